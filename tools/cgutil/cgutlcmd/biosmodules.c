@@ -29,6 +29,15 @@
  *
  * $Log:   S:/CG/archives/CGTOOLS/CGUTIL/W32DOSX/CGUTLCMD/BiosModules.c-arc  $
  * 
+ * MOD005: /BATCH rejects commands writing files (/SAVE, /DSAVE, /SLIST, /CREATE) and
+ *         lines longer than the line buffer.
+ * 
+ * MOD004: Report the free module space including the free gaps of the section.
+ * 
+ * MOD003: Added option /MTD:xxx to access the MPFA sections through a Linux MTD device.
+ * 
+ * MOD002: Added command /BATCH to execute several commands and apply all changes at once.
+ * 
  *    Rev 1.6   Sep 06 2016 16:28:24   congatec
  * Added BSD header.
  * MOD001: Corrected usage description, especially for module creation.
@@ -66,6 +75,7 @@
 
 #include "cgutlcmn.h"
 #include "cgbmod.h"
+#include "cgstore.h"																//MOD003
 
 
 /*--------------
@@ -90,12 +100,18 @@ extern _TCHAR *g_lpszBiosFilename;
 #define CMD_SET_OEM         7
 #define CMD_CMP_MOD         8
 
+// Batch file limits															//MOD002
+#define BATCH_MAX_LINE      1024
+#define BATCH_MAX_ARGS      16
+
 /*-------------------------
  * Module global variables
  *-------------------------
  */
 static _TCHAR szBiosFilename[256], szInpFilename[256], szOutpFilename[256];
+static _TCHAR szMtdDevice[256] = {0};											//MOD003
 static UINT32 command;
+static UINT32 nCompFlags, nSaveFlags;											//MOD002
 static _TCHAR szOemBiosVersion[256] = {0};
    
 static CG_MPFA_MODULE_HEADER localMpfaHeader = {CG_MPFA_MOD_HDR_ID,     //hdrID
@@ -136,6 +152,11 @@ static void ShowUsage(void)
     PRINTF(_T("                 respective board.\n"));
     PRINTF(_T("        All other strings are interpreted as name of the BIOS file\n"));
     PRINTF(_T("        to be used as operation target.\n"));
+#ifdef LINUX																	//MOD003 v
+    PRINTF(_T("/MTD:xxx - Only with /OT:BOARD, right before the command. Access the MPFA\n"));
+    PRINTF(_T("        sections through MTD device xxx (e.g. /dev/mtd0 of the intel-spi\n"));
+    PRINTF(_T("        driver) instead of the CGOS interface.\n"));
+#endif																			//MOD003 ^
     PRINTF(_T("/IF:  - Specify the input data file (depends on command).\n"));      
     PRINTF(_T("/OF:  - Specify the output data file (depends on command).\n"));      
 
@@ -159,6 +180,10 @@ static void ShowUsage(void)
     PRINTF(_T("/INFO    - Display the OEM BIOS version (if assigned) and information\n"));
     PRINTF(_T("           about the free space left in the module storage area.\n"));
     PRINTF(_T("/OEM:xxx - Assign OEM BIOS version (eight characters max.).\n"));
+    PRINTF(_T("/BATCH   - Execute the commands of the input file (one command with\n"));	//MOD002 v
+    PRINTF(_T("           its parameters per line) and apply all changes at once.\n"));
+    PRINTF(_T("           If a command fails, none of the changes is applied.\n"));	//MOD002 ^
+    PRINTF(_T("           /SAVE, /DSAVE, /SLIST and /CREATE are not allowed.\n"));		//MOD005
 
     PRINTF(_T("\nPress ENTER to continue...\n"));
     getch();
@@ -243,7 +268,7 @@ UINT16 CgMpfaListModules
     }
 
     fprintf(fpOutDatafile,_T("\nBIOS Module Overview\n\n"));
-    fprintf(fpOutDatafile,_T("Space available for new modules:0x%X Bytes\n"),(CgMpfaStaticInfo.sectionSize - CgMpfaStaticInfo.addIndex));
+    fprintf(fpOutDatafile,_T("Space available for new modules:0x%X Bytes\n"),CgMpfaGetFreeSpace(&CgMpfaStaticInfo));	//MOD004
     fprintf(fpOutDatafile,_T("\nDetected BIOS Modules:\n\n"));
 
     if(fpOutDatafile == stdout)
@@ -310,83 +335,39 @@ UINT16 CgMpfaListModules
     return CG_MPFARET_OK;
 }
 
+//MOD002 v
 /*---------------------------------------------------------------------------
- * Name: HandleBiosModules
- * Desc: Main BIOS MPFA module interface handler.
- * Inp:  argc   - Number of command line arguments passed
- *       argv[] - Array of pointers to command line parameters
- * Outp: none       
+ * Name: ParseCommand
+ * Desc: Parse a module command and its parameters.
+ * Inp:  argc          - Number of arguments
+ *       argv          - Arguments, argv[0] holds the command
+ * Outp: TRUE on success, FALSE on a parameter error
  *---------------------------------------------------------------------------
  */
-void HandleBiosModules(INT32 argc, _TCHAR* argv[])
+static UINT16 ParseCommand(INT32 argc, _TCHAR* argv[])
 {
     _TCHAR	cTemp;
-    INT32	i, parStart, exitState = 0;
-    UINT32	retVal, modType, modRev, modLoadTime, modExecTime,
-                        modLoadAddr, modEntryOff, modID, nCompFlags,
-                        nSaveFlags, j;											//MOD001
-    UINT16	bOutpFileRequired, bInpFileRequired ,
-			bModParRequired, bApplyChangeReq,bModTypeFound;						//MOD001
-    FILE	*fpOutDatafile;
-        
-    PRINTF(_T("BIOS Module Modification Module\n"));
-    if(argc < 2)
-    {
-        ShowUsage();
-        exit(1);
-    }
-    // Select operation target / operation mode.
-    if (STRNCMP(argv[1], _T("/OT:"), 4) != 0)
-	{
-        PRINTF(_T("ERROR: You have to select an operation target!\n"));
-        exit(1);
-    }
-    if ((SSCANF(argv[1], _T("/OT:%s%c"), &szBiosFilename[0], &cTemp) == 1) ||
-        (SSCANF(argv[1], _T("/ot:%s%c"), &szBiosFilename[0], &cTemp) == 1))
-	{
-	    if(STRNCMP(&szBiosFilename[0], _T("BOARD"), 5) == 0)
-        {
-            g_nOperationTarget = OT_BOARD;
-        }
-        else if (STRNCMP(&szBiosFilename[0], _T("NONE"), 4) == 0)
-        {
-            g_nOperationTarget = OT_NONE;
-        }
-        else
-        {
-            g_nOperationTarget = OT_ROMFILE;
-            g_lpszBiosFilename = &szBiosFilename[0];
-        }
-    }
-	else
-	{
-        PRINTF(_T("ERROR: You have to select an operation target!\n"));
-        exit(1);
-	}
-
-
-    if(argc < 3)
-    {
-        PRINTF(_T("ERROR: You have to pass a command!\n"));
-        exit(1);
-    }
+    INT32	i, parStart;
+    UINT32	modType, modRev, modLoadTime, modExecTime,
+                        modLoadAddr, modEntryOff, modID;
+    UINT16	bOutpFileRequired, bInpFileRequired, bModParRequired;
 
-	// Select command to be processed
-    if (STRNCMP(argv[2], _T("/ADD"), 4) == 0)
+    // Select command to be processed
+    if (STRNCMP(argv[0], _T("/ADD"), 4) == 0)
 	{
         command = CMD_ADD_MOD;
         bInpFileRequired = TRUE;
         bOutpFileRequired = FALSE;
         bModParRequired = FALSE;
     }
-    else if (STRNCMP(argv[2], _T("/DEL"),4) == 0)
+    else if (STRNCMP(argv[0], _T("/DEL"),4) == 0)
 	{
         command = CMD_DEL_MOD;
         bInpFileRequired = FALSE;
         bOutpFileRequired = FALSE;
         bModParRequired = TRUE;
     }
-    else if (STRNCMP(argv[2], _T("/CMP"),4) == 0)
+    else if (STRNCMP(argv[0], _T("/CMP"),4) == 0)
 	{
         command = CMD_CMP_MOD;
         bInpFileRequired = TRUE;
@@ -394,7 +375,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         bModParRequired = FALSE;
         nCompFlags = CG_MPFACMP_ALL;
     }
-    else if (STRNCMP(argv[2], _T("/DCMP"),5) == 0)
+    else if (STRNCMP(argv[0], _T("/DCMP"),5) == 0)
 	{
         command = CMD_CMP_MOD;
         bInpFileRequired = TRUE;
@@ -402,7 +383,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         bModParRequired = TRUE;
         nCompFlags = 0;         // Will be set later on.
     }
-    else if (STRNCMP(argv[2], _T("/SAVE"),5) == 0)
+    else if (STRNCMP(argv[0], _T("/SAVE"),5) == 0)
 	{
         command = CMD_SAVE_MOD;
         nSaveFlags = CG_MPFASFL_MOD;
@@ -410,7 +391,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         bOutpFileRequired = TRUE;
         bModParRequired = TRUE;
     }
-    else if (STRNCMP(argv[2], _T("/DSAVE"),6) == 0)
+    else if (STRNCMP(argv[0], _T("/DSAVE"),6) == 0)
 	{
         command = CMD_SAVE_MOD;
         nSaveFlags = CG_MPFASFL_DATA;
@@ -418,61 +399,61 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         bOutpFileRequired = TRUE;
         bModParRequired = TRUE;
     }
-    else if (STRNCMP(argv[2], _T("/LIST"),5) == 0)
+    else if (STRNCMP(argv[0], _T("/LIST"),5) == 0)
 	{
         command = CMD_DISPLAY_LIST;
         bInpFileRequired = FALSE;
         bOutpFileRequired = FALSE;
         bModParRequired = FALSE;
     }
-    else if (STRNCMP(argv[2], _T("/SLIST"),6) == 0)
+    else if (STRNCMP(argv[0], _T("/SLIST"),6) == 0)
 	{
         command = CMD_SAVE_LIST;
         bInpFileRequired = FALSE;
         bOutpFileRequired = TRUE;
         bModParRequired = FALSE;
     }
-    else if (STRNCMP(argv[2], _T("/CREATE"),7) == 0)
+    else if (STRNCMP(argv[0], _T("/CREATE"),7) == 0)
 	{
         command = CMD_CREATE_MOD;
         bInpFileRequired = TRUE;
         bOutpFileRequired = TRUE;
         bModParRequired = TRUE;
     }
-    else if (STRNCMP(argv[2], _T("/INFO"),5) == 0)
+    else if (STRNCMP(argv[0], _T("/INFO"),5) == 0)
 	{
         command = CMD_INFO;
         bInpFileRequired = FALSE;
         bOutpFileRequired = FALSE;
         bModParRequired = FALSE;
     }
-    else if (STRNCMP(argv[2], _T("/OEM:"),5) == 0)
+    else if (STRNCMP(argv[0], _T("/OEM:"),5) == 0)
 	{
         command = CMD_SET_OEM;
         bInpFileRequired = FALSE;
         bOutpFileRequired = FALSE;
         bModParRequired = FALSE;
-        if ((SSCANF(argv[2], _T("/OEM:%8s%c"), &szOemBiosVersion[0], &cTemp) != 1) &&
-            (SSCANF(argv[2], _T("/oem:%8s%c"), &szOemBiosVersion[0], &cTemp) != 1))
+        if ((SSCANF(argv[0], _T("/OEM:%8s%c"), &szOemBiosVersion[0], &cTemp) != 1) &&
+            (SSCANF(argv[0], _T("/oem:%8s%c"), &szOemBiosVersion[0], &cTemp) != 1))
 	    {
             PRINTF(_T("ERROR: Invalid OEM version specified (min. 1, max. 8 characters)!\n"));          
-            exit(1);
+            return FALSE;
         }
     }
     else
     {
         PRINTF(_T("ERROR: Unknown command!\n"));
-        exit(1);
+        return FALSE;
     }
 
     if((g_nOperationTarget == OT_NONE) &&(command != CMD_CREATE_MOD))
     {
         PRINTF(_T("ERROR: Only CREATE command is supported with operation target NONE!\n"));
-        exit(1);
+        return FALSE;
     }
 
     // Minimum set of module parameters
-    parStart = 3;
+    parStart = 1;
 
     // Select input/output data file name
     if (bInpFileRequired)
@@ -480,18 +461,18 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         if(argc < parStart + 1)
         {
             PRINTF(_T("ERROR: You have to specify an input file!\n"));
-            exit(1);
+            return FALSE;
         }
         if (STRNCMP(argv[parStart], _T("/IF:"), 4) != 0)
 	    {
             PRINTF(_T("ERROR: You have to specify an input file!\n"));
-            exit(1);
+            return FALSE;
         }
         if ((SSCANF(argv[parStart], _T("/IF:%s%c"), &szInpFilename[0], &cTemp) != 1) &&
             (SSCANF(argv[parStart], _T("/if:%s%c"), &szInpFilename[0], &cTemp) != 1))
 	    {
             PRINTF(_T("ERROR: You have to specify an input file!\n"));
-            exit(1);
+            return FALSE;
         }
         parStart = parStart + 1;
     }
@@ -500,18 +481,18 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         if(argc < parStart + 1)
         {
             PRINTF(_T("ERROR: You have to specify an output file!\n"));
-            exit(1);
+            return FALSE;
         }
         if (STRNCMP(argv[parStart], _T("/OF:"), 4) != 0)
 	    {
             PRINTF(_T("ERROR: You have to specify an output file!\n"));
-            exit(1);
+            return FALSE;
         }
         if ((SSCANF(argv[parStart], _T("/OF:%s%c"), &szOutpFilename[0], &cTemp) != 1) &&
             (SSCANF(argv[parStart], _T("/of:%s%c"), &szOutpFilename[0], &cTemp) != 1))
 	    {
             PRINTF(_T("ERROR: You have to specify an output file!\n"));
-            exit(1);
+            return FALSE;
         }
         parStart = parStart + 1;
     }
@@ -521,7 +502,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
         if(argc < parStart + 1)
         {
             PRINTF(_T("ERROR: At least a module type has to be specified!\n"));
-            exit(1);
+            return FALSE;
         }
         // Scan for parameters and store them in a MPFA header structure.
         nCompFlags = 0;
@@ -534,7 +515,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/t:%x%c"), &modType, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: Type parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modType = (unsigned char) modType;
                 nCompFlags = nCompFlags | CG_MPFACMP_TYPE;
@@ -546,7 +527,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/id:%x%c"), &modID, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: ID parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modID = (UINT16)modID;
                 nCompFlags = nCompFlags | CG_MPFACMP_ID;
@@ -558,7 +539,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/r:%x%c"), &modRev, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: Revision parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modRev = (unsigned char) modRev;
                 nCompFlags = nCompFlags | CG_MPFACMP_REV;
@@ -570,7 +551,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/la:%X%c"), &modLoadAddr, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: Load address parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modLoadAddr = modLoadAddr;
                 nCompFlags = nCompFlags | CG_MPFACMP_LOADADDR;
@@ -582,7 +563,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/lt:%x%c"), &modLoadTime, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: Load time parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modLoadTime = (unsigned char)modLoadTime;
                 nCompFlags = nCompFlags | CG_MPFACMP_LOADTIME;
@@ -594,7 +575,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/et:%x%c"), &modExecTime, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: Execution time parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modExecTime = (unsigned char)modExecTime;
                 nCompFlags = nCompFlags | CG_MPFACMP_EXECTIME;
@@ -606,7 +587,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
                     (SSCANF(argv[i], _T("/o:%x%c"), &modEntryOff, &cTemp) != 1))
 			    {
                     PRINTF(_T("ERROR: Entry offset parameter parse error!\n"));
-                    exit(1);
+                    return FALSE;
                 }
                 localMpfaHeader.modEntryOff = modEntryOff;
                 nCompFlags = nCompFlags | CG_MPFACMP_ENTRYOFF;
@@ -614,7 +595,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             else
             {
                 PRINTF(_T("ERROR: Unknown parameter!\n"));
-                exit(1);
+                return FALSE;
             }
         }
     }
@@ -623,34 +604,26 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
     if((localMpfaHeader.modType == 0) && (bModParRequired == TRUE))
     {
         PRINTF(_T("ERROR: You have to specify a module type!\n"));
-        exit(1);
+        return FALSE;
     }
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: ExecuteCommand
+ * Desc: Execute the parsed module command on the MPFA sections held in
+ *       memory. Changes are not applied to the operation target.
+ * Inp:  pbApplyChangeReq - Set to TRUE if the command changed the sections
+ * Outp: exit state: 0 - success, 1 - error
+ *---------------------------------------------------------------------------
+ */
+static INT32 ExecuteCommand(UINT16 *pbApplyChangeReq)
+{
+    INT32	exitState = 0;
+    UINT32	retVal, j;
+    UINT16	bModTypeFound;
+    FILE	*fpOutDatafile;
 
-    //
-    // Begin command execution.
-    //
-    if((retVal = CgMpfaStart(FALSE)) != CG_MPFARET_OK)
-    {
-        if(retVal == CG_MPFARET_INTRF_ERROR)
-        {
-            if(g_nOperationTarget == OT_ROMFILE)
-            {
-                PRINTF(_T("ERROR: Failed to access BIOS file!\n"));
-            }
-            else
-            {
-                PRINTF(_T("ERROR: Failed to access system interface!\n"));
-            }       
-        }
-        else
-        {
-            PRINTF(_T("ERROR: Failed to perform module initialisation!\n"));
-        }
-    }
-    else
-    {
-        exitState = 0;
-        bApplyChangeReq = FALSE;
         switch(command)
         {
         case CMD_ADD_MOD:
@@ -699,7 +672,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             }
             else
             {
-                bApplyChangeReq = TRUE;
+                *pbApplyChangeReq = TRUE;
                 PRINTF(_T("DONE\n"));
             }
             break;
@@ -725,7 +698,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             }
             else
             {
-                bApplyChangeReq = TRUE;
+                *pbApplyChangeReq = TRUE;
                 PRINTF(_T("DONE\n"));
             }
             break;
@@ -780,7 +753,6 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             }
             else
             {
-                bApplyChangeReq = FALSE;
                 PRINTF(_T("DONE\n"));
             }
             break;
@@ -835,7 +807,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             {
                 PRINTF(_T("OEM BIOS version                  : %s\n"), &szOemBiosVersion[0]);
             }
-            PRINTF(_T("Space available for new modules   : 0x%X bytes\n"), (CgMpfaStaticInfo.sectionSize - CgMpfaStaticInfo.addIndex));
+            PRINTF(_T("Space available for new modules   : 0x%X bytes\n"), CgMpfaGetFreeSpace(&CgMpfaStaticInfo));	//MOD004
             break;
 
         case CMD_CREATE_MOD:
@@ -911,7 +883,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             }
             else
             {
-                bApplyChangeReq = TRUE;
+                *pbApplyChangeReq = TRUE;
                 PRINTF(_T("DONE\n"));
             }
             break;
@@ -920,6 +892,234 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             exitState = 1;
             break;
         }
+    return exitState;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: ExecuteBatch
+ * Desc: Execute the module commands of a batch file on the MPFA sections
+ *       held in memory. Each line holds one command with its parameters,
+ *       e.g. '/ADD /IF:logo.mod' or '/DEL /T:6'. Empty lines and lines
+ *       starting with ';' are skipped. If a command fails, the remaining
+ *       commands are not executed and all changes are discarded.
+ *       Commands that write output files (/SAVE, /DSAVE, /SLIST, /CREATE)
+ *       are rejected, as their files could not be discarded.
+ * Inp:  lpszBatchFilename - Name of the batch file
+ *       pbApplyChangeReq  - Set to TRUE if the commands changed the sections
+ * Outp: exit state: 0 - success, 1 - error
+ *---------------------------------------------------------------------------
+ */
+static INT32 ExecuteBatch(_TCHAR *lpszBatchFilename, UINT16 *pbApplyChangeReq)
+{
+    FILE	*fpBatchfile;
+    char	szLine[BATCH_MAX_LINE];
+    _TCHAR	*argvBatch[BATCH_MAX_ARGS + 1];
+    INT32	argcBatch, nLine = 0, exitState = 0;
+    UINT16	bApplyChangeReq = FALSE;
+    CG_MPFA_MODULE_HEADER defaultMpfaHeader = localMpfaHeader;
+
+    if (!(fpBatchfile = fopen(lpszBatchFilename, "rt")))
+    {
+        PRINTF(_T("ERROR: Failed to open batch file!\n"));
+        return 1;
+    }
+    while(fgets(&szLine[0], sizeof(szLine), fpBatchfile) != NULL)
+    {
+        nLine = nLine + 1;
+        if((strchr(&szLine[0], '\n') == NULL) && !feof(fpBatchfile))			//MOD005 v
+        {
+            PRINTF(_T("[%d] ERROR: Line too long!\n"), nLine);
+            exitState = 1;
+            break;
+        }																		//MOD005 ^
+        argcBatch = 0;
+        argvBatch[0] = strtok(&szLine[0], " \t\r\n");
+        while((argvBatch[argcBatch] != NULL) && (argcBatch < BATCH_MAX_ARGS))
+        {
+            argcBatch = argcBatch + 1;
+            argvBatch[argcBatch] = strtok(NULL, " \t\r\n");
+        }
+        if((argcBatch == 0) || (argvBatch[0][0] == ';'))
+        {
+            continue;
+        }
+        PRINTF(_T("[%d] "), nLine);
+        if(argvBatch[argcBatch] != NULL)
+        {
+            PRINTF(_T("ERROR: Too many parameters!\n"));
+            exitState = 1;
+            break;
+        }
+        if (STRNCMP(argvBatch[0], _T("/BATCH"), 6) == 0)
+        {
+            PRINTF(_T("ERROR: Batch files cannot be nested!\n"));
+            exitState = 1;
+            break;
+        }
+        // Each command starts with the default module parameters
+        localMpfaHeader = defaultMpfaHeader;
+        if(!ParseCommand(argcBatch, argvBatch))
+        {
+            exitState = 1;
+            break;
+        }
+        if((command == CMD_SAVE_MOD) || (command == CMD_SAVE_LIST) || (command == CMD_CREATE_MOD))	//MOD005 v
+        {
+            // Output files are written at once and can't be discarded on errors
+            PRINTF(_T("ERROR: Commands writing files are not allowed in batch files!\n"));
+            exitState = 1;
+            break;
+        }																		//MOD005 ^
+        if((exitState = ExecuteCommand(&bApplyChangeReq)) != 0)
+        {
+            break;
+        }
+    }
+    fclose(fpBatchfile);
+
+    if(exitState != 0)
+    {
+        PRINTF(_T("ERROR: Batch command in line %d failed, all changes are discarded!\n"), nLine);
+        bApplyChangeReq = FALSE;
+    }
+    *pbApplyChangeReq = bApplyChangeReq;
+    return exitState;
+}
+																				//MOD002 ^
+
+/*---------------------------------------------------------------------------
+ * Name: HandleBiosModules
+ * Desc: Main BIOS MPFA module interface handler.
+ * Inp:  argc   - Number of command line arguments passed
+ *       argv[] - Array of pointers to command line parameters
+ * Outp: none       
+ *---------------------------------------------------------------------------
+ */
+void HandleBiosModules(INT32 argc, _TCHAR* argv[])
+{
+    _TCHAR	cTemp;
+    INT32	exitState = 0;
+    UINT32	retVal;
+    UINT16	bApplyChangeReq, bBatch;											//MOD002
+    INT32	nCmdArg;																//MOD003
+        
+    PRINTF(_T("BIOS Module Modification Module\n"));
+    if(argc < 2)
+    {
+        ShowUsage();
+        exit(1);
+    }
+    // Select operation target / operation mode.
+    if (STRNCMP(argv[1], _T("/OT:"), 4) != 0)
+	{
+        PRINTF(_T("ERROR: You have to select an operation target!\n"));
+        exit(1);
+    }
+    if ((SSCANF(argv[1], _T("/OT:%s%c"), &szBiosFilename[0], &cTemp) == 1) ||
+        (SSCANF(argv[1], _T("/ot:%s%c"), &szBiosFilename[0], &cTemp) == 1))
+	{
+	    if(STRNCMP(&szBiosFilename[0], _T("BOARD"), 5) == 0)
+        {
+            g_nOperationTarget = OT_BOARD;
+        }
+        else if (STRNCMP(&szBiosFilename[0], _T("NONE"), 4) == 0)
+        {
+            g_nOperationTarget = OT_NONE;
+        }
+        else
+        {
+            g_nOperationTarget = OT_ROMFILE;
+            g_lpszBiosFilename = &szBiosFilename[0];
+        }
+    }
+	else
+	{
+        PRINTF(_T("ERROR: You have to select an operation target!\n"));
+        exit(1);
+	}
+
+
+    // Optional MTD device, the command follows it						//MOD003 v
+    nCmdArg = 2;
+#ifdef LINUX
+    if((argc > 2) && (STRNCMP(argv[2], _T("/MTD:"), 5) == 0))
+    {
+        if((g_nOperationTarget != OT_BOARD) ||
+           (SSCANF(argv[2] + 5, _T("%255s%c"), &szMtdDevice[0], &cTemp) != 1))
+        {
+            PRINTF(_T("ERROR: Invalid MTD device specified!\n"));
+            exit(1);
+        }
+        nCmdArg = 3;
+    }
+#endif																		//MOD003 ^
+
+    if(argc <= nCmdArg)														//MOD003
+    {
+        PRINTF(_T("ERROR: You have to pass a command!\n"));
+        exit(1);
+    }
+
+    // A batch file holds several commands that are applied together		//MOD002 v
+    bBatch = FALSE;
+    if (STRNCMP(argv[nCmdArg], _T("/BATCH"), 6) == 0)						//MOD003
+    {
+        if ((argc != (nCmdArg + 2)) ||										//MOD003
+            ((SSCANF(argv[nCmdArg + 1], _T("/IF:%s%c"), &szInpFilename[0], &cTemp) != 1) &&	//MOD003
+             (SSCANF(argv[nCmdArg + 1], _T("/if:%s%c"), &szInpFilename[0], &cTemp) != 1)))	//MOD003
+        {
+            PRINTF(_T("ERROR: You have to specify a batch file!\n"));
+            exit(1);
+        }
+        bBatch = TRUE;
+    }
+    else if (!ParseCommand(argc - nCmdArg, &argv[nCmdArg]))				//MOD003
+    {
+        exit(1);
+    }																		//MOD002 ^
+
+    // The MPFA engine erases and writes the sections in 64KB blocks		//MOD003 v
+    if(szMtdDevice[0] &&
+       (!CgStoreOpenMtd(&szMtdDevice[0]) || !CgStoreMapMpfaSections(64 * 1024)))
+    {
+        PRINTF(_T("ERROR: Failed to access the MPFA sections through the MTD device!\n"));
+        CgStoreClose();
+        exit(1);
+    }																		//MOD003 ^
+
+    //
+    // Begin command execution.
+    //
+    if((retVal = CgMpfaStart(FALSE)) != CG_MPFARET_OK)
+    {
+        if(retVal == CG_MPFARET_INTRF_ERROR)
+        {
+            if(g_nOperationTarget == OT_ROMFILE)
+            {
+                PRINTF(_T("ERROR: Failed to access BIOS file!\n"));
+            }
+            else
+            {
+                PRINTF(_T("ERROR: Failed to access system interface!\n"));
+            }       
+        }
+        else
+        {
+            PRINTF(_T("ERROR: Failed to perform module initialisation!\n"));
+        }
+    }
+    else
+    {
+        exitState = 0;
+        bApplyChangeReq = FALSE;
+        if(bBatch)																//MOD002 v
+        {
+            exitState = ExecuteBatch(&szInpFilename[0], &bApplyChangeReq);
+        }
+        else
+        {
+            exitState = ExecuteCommand(&bApplyChangeReq);
+        }																		//MOD002 ^
         if(bApplyChangeReq == TRUE)
         {
             PRINTF(_T("Applying changes to operation target..."));
@@ -948,6 +1148,7 @@ void HandleBiosModules(INT32 argc, _TCHAR* argv[])
             PRINTF(_T("ERROR: Failed to perform module cleanup!\n"));
             exitState = 1;
     }
+    CgStoreClose();																//MOD003
     exit(exitState);
 }
 
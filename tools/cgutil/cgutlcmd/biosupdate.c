@@ -29,6 +29,42 @@
  *
  * $Log:   S:/CG/archives/CGTOOLS/CGUTIL/W32DOSX/CGUTLCMD/BiosUpdate.c-arc  $
  * 
+ * MOD023: /UPTODATE usage: the flash is always read, cached digests are only a hint.
+ * 
+ * MOD022: /BOARDS:ALL rejects extended updates and /AOO. Workers never restart the system.
+ * 
+ * MOD021: Match /BOARDS:ALL exactly.
+ * 
+ * MOD020: Added option /UPTODATE to skip the update if the flash already holds the
+ *         BIOS file (exit code 13).
+ * 
+ * MOD019: Added option /MTD:xxx to access the BIOS flash through a Linux MTD device.
+ * 
+ * MOD018: Added option /SBL for a Slim Bootloader component aware update.
+ * 
+ * MOD017: Added option /STITCH:xxx to replace the BIOS region of a full flash image.
+ * 
+ * MOD016: Added option /TELEMETRY:xxx to record the update events as JSON lines.
+ * 
+ * MOD015: Added option /BOARDS:ALL to update all CGOS boards in parallel.
+ * 
+ * MOD014: Added option /SPARSE to write /S and /BACKUP files as backup container.
+ * 
+ * MOD013: Added option /BACKUP:xxx to save the flash contents before the update.
+ * 
+ * MOD012: Added option /JOURNAL to make an interrupted update resumable.
+ * 
+ * MOD011: Added option /REGION:xxx to update only the given flash descriptor regions.
+ * 
+ * MOD010: Added option /DIFF for a differential update.
+ * 
+ * MOD009: Parse option /LAN. Wait 50ms after each progress report.
+ * 
+ * MOD008: Added option /LAN to restore the LAN areas with an extended update.
+ *         No 1s wait after each progress report.
+ * 
+ * MOD007: Added option /P to preserve the BIOS password.
+ * 
  *    Rev 1.11   Sep 06 2016 16:44:18   congatec
  * Added BSD header.
  * MOD006:
@@ -85,23 +121,99 @@
  */
 #include "cgutlcmn.h"
 #include "biosflsh.h"
+#include "cgifd.h"														//MOD011
 #include "cgbmod.h"
+#include "cgtelem.h"													//MOD016
+#include "cgstore.h"													//MOD019
 
 /*--------------
  * Externs used
  *--------------
  */
-extern UINT32 nFlashSize, nFlashBlockSize, nExtdFlashSize;						//MOD003
+extern CG_TLS UINT32 nFlashSize, nFlashBlockSize, nExtdFlashSize;						//MOD003
+extern UINT32 nBfRegionMask;													//MOD011
+extern CG_TLS _TCHAR szBfBackupFile[256];												//MOD013
+extern UINT16 bBfSparseBackup;													//MOD014
+extern _TCHAR szBfStitchFile[256];												//MOD017
 
 /*--------------------
  * Local definitions
  *--------------------
  */
 
+#define BF_BOARD_LOG_SIZE       2048										//MOD015 v
+#define BF_PROGRESS_WIDTH       78
+
+// State of one board updated with /BOARDS:ALL
+typedef struct {
+	UINT32 nBfRet;							// Result of the update
+	_TCHAR *lpszError;						// Error not covered by nBfRet or NULL
+	_TCHAR szLog[BF_BOARD_LOG_SIZE];		// Report output of the update
+} BF_BOARD_STATE;																//MOD015 ^
+
 /*------------------
  * Global variables
  *------------------
  */
+static BF_BOARD_STATE *pBoardStates = NULL;									//MOD015 v
+static UINT32 nBoardStates = 0;
+static CG_TLS BF_BOARD_STATE *pBoardState = NULL;	// Board of the calling worker thread
+static _TCHAR *lpszBoardsBiosFile;
+static _TCHAR *lpszBoardsPassword;
+static _TCHAR szBoardsBackupFile[256];
+static UINT32 nBoardsFlags;														//MOD015 ^
+																				//MOD011 v
+// Flash region names accepted by the /REGION: option
+static const struct {
+	_TCHAR *lpszName;
+	UINT32 nLen;
+	UINT32 nRegion;
+} BiosUpdateRegions[] = {
+	{ _T("DESC"),	4,	CG_IFD_REGION_DESC },
+	{ _T("BIOS"),	4,	CG_IFD_REGION_BIOS },
+	{ _T("ME"),		2,	CG_IFD_REGION_ME },
+	{ _T("GBE"),	3,	CG_IFD_REGION_GBE },
+	{ _T("PDR"),	3,	CG_IFD_REGION_PDR },
+	{ _T("EC"),		2,	CG_IFD_REGION_EC }
+};
+
+/*---------------------------------------------------------------------------
+ * Name: ParseRegionList
+ * Desc: Converts a comma separated list of flash region names into a mask.
+ * Inp:  lpszList       - Region list, e.g. "BIOS,EC".
+ * Outp: Bit mask of selected regions (bit n = flash region n) or 0 if the
+ *       list contains an unknown region.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 ParseRegionList(_TCHAR *lpszList)
+{
+	UINT32 nMask = 0;
+	UINT32 i, nLen;
+
+	while(*lpszList)
+	{
+		for(i = 0; i < (sizeof(BiosUpdateRegions) / sizeof(BiosUpdateRegions[0])); i++)
+		{
+			nLen = BiosUpdateRegions[i].nLen;
+			if((STRNCMP(lpszList, BiosUpdateRegions[i].lpszName, nLen) == 0) &&
+			   ((lpszList[nLen] == _T(',')) || (lpszList[nLen] == 0)))
+			{
+				break;
+			}
+		}
+		if(i >= (sizeof(BiosUpdateRegions) / sizeof(BiosUpdateRegions[0])))
+		{
+			return 0;
+		}
+		nMask = nMask | (1 << BiosUpdateRegions[i].nRegion);
+		lpszList = lpszList + nLen;
+		if(*lpszList == _T(','))
+		{
+			lpszList++;
+		}
+	}
+	return nMask;
+}																				//MOD011 ^
 
 /*---------------------------------------------------------------------------
  * Name:
@@ -140,6 +252,39 @@ static void ShowUsage(void)
         PRINTF(_T("/NOC     - Do not invalidate CMOS (DEFAULT).\n"));
 		PRINTF(_T("/P       - Preserve BIOS password.\n"));											//MOD007	
 		PRINTF(_T("/LAN     - Restore LAN area(s) when running an extended update.\n"));         	//MOD008	
+		PRINTF(_T("/DIFF    - Differential update. Only erase and write flash blocks that\n"));		//MOD010
+		PRINTF(_T("           differ from the BIOS file contents.\n"));							//MOD010
+		PRINTF(_T("/REGION:xxx - Only update the given flash regions (DESC,BIOS,ME,GBE,PDR,EC).\n"));	//MOD011 v
+		PRINTF(_T("           E.g. /REGION:BIOS,EC. Implies /EF. Flash region layouts of file\n"));
+		PRINTF(_T("           and flash part have to match.\n"));										//MOD011 ^
+		PRINTF(_T("/JOURNAL - Record the update progress in <BIOS file>.jnl. If the update is\n"));	//MOD012 v
+		PRINTF(_T("           interrupted, running it again continues with the blocks not\n"));
+		PRINTF(_T("           written yet.\n"));														//MOD012 ^
+		PRINTF(_T("/BACKUP:xxx - Save the current flash contents to file xxx before the update.\n"));	//MOD013 v
+		PRINTF(_T("           The flash is read only once for backup and /DIFF.\n"));				//MOD013 ^
+		PRINTF(_T("/SPARSE  - Write /S and /BACKUP files as sparse, compressed backup container.\n"));	//MOD014 v
+		PRINTF(_T("           A container can be passed as <BIOS file> to restore it. Only\n"));
+		PRINTF(_T("           blocks that differ are written.\n"));									//MOD014 ^
+		PRINTF(_T("/BOARDS:ALL - Update all boards provided by the CGOS interface in parallel.\n"));	//MOD015 v
+		PRINTF(_T("           /BACKUP files get the board number appended, e.g. xxx.0.\n"));		//MOD015 ^
+		PRINTF(_T("           Not possible with extended updates (/E, /REGION, ...) or /AOO.\n"));	//MOD022
+		PRINTF(_T("/TELEMETRY:xxx - Append update events (JSON lines) to file xxx: latency of\n"));	//MOD016 v
+		PRINTF(_T("           each block erase/program/verify, time per phase and a summary\n"));
+		PRINTF(_T("           with latency histogram.\n"));										//MOD016 ^
+		PRINTF(_T("/STITCH:xxx - Replace the BIOS region of <BIOS file> (full flash image) by\n"));	//MOD017 v
+		PRINTF(_T("           the BIOS image xxx, e.g. a Slim Bootloader image, and flash the\n"));
+		PRINTF(_T("           result. Implies /EF. Add /DIFF to only write the changed blocks.\n"));	//MOD017 ^
+		PRINTF(_T("/SBL     - Slim Bootloader update. Only write the components (Stage1A/1B/2,\n"));	//MOD018 v
+		PRINTF(_T("           payloads, config data, ...) of the flash map that differ from\n"));
+		PRINTF(_T("           the flash part, including their redundant A/B copies.\n"));			//MOD018 ^
+#ifdef LINUX																						//MOD019 v
+		PRINTF(_T("/MTD:xxx - Access the BIOS flash through MTD device xxx (e.g. /dev/mtd0 of the\n"));
+		PRINTF(_T("           intel-spi driver) instead of the CGOS interface.\n"));
+#endif																								//MOD019 ^
+		PRINTF(_T("/UPTODATE - Check the flash contents first and write nothing if the flash\n"));	//MOD020 v
+		PRINTF(_T("           already holds the BIOS file. The flash is always read, cached\n"));	//MOD023 v
+		PRINTF(_T("           block digests only help to find a difference early.\n"));			//MOD023 ^
+		PRINTF(_T("           Exit code 13 if nothing has been written.\n"));						//MOD020 ^
 		PRINTF(_T("/AOO     - Perform immediate/automatic off-on cycle to unlock extended\n"));				
 		PRINTF(_T("           BIOS area if necessary. (Default for DOS and UEFI)\n"));
 		PRINTF(_T("/NAOO    - Do NOT perform immediate/automatic off-on cycle to unlock extended\n"));				
@@ -192,6 +337,239 @@ static void ShowUsage(void)
 }
 
 
+/*---------------------------------------------------------------------------
+ * Name: ShowBiosFlashError
+ * Desc: Prints the reason for a failed BIOS update.
+ * Inp:  nBfRet         - Return code of CG_BiosFlash.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+static void ShowBiosFlashError(UINT32 nBfRet)									//MOD015
+{
+    if(nBfRet == CG_BFRET_INCOMP)
+    {
+        PRINTF(_T("Project ID of selected BIOS file and current BIOS do not match!\n"));
+        PRINTF(_T("The BIOS you tried to flash is not meant to be used on this board!\n"));
+        /*PRINTF(_T("Select 'Force Update' option (/F) to flash anyways.\n"));*/
+    }
+    else if(nBfRet == CG_BFRET_INVALID)
+    {
+        PRINTF(_T("The specified file is not a valid BIOS file!\n"));						//MOD001
+    }
+    else if(nBfRet == CG_BFRET_ERROR_SIZE)
+    {
+        PRINTF(_T("File size and flash size do not match!\n"));
+    }
+    else if(nBfRet == CG_BFRET_INTRF_ERROR)
+    {
+        PRINTF(_T("Failed to access system interface!\n"));
+    }
+    else if(nBfRet == CG_BFRET_ERROR_FILE)
+    {
+        PRINTF(_T("File processing error!\n"));
+    }
+    else if(nBfRet == CG_BFRET_ERROR_NOEXTD)												//MOD001 v
+    {
+        PRINTF(_T("Extended/full flash update not possible!\n"));
+    }
+    else if(nBfRet == CG_BFRET_ERROR_UNLOCK_EXTD)								
+    {
+        PRINTF(_T("Failed to unlock flash for extended/full flash update!\n"));
+    }
+    else if(nBfRet == CG_BFRET_ERROR_LOCK_EXTD)								
+    {
+        PRINTF(_T("Failed to lock flash after extended/full flash update!\n"));
+    }
+    else if(nBfRet == CG_BFRET_NOTCOMP_EXTD)								
+    {
+        PRINTF(_T("Extended/full flash update not (yet) completed!\n"));
+    }
+    else if(nBfRet == CG_BFRET_INCOMP_EXTD)								
+    {
+        PRINTF(_T("This platform/BIOS requires an extended/full flash update (/E)!\n"));
+    }																						//MOD001 ^
+    else if(nBfRet == CG_BFRET_ERROR_REGION)												//MOD011 v
+    {
+        PRINTF(_T("Flash region layouts of file and flash part do not match or\n"));
+        PRINTF(_T("selected flash region not present!\n"));
+    }																						//MOD011 ^
+    else
+    {
+        PRINTF(_T("Internal processing error!\n"));
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: BoardReportState
+ * Desc: Records report output of a worker thread in the log of its board
+ *       and shows the last line of all boards as aggregated progress.
+ * Inp:  nControl       - See BiosFlashReportState.
+ *       szReportString - Report string.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+static void BoardReportState(UINT32 nControl, _TCHAR *szReportString)			//MOD015
+{
+    _TCHAR szLine[BF_PROGRESS_WIDTH + 16];
+    _TCHAR *lpszLast;
+    UINT32 i, nLen, nWidth, nStart, nEnd;
+
+    CgutlLock();
+    nLen = (UINT32)strlen(pBoardState->szLog);
+    if(nControl == 2)
+    {
+        // Progress output replaces the current line
+        lpszLast = strrchr(pBoardState->szLog, '\n');
+        nLen = lpszLast ? (UINT32)(lpszLast - pBoardState->szLog) + 1 : 0;
+    }
+    else if((nControl != 1) && (nLen < (BF_BOARD_LOG_SIZE - 1)))
+    {
+        pBoardState->szLog[nLen++] = '\n';
+    }
+    if(nLen < (BF_BOARD_LOG_SIZE - 1))
+    {
+        // Further output is dropped if the log is full
+        strncpy(&pBoardState->szLog[nLen], szReportString, BF_BOARD_LOG_SIZE - 1 - nLen);
+        pBoardState->szLog[BF_BOARD_LOG_SIZE - 1] = 0;
+    }
+
+    // One column per board: [n] followed by the current line of its log
+    nWidth = BF_PROGRESS_WIDTH / nBoardStates;
+    if(nWidth < 8)
+    {
+        nWidth = 8;
+    }
+    PRINTF("\r");
+    for(i = 0; i < nBoardStates; i++)
+    {
+        // Last line that is not empty
+        for(nEnd = (UINT32)strlen(pBoardStates[i].szLog); (nEnd > 0) && isspace((unsigned char)pBoardStates[i].szLog[nEnd - 1]); nEnd--);
+        for(nStart = nEnd; (nStart > 0) && (pBoardStates[i].szLog[nStart - 1] != '\n'); nStart--);
+        SPRINTF(&szLine[0], "[%d] %.*s", i, (int)(((nEnd - nStart) > 70) ? 70 : (nEnd - nStart)), &pBoardStates[i].szLog[nStart]);
+        szLine[nWidth - 1] = 0;
+        PRINTF("%-*s ", nWidth - 1, &szLine[0]);
+    }
+    fflush(stdout);
+    CgutlUnlock();
+}
+
+/*---------------------------------------------------------------------------
+ * Name: BoardUpdateWorker
+ * Desc: Worker thread of /BOARDS:ALL. Updates one board.
+ * Inp:  nBoard         - Board index.
+ * Outp: None, the result is stored in pBoardStates[nBoard].
+ *---------------------------------------------------------------------------
+ */
+static void BoardUpdateWorker(UINT32 nBoard)									//MOD015
+{
+    pBoardState = &pBoardStates[nBoard];
+    if(!CgosOpenBoard(nBoard))
+    {
+        pBoardState->nBfRet = CG_BFRET_INTRF_ERROR;
+        return;
+    }
+    if(CgMpfaCheckBUPActive() &&
+       (!(*lpszBoardsPassword) || !CgMpfaSetBUPInactive(lpszBoardsPassword)))
+    {
+        pBoardState->nBfRet = CG_BFRET_ERROR;
+        pBoardState->lpszError = (*lpszBoardsPassword) ? _T("Failed to deactivate BIOS write protection!\n") :
+                                                         _T("BIOS write protection is active!\n");
+        CgosCloseBoard();
+        return;
+    }
+    if(nBoardsFlags & CG_BFFLAG_BACKUP)
+    {
+        // One backup file per board
+        SPRINTF(&szBfBackupFile[0], "%.240s.%d", &szBoardsBackupFile[0], nBoard);
+    }
+    CgTmBegin(nBoard, lpszBoardsBiosFile);										//MOD016
+    if((pBoardState->nBfRet = CG_BiosFlashPrepare()) == CG_BFRET_OK)
+    {
+        pBoardState->nBfRet = CG_BiosFlash(lpszBoardsBiosFile, nBoardsFlags);
+    }
+    CgTmEnd(pBoardState->nBfRet);												//MOD016
+    CgosCloseBoard();
+}
+
+/*---------------------------------------------------------------------------
+ * Name: BiosUpdateAllBoards
+ * Desc: Updates all boards provided by the CGOS interface in parallel, one
+ *       worker thread per board. Does not return.
+ * Inp:  lpszBiosFile   - BIOS file.
+ *       nFlags         - Update flags (CG_BFFLAG_xxx).
+ *       lpszPassword   - Password to deactivate the BIOS write protection
+ *                        or empty string.
+ * Outp: Exit code 0 if all boards have been updated, CG_BFRET_UPTODATE if
+ *       no board required an update, else the result of the first board
+ *       that failed.
+ *---------------------------------------------------------------------------
+ */
+static void BiosUpdateAllBoards(_TCHAR *lpszBiosFile, UINT32 nFlags, _TCHAR *lpszPassword)	//MOD015
+{
+    UINT32 i, nExit = 0;
+    UINT32 nUpToDate = 0;														//MOD020
+
+    // The board handle opened by CgosOpen is not used by the workers
+    CgosBoardClose(hCgos);
+    hCgos = 0;
+
+    nBoardStates = CgosGetBoardCount();
+    if((nBoardStates == 0) ||
+       ((pBoardStates = (BF_BOARD_STATE*)calloc(nBoardStates, sizeof(BF_BOARD_STATE))) == NULL))
+    {
+        PRINTF(_T("ERROR: Failed to access system interface!\n"));
+        CgosClose();
+        exit(1);
+    }
+    lpszBoardsBiosFile = lpszBiosFile;
+    lpszBoardsPassword = lpszPassword;
+    nBoardsFlags = nFlags;
+    strcpy(&szBoardsBackupFile[0], &szBfBackupFile[0]);
+    PRINTF(_T("Updating %d boards...\n"), nBoardStates);
+
+    if(!CgutlRunParallel(nBoardStates, BoardUpdateWorker))
+    {
+        PRINTF(_T("\nERROR: Failed to start update of all boards!\n"));
+        nExit = 1;
+    }
+
+    PRINTF(_T("\n"));
+    for(i = 0; i < nBoardStates; i++)
+    {
+        PRINTF(_T("\n--- Board %d ---%s\n"), i, pBoardStates[i].szLog);
+        if(pBoardStates[i].nBfRet == CG_BFRET_OK)
+        {
+            continue;
+        }
+        if(pBoardStates[i].nBfRet == CG_BFRET_UPTODATE)							//MOD020 v
+        {
+            nUpToDate++;
+            continue;
+        }																		//MOD020 ^
+        PRINTF(_T("\nERROR: Failed to update BIOS!\n"));
+        if(pBoardStates[i].lpszError)
+        {
+            PRINTF(_T("%s"), pBoardStates[i].lpszError);
+        }
+        else
+        {
+            ShowBiosFlashError(pBoardStates[i].nBfRet);
+        }
+        if(nExit == 0)
+        {
+            nExit = pBoardStates[i].nBfRet;
+        }
+    }
+    if((nExit == 0) && (nUpToDate == nBoardStates))								//MOD020 v
+    {
+        nExit = CG_BFRET_UPTODATE;
+    }																			//MOD020 ^
+    free(pBoardStates);
+    CgTmClose();																//MOD016
+    CgosClose();
+    exit(nExit);
+}
+
 /*---------------------------------------------------------------------------
  * Name:
  * Desc:
@@ -208,6 +586,10 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
     char    cTemp;
     _TCHAR szNewBiosFile[256];
     _TCHAR szBupPassword[256] = {0};											//MOD004
+    UINT16 bAllBoards = FALSE;													//MOD015
+    UINT16 bAutoOffOnSel = FALSE;												//MOD022
+    _TCHAR szTelemetryFile[256] = {0};											//MOD016
+    _TCHAR szMtdDevice[256] = {0};												//MOD019
 
     g_nOperationTarget = OT_BOARD;                   
 
@@ -302,12 +684,55 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
             {            
                 nFlags = nFlags | CG_BFFLAG_FORCE;
 		    }		
+            else if (STRNCMP(argv[i], "/SPARSE",7) == 0)						//MOD014 v
+            {
+                bBfSparseBackup = TRUE;
+            }																	//MOD014 ^
+            else if (STRNCMP(argv[i], "/SBL",4) == 0)							//MOD018 v
+            {
+                nFlags = nFlags | CG_BFFLAG_SBL;
+            }																	//MOD018 ^
+            else if (STRNCMP(argv[i], "/STITCH:",8) == 0)						//MOD017 v
+            {
+                if (SSCANF(argv[i] + 8, "%255s%c", &szBfStitchFile[0], &cTemp) != 1)
+                {
+                    PRINTF(_T("ERROR: Invalid BIOS image file name specified!\n"));
+                    exit(1);
+                }
+                nFlags = nFlags | CG_BFFLAG_STITCH;
+                nFlags = nFlags | CG_BFFLAG_EXTD;
+                nFlags = nFlags | CG_BFFLAG_FEXTD;
+            }																	//MOD017 ^
 #ifdef INTERN																	//MOD006
             else if (STRNCMP(argv[i], "/S",2) == 0)
             {            
                 nFlags = nFlags | CG_BFFLAG_SAVE;
 		    }
 #endif																			//MOD006
+            else if (STRNCMP(argv[i], _T("/BOARDS:ALL"), 12) == 0)				//MOD015 v //MOD021
+            {
+                bAllBoards = TRUE;
+            }																	//MOD015 ^
+            else if (STRNCMP(argv[i], "/TELEMETRY:",11) == 0)					//MOD016 v
+            {
+                if (SSCANF(argv[i] + 11, "%255s%c", &szTelemetryFile[0], &cTemp) != 1)
+                {
+                    PRINTF(_T("ERROR: Invalid telemetry file name specified!\n"));
+                    exit(1);
+                }
+            }																	//MOD016 ^
+            else if (STRNCMP(argv[i], "/UPTODATE",9) == 0)						//MOD020 v
+            {
+                nFlags = nFlags | CG_BFFLAG_UPTODATE;
+            }																	//MOD020 ^
+            else if (STRNCMP(argv[i], "/MTD:",5) == 0)							//MOD019 v
+            {
+                if (SSCANF(argv[i] + 5, "%255s%c", &szMtdDevice[0], &cTemp) != 1)
+                {
+                    PRINTF(_T("ERROR: Invalid MTD device specified!\n"));
+                    exit(1);
+                }
+            }																	//MOD019 ^
             else if (STRNCMP(argv[i], _T("/BP:"),4) == 0)
 	        {
                 if ((SSCANF(argv[i], _T("/BP:%256s%c"), &szBupPassword[0], &cTemp) != 1) &&	//MOD004
@@ -318,6 +743,34 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
                 }
                 nBupDeactivate = 0x01;  /* Deactivate BUP and update or save BIOS */
             }
+            else if (STRNCMP(argv[i], "/DIFF",5) == 0)							//MOD010 v
+            {            
+                nFlags = nFlags | CG_BFFLAG_DIFF;
+		    }																	//MOD010 ^
+            else if (STRNCMP(argv[i], "/REGION:",8) == 0)						//MOD011 v
+            {
+                if((nBfRegionMask = ParseRegionList(argv[i] + 8)) == 0)
+                {
+                    PRINTF(_T("ERROR: Invalid flash region specified!\n"));
+                    exit(1);
+                }
+                nFlags = nFlags | CG_BFFLAG_REGION;
+                nFlags = nFlags | CG_BFFLAG_EXTD;
+                nFlags = nFlags | CG_BFFLAG_FEXTD;
+            }																	//MOD011 ^
+            else if (STRNCMP(argv[i], "/JOURNAL",8) == 0)						//MOD012 v
+            {
+                nFlags = nFlags | CG_BFFLAG_JOURNAL;
+            }																	//MOD012 ^
+            else if (STRNCMP(argv[i], "/BACKUP:",8) == 0)						//MOD013 v
+            {
+                if (SSCANF(argv[i] + 8, "%255s%c", &szBfBackupFile[0], &cTemp) != 1)
+                {
+                    PRINTF(_T("ERROR: Invalid backup file name specified!\n"));
+                    exit(1);
+                }
+                nFlags = nFlags | CG_BFFLAG_BACKUP;
+            }																	//MOD013 ^
             else if (STRNCMP(argv[i], "/D",2) == 0)
             {            
                 nFlags = nFlags | CG_BFFLAG_ASK;
@@ -381,11 +834,13 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
             {            
 				// Unlock ext. flash area.					
                 nFlags = nFlags & (~CG_BFFLAG_AUTO_OFFON);
+                bAutoOffOnSel = FALSE;														//MOD022
 		    }
 			else if (STRNCMP(argv[i], "/AOO",4) == 0)
             {            
 				// Lock ext. flash area.					
                 nFlags = nFlags | CG_BFFLAG_AUTO_OFFON;
+                bAutoOffOnSel = TRUE;														//MOD022
 		    }																								
 			else
 		    {
@@ -395,11 +850,53 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
 	    }
     }
     
+    if(bAllBoards)																//MOD015 v
+    {
+        // Only plain updates of a BIOS file run unattended on several boards.
+        // The journal is kept next to the BIOS file and thus can't be shared.
+        if((nBupDeactivate == 0x02) ||
+           (nFlags & (CG_BFFLAG_SAVE | CG_BFFLAG_ASK | CG_BFFLAG_JOURNAL | CG_BFFLAG_ISLOCKED | CG_BFFLAG_UNLOCK | CG_BFFLAG_LOCK)))
+        {
+            PRINTF(_T("ERROR: /BOARDS:ALL can't be combined with /S, /D, /JOURNAL or commands!\n"));
+            exit(1);
+        }
+        // The MTD device is the flash part of this board only
+        if(szMtdDevice[0])														//MOD019 v
+        {
+            PRINTF(_T("ERROR: /BOARDS:ALL can't be combined with /MTD!\n"));
+            exit(1);
+        }																		//MOD019 ^
+        // Locking or unlocking the extended area restarts the system, which	//MOD022 v
+        // would power-cycle the host while other boards are still written.
+        if((nFlags & CG_BFFLAG_EXTD) || bAutoOffOnSel)
+        {
+            PRINTF(_T("ERROR: /BOARDS:ALL can't be combined with extended updates or /AOO!\n"));
+            exit(1);
+        }
+        nFlags = nFlags & (~CG_BFFLAG_AUTO_OFFON);								//MOD022 ^
+    }																			//MOD015 ^
+
+    if(szTelemetryFile[0] && !CgTmOpen(&szTelemetryFile[0]))					//MOD016 v
+    {
+        PRINTF(_T("ERROR: Failed to open telemetry file!\n"));
+        exit(1);
+    }																			//MOD016 ^
+
+    if(szMtdDevice[0] && !CgStoreOpenMtd(&szMtdDevice[0]))						//MOD019 v
+    {
+        PRINTF(_T("ERROR: Failed to open MTD device!\n"));
+        exit(1);
+    }																			//MOD019 ^
+
     if (!CgosOpen())
     {
         PRINTF(_T("ERROR: Failed to access system interface!\n"));
         exit(1);   
     }
+    if(bAllBoards)																//MOD015
+    {
+        BiosUpdateAllBoards(&szNewBiosFile[0], nFlags, &szBupPassword[0]);
+    }
 
     if(nBupDeactivate > 0x00)
     {
@@ -650,56 +1147,20 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
             PRINTF(_T("Afterwards press any key to start BIOS update...\n"));
             getch();
         }
+        CgTmBegin(0, &szNewBiosFile[0]);										//MOD016
         nBfRet = CG_BiosFlash((_TCHAR *) &szNewBiosFile, nFlags);
+        CgTmEnd(nBfRet);														//MOD016
+        CgTmClose();															//MOD016
+        if(nBfRet == CG_BFRET_UPTODATE)											//MOD020 v
+        {
+            PRINTF(_T("\nBIOS already up to date!\n"));
+            CgosClose();
+            exit(nBfRet);
+        }																		//MOD020 ^
         if(nBfRet != CG_BFRET_OK)
         {
             PRINTF(_T("\nERROR: Failed to update BIOS!\n"));
-            if(nBfRet == CG_BFRET_INCOMP)
-            {
-                PRINTF(_T("Project ID of selected BIOS file and current BIOS do not match!\n"));
-                PRINTF(_T("The BIOS you tried to flash is not meant to be used on this board!\n"));
-                /*PRINTF(_T("Select 'Force Update' option (/F) to flash anyways.\n"));*/
-            }
-            else if(nBfRet == CG_BFRET_INVALID)
-            {
-                PRINTF(_T("The specified file is not a valid BIOS file!\n"));						//MOD001
-            }
-            else if(nBfRet == CG_BFRET_ERROR_SIZE)
-            {
-                PRINTF(_T("File size and flash size do not match!\n"));
-            }
-            else if(nBfRet == CG_BFRET_INTRF_ERROR)
-            {
-                PRINTF(_T("Failed to access system interface!\n"));
-            }
-            else if(nBfRet == CG_BFRET_ERROR_FILE)
-            {
-                PRINTF(_T("File processing error!\n"));
-            }
-            else if(nBfRet == CG_BFRET_ERROR_NOEXTD)												//MOD001 v
-			{
-				PRINTF(_T("Extended/full flash update not possible!\n"));
-			}
-			else if(nBfRet == CG_BFRET_ERROR_UNLOCK_EXTD)								
-			{
-				PRINTF(_T("Failed to unlock flash for extended/full flash update!\n"));
-			}
-			else if(nBfRet == CG_BFRET_ERROR_LOCK_EXTD)								
-			{
-				PRINTF(_T("Failed to lock flash after extended/full flash update!\n"));
-			}
-			else if(nBfRet == CG_BFRET_NOTCOMP_EXTD)								
-			{
-				PRINTF(_T("Extended/full flash update not (yet) completed!\n"));
-			}
-			else if(nBfRet == CG_BFRET_INCOMP_EXTD)								
-			{
-				PRINTF(_T("This platform/BIOS requires an extended/full flash update (/E)!\n"));
-			}																						//MOD001 ^
-			else
-            {
-                PRINTF(_T("Internal processing error!\n"));
-            }
+            ShowBiosFlashError(nBfRet);											//MOD015
             CgosClose();
             exit (nBfRet);	//MOD006: Return dedicated exit codes to indicate what went wrong.  exit( 1);
         }
@@ -717,6 +1178,12 @@ void HandleBiosUpdate(INT32 argc, _TCHAR* argv[])
  */
 void BiosFlashReportState(UINT32 nControl, _TCHAR *szReportString)
 {
+    if(pBoardState)																//MOD015 v
+    {
+        // Called by a /BOARDS:ALL worker thread
+        BoardReportState(nControl, szReportString);
+        return;
+    }																			//MOD015 ^
 #ifdef WIN32
     if(nControl == 1)
     {
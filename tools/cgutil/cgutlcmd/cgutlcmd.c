@@ -103,6 +103,7 @@ extern void HandleReportGeneration(INT32 argc, _TCHAR* argv[]);
 extern void HandlePanelConfiguration(INT32 argc, _TCHAR* argv[]);
 extern void HandleCgosTest(INT32 argc, _TCHAR* argv[]);
 extern void HandleInfo(INT32 argc, _TCHAR* argv[]);
+extern void HandleFlashBench(INT32 argc, _TCHAR* argv[]);
 
 #ifdef __cplusplus
 }
@@ -138,6 +139,7 @@ static CG_UTIL_MODULE moduleList[] =   {
                                 {"CPANEL", "Panel Configuration Module", HandlePanelConfiguration},
                                 {"MODULE", "BIOS Module Modification Module", HandleBiosModules},
                                 {"CGINFO", "Board/BIOS Information Module", HandleInfo},
+                                {"FBENCH", "Flash Access Benchmark Module", HandleFlashBench},
                                 };
 
 /*---------------------------------------------------------------------------
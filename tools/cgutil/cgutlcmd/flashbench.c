@@ -0,0 +1,380 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Congatec flash access benchmark command line module.
+ *           Measures the storage area read, erase and write throughput for
+ *           different transfer sizes and stores the fastest read size for
+ *           the board (see CgBfGetReadSize).
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "biosflsh.h"
+
+/*--------------
+ * Externs used
+ *--------------
+ */
+extern CG_TLS UINT32 nFlashSize, nFlashBlockSize, nExtdFlashSize;
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+#define FBENCH_READ_TOTAL       0x400000    // Max. number of bytes read per transfer size
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+
+/*---------------------------------------------------------------------------
+ * Name: ShowUsage
+ * Desc: Display module usage and exit with error.
+ * Inp:  none
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+static void ShowUsage(void)
+{
+        PRINTF(_T("\nUsage:\n\n"));
+        PRINTF(_T("FBENCH [options]\n\n"));
+        PRINTF(_T("Options:\n"));
+        PRINTF(_T("/EXTD    - Use the extended flash area instead of the BIOS area.\n"));
+        PRINTF(_T("/TUNE    - Store the fastest read size for this board in %s.\n"), _T(CG_BF_READSIZE_FILE));
+        PRINTF(_T("           It is used by all bulk flash reads (save, verify, module access).\n"));
+        PRINTF(_T("/RESET   - Remove the stored read size of this board.\n"));
+        PRINTF(_T("/W:xxx   - Also measure erase and write throughput using the flash block\n"));
+        PRINTF(_T("           at hex offset xxx. The block contents are written back.\n"));
+        PRINTF(_T("           Do not interrupt the benchmark while it is running!\n"));
+        PRINTF(_T("\n"));
+        exit(1);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: GetThroughput
+ * Desc: Calculates the throughput in KB/s.
+ * Inp:  nBytes         - Number of bytes transferred.
+ *       nTicks         - Time in milliseconds.
+ * Outp: Throughput in KB/s.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 GetThroughput(UINT32 nBytes, UINT32 nTicks)
+{
+    if(nTicks == 0)
+    {
+        nTicks = 1;
+    }
+    return (UINT32)(((double)nBytes * 1000.0) / ((double)nTicks * 1024.0));
+}
+
+/*---------------------------------------------------------------------------
+ * Name: BenchRead
+ * Desc: Measures the read throughput for all transfer sizes.
+ * Inp:  ulStorageSelector  - Storage area.
+ *       nAreaSize          - Size of storage area.
+ *       pBuffer            - Buffer of CG_BF_READSIZE_MAX bytes.
+ * Outp: Fastest read size or 0 on error.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 BenchRead(UINT32 ulStorageSelector, UINT32 nAreaSize, unsigned char *pBuffer)
+{
+    UINT32 nReadSize, nTotal, nOffset, nStart, nTicks, nRate;
+    UINT32 nBestSize = 0, nBestRate = 0;
+
+    nTotal = (nAreaSize < FBENCH_READ_TOTAL) ? nAreaSize : FBENCH_READ_TOTAL;
+    PRINTF(_T("\nRead size    Read KB/s\n"));
+    for(nReadSize = CG_BF_READSIZE_MIN; (nReadSize <= CG_BF_READSIZE_MAX) && (nReadSize <= nTotal); nReadSize = nReadSize * 2)
+    {
+        nStart = CgutlGetTickCount();
+        for(nOffset = 0; (nOffset + nReadSize) <= nTotal; nOffset = nOffset + nReadSize)
+        {
+            if(!CgosStorageAreaRead(hCgos, ulStorageSelector, nOffset, pBuffer, nReadSize))
+            {
+                break;
+            }
+        }
+        nTicks = CgutlGetTickCount() - nStart;
+        if((nOffset + nReadSize) <= nTotal)
+        {
+            // Transfer size not supported by the interface
+            PRINTF(_T("%8Xh    FAILED\n"), nReadSize);
+            continue;
+        }
+        nRate = GetThroughput(nOffset, nTicks);
+        PRINTF(_T("%8Xh    %9u\n"), nReadSize, nRate);
+        if(nRate > nBestRate)
+        {
+            nBestRate = nRate;
+            nBestSize = nReadSize;
+        }
+    }
+    return nBestSize;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: IsBlockRestored
+ * Desc: Reads back the complete flash block and compares it with the
+ *       original contents. Unlike CgBfVerifyBlock, every block of the
+ *       extended area is read back.
+ * Inp:  ulStorageSelector  - Storage area.
+ *       nOffset            - Offset of flash block.
+ *       pOriginal          - Original block contents.
+ *       pBuffer            - Buffer of nFlashBlockSize bytes.
+ * Outp: TRUE if the block contains the original contents, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 IsBlockRestored(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pOriginal,
+                              unsigned char *pBuffer)
+{
+    if(!CgBfStorageRead(ulStorageSelector, nOffset, pBuffer, nFlashBlockSize))
+    {
+        return FALSE;
+    }
+    return (memcmp(pBuffer, pOriginal, nFlashBlockSize) == 0);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: BenchWrite
+ * Desc: Measures the erase and write throughput for all transfer sizes up to
+ *       the flash block size. The original block contents are written back
+ *       in each pass.
+ * Inp:  ulStorageSelector  - Storage area.
+ *       nOffset            - Offset of flash block to use.
+ *       pBuffer            - Buffer of nFlashBlockSize bytes.
+ * Outp: TRUE on success, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 BenchWrite(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer)
+{
+    UINT32 nWriteSize, nPos, nStart, nEraseTicks, nWriteTicks;
+    unsigned char *pOriginal;
+    UINT32 bResult = TRUE;
+
+    if(CgosStorageAreaBlockSize(hCgos, ulStorageSelector) == 0x80000)
+    {
+        // The BIOS erases and verifies 512KB blocks itself
+        PRINTF(_T("\nWrite benchmark not supported by the flash interface of this board.\n"));
+        return TRUE;
+    }
+    if(!(pOriginal = (unsigned char*)malloc(nFlashBlockSize)))
+    {
+        return FALSE;
+    }
+    if(!CgBfStorageRead(ulStorageSelector, nOffset, pOriginal, nFlashBlockSize))
+    {
+        free(pOriginal);
+        return FALSE;
+    }
+    // Cached flash digests (BFLASH /UPTODATE) are outdated by the write
+    CgBfDigestInvalidate();
+
+    PRINTF(_T("\nWrite size   Erase KB/s   Write KB/s\n"));
+    for(nWriteSize = CG_BF_READSIZE_MIN; (nWriteSize <= nFlashBlockSize) && bResult; nWriteSize = nWriteSize * 2)
+    {
+        nStart = CgutlGetTickCount();
+        if(!CgosStorageAreaErase(hCgos, ulStorageSelector, nOffset, nFlashBlockSize) ||
+           (CgBfWaitEraseDone(ulStorageSelector, nOffset, nFlashBlockSize) != CG_BFRET_OK))
+        {
+            bResult = FALSE;
+        }
+        nEraseTicks = CgutlGetTickCount() - nStart;
+
+        nStart = CgutlGetTickCount();
+        for(nPos = 0; bResult && (nPos < nFlashBlockSize); nPos = nPos + nWriteSize)
+        {
+            if(!CgosStorageAreaWrite(hCgos, ulStorageSelector, nOffset + nPos, pOriginal + nPos, nWriteSize))
+            {
+                bResult = FALSE;
+            }
+        }
+        nWriteTicks = CgutlGetTickCount() - nStart;
+
+        // Always make sure that the original contents are back in place
+        if(!bResult || !IsBlockRestored(ulStorageSelector, nOffset, pOriginal, pBuffer))
+        {
+            PRINTF(_T("%8Xh    FAILED\n"), nWriteSize);
+            bResult = CgosStorageAreaErase(hCgos, ulStorageSelector, nOffset, nFlashBlockSize) &&
+                      (CgBfWaitEraseDone(ulStorageSelector, nOffset, nFlashBlockSize) == CG_BFRET_OK) &&
+                      CgosStorageAreaWrite(hCgos, ulStorageSelector, nOffset, pOriginal, nFlashBlockSize) &&
+                      IsBlockRestored(ulStorageSelector, nOffset, pOriginal, pBuffer);
+            if(!bResult)
+            {
+                PRINTF(_T("ERROR: Failed to restore flash block at %Xh!\n"), nOffset);
+            }
+            break;
+        }
+        PRINTF(_T("%8Xh    %10u   %10u\n"), nWriteSize, GetThroughput(nFlashBlockSize, nEraseTicks),
+               GetThroughput(nFlashBlockSize, nWriteTicks));
+    }
+    free(pOriginal);
+    return bResult;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: HandleFlashBench
+ * Desc: Flash benchmark module entry.
+ * Inp:  argc, argv     - Module command line.
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void HandleFlashBench(INT32 argc, _TCHAR* argv[])
+{
+    UINT32 ulStorageSelector = CG32_STORAGE_MPFA_ALL;
+    UINT32 nAreaSize, nBestSize, nWriteOffset = 0, nBiosBase;
+    UINT16 bTune = FALSE, bReset = FALSE, bWrite = FALSE;
+    INT32 i, retCode = 0;
+    unsigned char *pBuffer;
+    _TCHAR cTemp;
+
+    PRINTF(_T("Flash Access Benchmark Module\n"));
+
+    for (i=1; i<argc; i++)
+    {
+        if (STRNCMP(argv[i], _T("/EXTD"),5) == 0)
+        {
+            ulStorageSelector = CG32_STORAGE_MPFA_EXTD;
+        }
+        else if (STRNCMP(argv[i], _T("/TUNE"),5) == 0)
+        {
+            bTune = TRUE;
+        }
+        else if (STRNCMP(argv[i], _T("/RESET"),6) == 0)
+        {
+            bReset = TRUE;
+        }
+        else if (STRNCMP(argv[i], _T("/W:"),3) == 0)
+        {
+            if (SSCANF(argv[i] + 3, _T("%x%c"), &nWriteOffset, &cTemp) != 1)
+            {
+                PRINTF(_T("ERROR: Invalid write offset specified!\n"));
+                exit(1);
+            }
+            bWrite = TRUE;
+        }
+        else
+        {
+            ShowUsage();
+        }
+    }
+
+    if (!CgosOpen())
+    {
+        PRINTF(_T("ERROR: Failed to access system interface!\n"));
+        exit(1);
+    }
+
+    if(bReset)
+    {
+        if(CgBfSetReadSize(0, TRUE) != CG_BFRET_OK)
+        {
+            PRINTF(_T("ERROR: Failed to update %s!\n"), _T(CG_BF_READSIZE_FILE));
+            CgosClose();
+            exit(1);
+        }
+        PRINTF(_T("\nRead size reset to default.\n"));
+        CgosClose();
+        exit(0);
+    }
+
+    if((CgBfGetFlashSize(&nFlashSize, &nExtdFlashSize, &nFlashBlockSize) != CG_BFRET_OK) ||
+       (nFlashSize == 0) || (nFlashBlockSize == 0))
+    {
+        PRINTF(_T("ERROR: Failed to get flash size!\n"));
+        CgosClose();
+        exit(1);
+    }
+    nAreaSize = (ulStorageSelector == CG32_STORAGE_MPFA_EXTD) ? nExtdFlashSize : nFlashSize;
+    if(nAreaSize == 0)
+    {
+        PRINTF(_T("ERROR: Extended flash area not available!\n"));
+        CgosClose();
+        exit(1);
+    }
+    if(bWrite && (((nWriteOffset % nFlashBlockSize) != 0) || (nWriteOffset >= nAreaSize)))
+    {
+        PRINTF(_T("ERROR: Write offset has to be a flash block within the flash area!\n"));
+        CgosClose();
+        exit(1);
+    }
+    // Only the BIOS content at the end of the extended area may be used.
+    // The regions in front of it (descriptor, ME, GbE, ...) are left alone.
+    nBiosBase = (nAreaSize > nFlashSize) ? (nAreaSize - nFlashSize) : 0;
+    if(bWrite && (ulStorageSelector == CG32_STORAGE_MPFA_EXTD) && (nWriteOffset < nBiosBase))
+    {
+        PRINTF(_T("ERROR: Write offset has to be within the BIOS part (%Xh-%Xh) of the extended area!\n"),
+               nBiosBase, nAreaSize - 1);
+        CgosClose();
+        exit(1);
+    }
+
+    PRINTF(_T("\nFlash area size: %Xh, flash block size: %Xh, current read size: %Xh\n"),
+           nAreaSize, nFlashBlockSize, CgBfGetReadSize());
+
+    pBuffer = (unsigned char*)malloc((nFlashBlockSize > CG_BF_READSIZE_MAX) ? nFlashBlockSize : CG_BF_READSIZE_MAX);
+    if(!pBuffer)
+    {
+        PRINTF(_T("ERROR: Out of memory!\n"));
+        CgosClose();
+        exit(1);
+    }
+
+    nBestSize = BenchRead(ulStorageSelector, nAreaSize, pBuffer);
+    if(nBestSize == 0)
+    {
+        PRINTF(_T("ERROR: Failed to read flash!\n"));
+        retCode = 1;
+    }
+    else
+    {
+        PRINTF(_T("\nFastest read size: %Xh\n"), nBestSize);
+        if(bTune)
+        {
+            if(CgBfSetReadSize(nBestSize, TRUE) != CG_BFRET_OK)
+            {
+                PRINTF(_T("ERROR: Failed to update %s!\n"), _T(CG_BF_READSIZE_FILE));
+                retCode = 1;
+            }
+            else
+            {
+                PRINTF(_T("Read size stored in %s.\n"), _T(CG_BF_READSIZE_FILE));
+            }
+        }
+    }
+
+    if((retCode == 0) && bWrite)
+    {
+        if(!BenchWrite(ulStorageSelector, nWriteOffset, pBuffer))
+        {
+            PRINTF(_T("ERROR: Write benchmark failed!\n"));
+            retCode = 1;
+        }
+    }
+
+    free(pBuffer);
+    CgosClose();
+    exit(retCode);
+}
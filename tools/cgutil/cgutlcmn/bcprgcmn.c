@@ -141,7 +141,7 @@
  *---------------------
  */
 
-extern HCGOS hCgos;
+extern CG_TLS HCGOS hCgos;
 extern void BcprgShowProgress( INT32 progressCode );
 
 
@@ -18,6 +18,86 @@
  */
  
 /*
+ * MOD049: Erase status timeout based on elapsed time instead of poll count.
+ * 
+ * MOD048: Read back the blocks of a region update through the extended area.
+ * 
+ * MOD047: /UPTODATE confirms the cached digest manifest against the flash, bounded manifest name.
+ * 
+ * MOD046: Invalidate the digest manifests on each flash write, bound the manifest name.
+ * 
+ * MOD045: MTD backend: Erase each flash block, also with 512KB erase blocks.
+ * 
+ * MOD044: Report failed flash reads of the differential block compare in the telemetry.
+ * 
+ * MOD043: Report the EHL MAC address recovery messages with BiosFlashReportState.
+ * 
+ * MOD042: Release the flash snapshot on all error exits of CG_BiosFlash.
+ * 
+ * MOD041: Check the length of the journal file name.
+ * 
+ * MOD040: Compare flash blocks with memcmp and a branch-free loop.
+ * 
+ * MOD039: Optionally check the flash contents against the update image
+ *         first, using block digests cached per board and boot, and skip
+ *         the update if nothing differs.
+ * 
+ * MOD038: Access the BIOS flash areas through the selected storage backend
+ *         (CGOS or Linux MTD device).
+ * 
+ * MOD037: Optionally skip flash blocks that only hold Slim Bootloader
+ *         components that are unchanged in the flash part.
+ * 
+ * MOD036: Optionally replace the BIOS region of the update image by a separate
+ *         BIOS (e.g. Slim Bootloader) image in memory.
+ * 
+ * MOD035: Record block operation latencies and phase durations in the update
+ *         telemetry.
+ * 
+ * MOD034: Keep the flash engine state per thread to update several boards
+ *         in parallel.
+ * 
+ * MOD033: Optionally write /S saves and update backups as sparse, compressed
+ *         container and accept such a container as update file.
+ * 
+ * MOD032: Keep the flash contents read for a backup or differential update as
+ *         snapshot and serve later reads (backup, block compare, MAC address
+ *         recovery) from it. Blocks written in this session are re-read.
+ * 
+ * MOD031: Use a tuned transfer size (per board, stored by the FBENCH module) for
+ *         bulk storage area reads instead of the flash block size.
+ * 
+ * MOD030: Poll the erase status with a timeout instead of the fixed delay after
+ *         each block erase.
+ * 
+ * MOD029: Added update journal to resume an interrupted BIOS update. Blocks
+ *         already written are only checked against their recorded CRC32C.
+ * 
+ * MOD028: Added region selective flash update. Only the blocks of the selected
+ *         flash descriptor regions are erased and written.
+ * 
+ * MOD027: Use the shared flash descriptor parser (cgifd.c) for the MAC address
+ *         recovery variants. The flash part descriptor is read only once.
+ * 
+ * MOD026: EHL MAC address recovery: search the GbE GUID with a chunked scan
+ *         instead of one flash read per DWORD. Fixed reading of the GbE region
+ *         version.
+ * 
+ * MOD025: Map the BIOS file instead of reading it to a full size buffer (LINUX).
+ *         Save the system BIOS block by block.
+ * 
+ * MOD024: Verify each block of the 512k block size update as well, instead of
+ *         relying on the BIOS routine only.
+ * 
+ * MOD023: Verify each flash block right after it has been written and retry only
+ *         that block on a mismatch. Removed the separate full read-back pass.
+ * 
+ * MOD022: Differential BIOS update: skip the block erase if the new block contents
+ *         can be programmed without it (no bit has to change from 0 to 1).
+ * 
+ * MOD021: Added differential BIOS update. Only flash blocks that differ from the
+ *         ROM file contents are erased and written.
+ * 
  * MOD905 added "3AWN" for customer Omron to perform MAC address recovery
  * 
  * MOD020: Added CG_CheckPatchInputExtd_ICL for Icelake modules for mac adress recovery. GMA
@@ -114,6 +194,14 @@
 #include "cgbmod.h"
 #include "cgbinfo.h"
 #include "biosflsh.h"
+#include "cgifd.h"														//MOD027
+#include "cgbkup.h"														//MOD033
+#include "cgtelem.h"													//MOD035
+#include "cgsbl.h"														//MOD037
+#include "cgstore.h"													//MOD038
+#ifdef LINUX																	//MOD025
+#include <sys/mman.h>
+#endif
 
 /*--------------
  * Externs used
@@ -130,15 +218,37 @@ extern void BiosFlashReportState(UINT32 nControl, _TCHAR *szReportString);
 //MOD008 #define BM57_GBE_REGION_OFFSET	0x1000									//MOD003
 // Setup storage area 
 #define CGOS_STORAGE_AREA_SETUP		0x82020000									//MOD013
+// Read size used to scan a storage area for a pattern
+#define CG_BF_SCAN_CHUNK_SIZE		0x10000										//MOD026
 
 /*------------------
  * Global variables
  *------------------
  */
-UINT32 nFlashSize, nFlashBlockSize, nExtdFlashSize;								//MOD003
-char szBoardBiosName[9] = {0x00};
-CG_BIOS_INFO CgBiosInfoRomfile;													//MOD003
-CG_BIOS_INFO CgBiosInfoFlash;													//MOD003
+// Engine state is kept per thread, i.e. per board with /BOARDS:ALL			//MOD034
+CG_TLS UINT32 nFlashSize, nFlashBlockSize, nExtdFlashSize;						//MOD003 //MOD034
+CG_TLS char szBoardBiosName[9] = {0x00};
+CG_TLS CG_BIOS_INFO CgBiosInfoRomfile;											//MOD003
+CG_TLS CG_BIOS_INFO CgBiosInfoFlash;											//MOD003
+static CG_TLS unsigned char bRomfileMapped = 0;										//MOD025
+UINT32 nBfRegionMask = 0;			// Flash regions to update with CG_BFFLAG_REGION	//MOD028
+static CG_TLS UINT32 nCrc32cTable[256];										//MOD029 v
+static CG_TLS unsigned char bCrc32cTableValid = 0;
+static CG_TLS FILE *fpJournal = NULL;					// Update journal (CG_BFFLAG_JOURNAL)
+static CG_TLS CG_BF_JOURNAL_ENTRY *pJournal = NULL;
+static CG_TLS UINT32 nJournalBlocks = 0;
+static CG_TLS UINT32 nJournalStorageSelector;
+static CG_TLS char szJournalFile[300];											//MOD029 ^
+static CG_TLS UINT32 nBfReadSize = 0;					// Bulk read transfer size, 0: not set yet	//MOD031
+static CG_TLS unsigned char *pBfSnapshot = NULL;		// Flash snapshot (CgBfSnapshotLoad)	//MOD032 v
+static CG_TLS unsigned char *pBfSnapshotValid = NULL;	// Valid flag per snapshot page
+static CG_TLS UINT32 nBfSnapshotSelector, nBfSnapshotSize;
+CG_TLS _TCHAR szBfBackupFile[256];						// Backup file (CG_BFFLAG_BACKUP)	//MOD032 ^
+UINT16 bBfSparseBackup = FALSE;							// Save as backup container (cgbkup.c)	//MOD033
+_TCHAR szBfStitchFile[256];							// BIOS region image (CG_BFFLAG_STITCH)	//MOD036
+static CG_TLS UINT32 *pBfDigest = NULL;				// Block digests of the update image	//MOD039 v
+static CG_TLS CG_BF_DIGEST_HEADER bfDigestHeader;
+static CG_TLS char szBfDigestFile[300];				// Digest manifest, empty if not cached	//MOD039 ^
 
 																				//MOD003 
 
@@ -158,8 +268,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
     unsigned int i, j;
     char lanAreaProgress[50];
     UINT32	data32;		
-    UINT32	FRBAflash, FRBAfile;			//Flash region base address	
-    UINT32	FLREG11flash, FLREG11file;
+    CG_IFD_INFO ifdFile, *pIfdFlash;		//Flash descriptors of file and flash part	//MOD027
     UINT32	NACNISRegionflash, NACNISRegionfile;
     UINT32  NACNISRegionflashEnd; //NACNISRegionfileEnd;
     UINT32  NACNISSize;
@@ -281,80 +390,31 @@ UINT16 CG_CheckPatchInputExtd_ICL
     
     // -----------------------------
     
-	// Verify correct flash descriptors
+	// Verify correct flash descriptors									//MOD027 v
 
-	// Try to read flash descriptor signature from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, 0x10, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; //MOD019
-	}
-    
-    // Check flash descriptor signatures in flash part and in flash contents file 
-	if( (*((UINT32*)(pInputData+0x10)) != FLASH_DESCRIPTOR_SIGNATURE) ||  (data32 != FLASH_DESCRIPTOR_SIGNATURE))
+	// Parse flash descriptors of flash contents file and flash part
+	if((CgIfdParse(pInputData, nInputDataSize, &ifdFile) != CG_IFDRET_OK) ||
+	   (CgIfdGetFlash(&pIfdFlash) != CG_IFDRET_OK))
 	{
-		// Invalid descriptor signature in flash or file -> Break.
-		return CG_BFRET_OK;  //MOD019
-	}
-    
-    // Get flash region base address from input file
-	data32 = *((UINT32*)(pInputData+FLMAP0_OFFSET));
-	FRBAfile = (data32 & 0x00FF0000) >> 12;
-
-    // Get flash region base address from flash part 
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLMAP0_OFFSET, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; //MOD019
+		// Invalid descriptor in flash or file -> Break.
+		// If we cannot read the flash part at all, we might still only face a flash unlock issue.
+		return CG_BFRET_OK;
 	}
-	FRBAflash = (data32 & 0x00FF0000) >> 12;
 
-    // Check match
-	if(FRBAfile != FRBAflash)
+    // Check match of flash region base address
+	if(ifdFile.frba != pIfdFlash->frba)
 	{
 		// No match. Break 
-		return CG_BFRET_OK; //MOD019
+		return CG_BFRET_OK;
 	}
-    // Now that we have the flash region base address, check whether
-	// there is a used flash region 11, which is dedicated to LAN CTRL0
-
-    FLREG11file	=   FRBAfile + FLREG11_OFFSET;
-    FLREG11flash = FRBAflash + FLREG11_OFFSET;
-
 
-    // Get NAC NIS region base address from input file
-	data32 = *((UINT32*)(pInputData+FLREG11file));
-    
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
-	{
-		// Region unused. Break.
-		return CG_BFRET_OK; //MOD019
-	}
-    // Get NAC NIS region base
-    NACNISRegionfile = (data32 & 0x00007FFF) << 12;
-    // Get NAC NIS region limit
-    //NACNISRegionfileEnd = (data32 & 0x7FFF0000) >> 4;
-
-    // Get NACNIS region base address from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLREG11flash, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; // MOD019
-	} 
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
+    // Get NAC NIS region (flash region 11) base from input file and flash part
+	if((CgIfdGetRegion(&ifdFile, CG_IFD_REGION_LANCTRL0, &NACNISRegionfile, NULL) != CG_IFDRET_OK) ||
+	   (CgIfdGetRegion(pIfdFlash, CG_IFD_REGION_LANCTRL0, &NACNISRegionflash, &NACNISRegionflashEnd) != CG_IFDRET_OK))
 	{
 		// Region unused. Break.
-		return CG_BFRET_OK; //MOD019
-	}
-    // Get NAC NIS region base
-    NACNISRegionflash = (data32 & 0x00007FFF) << 12;
-    // Get NAC NIS region limit
-    NACNISRegionflashEnd = (data32 & 0x7FFF0000) >> 4;
+		return CG_BFRET_OK;
+	}																		//MOD027 ^
 
 
     /*
@@ -431,7 +491,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
                                                           */
 
     //Check bank1 validity in flash
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, NACNISRegionflash, (unsigned char*)(&data32), 4))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, NACNISRegionflash, (unsigned char*)(&data32), 4))	//MOD032
     {
         // If we cannot read at all, we have a problem !
         // However, we might still only face a flash unlock issue.
@@ -443,7 +503,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
 
     //Check bank2 validity in flash
     //Add the word offset 0x8000 "bank2offset" to switch to the next bank
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, NACNISRegionflash + bank2offset, (unsigned char*)(&data32), 4))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, NACNISRegionflash + bank2offset, (unsigned char*)(&data32), 4))	//MOD032
     {
         // If we cannot read at all, we have a problem !
         // However, we might still only face a flash unlock issue.
@@ -475,7 +535,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
     PFAPointerFlash = PFAPointerFlash*2;
 
     //Get the PFA Offset and double the offset to get the word offset
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, validBank+PFAPointerFlash, (unsigned char*)(&data32), 4))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, validBank+PFAPointerFlash, (unsigned char*)(&data32), 4))	//MOD032
     {
         // If we cannot read at all, we have a problem !
         // However, we might still only face a flash unlock issue.
@@ -485,7 +545,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
     PFAOffsetFlash = PFAOffsetFlash *2 ;
 
     //Get the PFALength
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, validBank+PFAOffsetFlash, (unsigned char*)(&data32), 4))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, validBank+PFAOffsetFlash, (unsigned char*)(&data32), 4))	//MOD032
     {
         // If we cannot read at all, we have a problem !
         // However, we might still only face a flash unlock issue.
@@ -496,7 +556,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
     //Get the offset for the start of PFA Region, which is 2 bytes further than the address of PFAOffset, or 2 byte next to PFALength.
     //Start of the PFA regions is the type ID of the first PFA region
     PFARegionStartOffsetFlash = validBank + PFAOffsetFlash + 0x2;
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, PFARegionStartOffsetFlash, (unsigned char*)(&data32), 4))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, PFARegionStartOffsetFlash, (unsigned char*)(&data32), 4))	//MOD032
     {
         // If we cannot read at all, we have a problem !
         // However, we might still only face a flash unlock issue.
@@ -505,7 +565,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
 
     //Get the first typeID
     typeIdOffsetFlash = PFARegionStartOffsetFlash;
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, typeIdOffsetFlash, (unsigned char*)(&data32), 4))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, typeIdOffsetFlash, (unsigned char*)(&data32), 4))	//MOD032
     {
         // If we cannot read at all, we have a problem !
         // However, we might still only face a flash unlock issue.
@@ -519,7 +579,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
     {
         //printf("typeID 0x%04x\n",typeIDFlash);
         //Get the the length of the current pfa region, which is one word after the typeID so you need to add 0x2 to the typeID offset
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, typeIdOffsetFlash+0x2, (unsigned char*)(&data32), 4))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, typeIdOffsetFlash+0x2, (unsigned char*)(&data32), 4))	//MOD032
         {
             // If we cannot read at all, we have a problem !
             // However, we might still only face a flash unlock issue.
@@ -535,7 +595,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
         typeIdOffsetFlash = PFARegionNextFlash;
 
         //Get the typeid of the next pfa offset
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, typeIdOffsetFlash, (unsigned char*)(&data32), 4))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, typeIdOffsetFlash, (unsigned char*)(&data32), 4))	//MOD032
         {
             // If we cannot read at all, we have a problem !
             // However, we might still only face a flash unlock issue.
@@ -602,7 +662,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
             {
                 readFlashBytes = flashPortion;
             }
-            if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, readAddress, lanBuffer, readFlashBytes))
+            if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, readAddress, lanBuffer, readFlashBytes))	//MOD032
             //if(fread(lanBuffer,1,readFlashBytes,biosFiletmp) != readFlashBytes)         //DEBUG read from file
             {
                 BiosFlashReportState(1, "FAILED!");
@@ -640,7 +700,7 @@ UINT16 CG_CheckPatchInputExtd_ICL
         //Save the mac addresses from the flash into the mac addresses array macAddress[][]
         for(i = 0; i < MACADDRESSES;i++)
         {
-            if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, PFARegionDataOffsetFlash + MACOFFSETS[i], &macAddress[i][0], 6))
+            if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, PFARegionDataOffsetFlash + MACOFFSETS[i], &macAddress[i][0], 6))	//MOD032
             {
                 return CG_BFRET_OK; //MOD019
             }
@@ -846,10 +906,7 @@ UINT16 CG_CheckPatchInputExtd_DSAC
     unsigned char macAddress[4][6];  
     unsigned char *lanBuffer;	
     unsigned int i;
-    UINT32	data32;		
-    UINT32	FRBAflash, FRBAfile;			//Flash region base address	
-    UINT32	FLREG11flash, FLREG11file;		//LAN CTRL0 region base address		
-    UINT32	FLREG12file, FLREG12flash;		//LAN CTRL1 region base address		
+    CG_IFD_INFO ifdFile, *pIfdFlash;		//Flash descriptors of file and flash part	//MOD027
 	UINT32	LANCTRL0Regionflash, LANCTRL0Regionfile;
     UINT32  LANCTRL0RegionflashEnd, LANCTRL0RegionfileEnd;
     UINT32	LANCTRL1Regionfile, LANCTRL1Regionflash;		
@@ -884,122 +941,51 @@ UINT16 CG_CheckPatchInputExtd_DSAC
     
     // -----------------------------
     
-	// Verify correct flash descriptors
+	// Verify correct flash descriptors									//MOD027 v
 
-	// Try to read flash descriptor signature from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, 0x10, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; //MOD019
-	}
-    
-    // Check flash descriptor signatures in flash part and in flash contents file 
-	if( (*((UINT32*)(pInputData+0x10)) != FLASH_DESCRIPTOR_SIGNATURE) ||  (data32 != FLASH_DESCRIPTOR_SIGNATURE))
+	// Parse flash descriptors of flash contents file and flash part
+	if((CgIfdParse(pInputData, nInputDataSize, &ifdFile) != CG_IFDRET_OK) ||
+	   (CgIfdGetFlash(&pIfdFlash) != CG_IFDRET_OK))
 	{
-		// Invalid descriptor signature in flash or file -> Break.
-		return CG_BFRET_OK;  //MOD019
-	}
-    
-    // Get flash region base address from input file
-	data32 = *((UINT32*)(pInputData+FLMAP0_OFFSET));
-	FRBAfile = (data32 & 0x00FF0000) >> 12;
-
-    // Get flash region base address from flash part 
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLMAP0_OFFSET, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; //MOD019
+		// Invalid descriptor in flash or file -> Break.
+		// If we cannot read the flash part at all, we might still only face a flash unlock issue.
+		return CG_BFRET_OK;
 	}
-	FRBAflash = (data32 & 0x00FF0000) >> 12;
 
-    // Check match
-	if(FRBAfile != FRBAflash)
+    // Check match of flash region base address
+	if(ifdFile.frba != pIfdFlash->frba)
 	{
 		// No match. Break 
-		return CG_BFRET_OK; //MOD019
+		return CG_BFRET_OK;
 	}
-    // Now that we have the flash region base address, check whether
-	// there is a used flash region 11, which is dedicated to LAN CTRL0
-	FLREG11file	=   FRBAfile + FLREG11_OFFSET;
-	FLREG11flash = FRBAflash + FLREG11_OFFSET;
 
-	// Get LAN CTRL0 region base address from input file
-	data32 = *((UINT32*)(pInputData+FLREG11file));
-    
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
-	{
-		// Region unused. Break.
-		return CG_BFRET_OK; //MOD019
-	}
-    LANCTRL0Regionfile = (data32 & 0x00007FFF) << 12;
-    // Get LAN CTRL 0 region limit
-    LANCTRL0RegionfileEnd = (data32 & 0x7FFF0000) >> 4;
-
-    // Get LAN CTRL0 region base address from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLREG11flash, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; // MOD019
-	} 
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
+    // Check whether there is a used flash region 11, which is dedicated to LAN CTRL0
+	if((CgIfdGetRegion(&ifdFile, CG_IFD_REGION_LANCTRL0, &LANCTRL0Regionfile, &LANCTRL0RegionfileEnd) != CG_IFDRET_OK) ||
+	   (CgIfdGetRegion(pIfdFlash, CG_IFD_REGION_LANCTRL0, &LANCTRL0Regionflash, &LANCTRL0RegionflashEnd) != CG_IFDRET_OK))
 	{
 		// Region unused. Break.
-		return CG_BFRET_OK; //MOD019
+		return CG_BFRET_OK;
 	}
-    LANCTRL0Regionflash = (data32 & 0x00007FFF) << 12;
-    // Get LAN CTRL 0 region limit
-    LANCTRL0RegionflashEnd = (data32 & 0x7FFF0000) >> 4;
     
     if((LANCTRL0Regionfile != LANCTRL0Regionflash) || (LANCTRL0RegionfileEnd != LANCTRL0RegionflashEnd))
 	{
 		// No match. Break
-		return CG_BFRET_OK; //MOD019
-	}
-    // Check whether
-	// there is a used flash region 11, which is dedicated to LAN CTRL1
-	FLREG12file	= FRBAfile + FLREG12_OFFSET;
-	FLREG12flash = FRBAflash + FLREG12_OFFSET;
-
-    // Get LAN CTRL1 region base address from input file
-	data32 = *((UINT32*)(pInputData+FLREG12file));
-    // Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
-	{
-		// Region unused. Break.
-		return CG_BFRET_OK; //MOD019
+		return CG_BFRET_OK;
 	}
 
-    LANCTRL1Regionfile = (data32 & 0x00007FFF) << 12;
-    LANCTRL1RegionfileEnd = (data32 & 0x7FFF0000) >> 4;
-    
- 	// Get LAN CTRL1 region base address from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLREG12flash, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; //MOD019
-	}
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
+    // Check whether there is a used flash region 12, which is dedicated to LAN CTRL1
+	if((CgIfdGetRegion(&ifdFile, CG_IFD_REGION_LANCTRL1, &LANCTRL1Regionfile, &LANCTRL1RegionfileEnd) != CG_IFDRET_OK) ||
+	   (CgIfdGetRegion(pIfdFlash, CG_IFD_REGION_LANCTRL1, &LANCTRL1Regionflash, &LANCTRL1RegionflashEnd) != CG_IFDRET_OK))
 	{
 		// Region unused. Break.
-		return CG_BFRET_OK; //MOD019
+		return CG_BFRET_OK;
 	}
-    LANCTRL1Regionflash = (data32 & 0x00007FFF) << 12;
-    // Get LAN CTRL 1 region limit
-    LANCTRL1RegionflashEnd = (data32 & 0x7FFF0000) >> 4;
-    
 
     if((LANCTRL1Regionfile != LANCTRL1Regionflash) || (LANCTRL1RegionfileEnd != LANCTRL1RegionflashEnd)) 
 	{
 		// No match. Break
-		return CG_BFRET_OK; //MOD019
-	} 
+		return CG_BFRET_OK;
+	}																		//MOD027 ^
      
     //There is a valid LANCTRL 1 section in the flash and in the file. 
     
@@ -1021,7 +1007,7 @@ UINT16 CG_CheckPatchInputExtd_DSAC
             return CG_BFRET_OK; //MOD019
         }
 
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, LANCTRL0Regionflash, lanBuffer, LANCTRL0Size))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, LANCTRL0Regionflash, lanBuffer, LANCTRL0Size))	//MOD032
         {
             BiosFlashReportState(1, "FAILED!");
             free(lanBuffer);
@@ -1046,7 +1032,7 @@ UINT16 CG_CheckPatchInputExtd_DSAC
             return CG_BFRET_OK; //MOD019
         }
         
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, LANCTRL1Regionflash, lanBuffer, LANCTRL1Size))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, LANCTRL1Regionflash, lanBuffer, LANCTRL1Size))	//MOD032
         {
             BiosFlashReportState(1, "FAILED!");
             free(lanBuffer);
@@ -1063,26 +1049,26 @@ UINT16 CG_CheckPatchInputExtd_DSAC
     {
 
         //Get first mac address with fixed offset
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, LANCTRL0Regionflash + MAC_0_2_OFFSET, &macAddress[0][0], 6))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, LANCTRL0Regionflash + MAC_0_2_OFFSET, &macAddress[0][0], 6))	//MOD032
         {
             return CG_BFRET_OK; //MOD019
         } 
         
         //MAC address 1 is stored at offset 0x212
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, LANCTRL0Regionflash + MAC_1_3_OFFSET, &macAddress[1][0], 6))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, LANCTRL0Regionflash + MAC_1_3_OFFSET, &macAddress[1][0], 6))	//MOD032
         {
             return CG_BFRET_OK; //MOD019
         }
         
         //Try to recover MAC address 2 using offset 0x202
         
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, LANCTRL1Regionflash + MAC_0_2_OFFSET, &macAddress[2][0], 6))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, LANCTRL1Regionflash + MAC_0_2_OFFSET, &macAddress[2][0], 6))	//MOD032
         {
             return CG_BFRET_OK; //MOD019
         }
         
         //MAC address 3 is stored at offset 0x212
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, LANCTRL1Regionflash + MAC_1_3_OFFSET, &macAddress[3][0], 6))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, LANCTRL1Regionflash + MAC_1_3_OFFSET, &macAddress[3][0], 6))	//MOD032
         {
             return CG_BFRET_OK; //MOD019
         }
@@ -1157,13 +1143,14 @@ UINT16 CG_CheckPatchInputExtd_EHL
 )
 {
     UINT32 gbeguid[4] = {0x12E29FB4, 0x4172AA56, 0x5FDD4EB3, 0xA90A444B};
-    UINT32 guidData[4] = {0}; // buffer for storing the guid read from the bios file in order to compare
-    UINT32 gbeFlashOffset, gbeFileOffset, nIndex, i, j;
+    UINT32 gbeFlashOffset, gbeFileOffset, i, j;                                 //MOD026
+    UINT16 retVal;                                                              //MOD026
     UINT8 guidFlashFound = FALSE;
     UINT8 guidFileFound = FALSE;
     UINT32 storageAreaSize;
     UINT32 versionFlash, numberOfPortsFlash; //version number and number of ports stored from bios flash
     unsigned char macEntryFlash[EHL_GBE_REGION_MAXNUM_PORTS][EHL_GBE_REGION_MAC_SIZE]; //array holding the mac entries stored from bios flash
+    _TCHAR szMessage[80];														//MOD043
     
     //##############################################
     // BIOS Flash : Get MAC addresses
@@ -1172,58 +1159,47 @@ UINT16 CG_CheckPatchInputExtd_EHL
     BiosFlashReportState(0, "GbE Region recovery . . . . ");
     
     //get size of bios area (CG32_STORAGE_MPFA_ALL -> BIOS ROM part (comprises _STATIC, _USER, _DYNAMIC))
-    if ((storageAreaSize = CgosStorageAreaSize(hCgos, CG32_STORAGE_MPFA_ALL)) <1)
+    if ((storageAreaSize = CgStoreSize(CG32_STORAGE_MPFA_ALL)) <1)	//MOD038
     {
         BiosFlashReportState(1, "\nERROR: Could not get flash size. Area locked??? Please try again with /ef flag");
     }
 
-    nIndex = 0;
-        
-    //search bios flash for gbe guid
-    while(nIndex < (storageAreaSize)-sizeof(guidData))
+    //search bios flash for gbe guid                                             //MOD026 v
+    retVal = CgBfFindPatternFlash(CG32_STORAGE_MPFA_ALL, storageAreaSize, (unsigned char*)&gbeguid[0], sizeof(gbeguid), 4, &gbeFlashOffset);
+    if(retVal == CG_BFRET_INTRF_ERROR)
     {
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&guidData, sizeof(guidData)))
-        {
-            BiosFlashReportState(1, "\nERROR: Could not get flash size. Area locked??? Please try again with /ef flag");
-            return CG_MPFARET_OK; // MOD018
-        }
-        //compare if 4 dwords read from the offset match the gbe guid.
-        else if((guidData[0] == gbeguid[0]) && (guidData[1] == gbeguid[1]) && (guidData[2] == gbeguid[2]) && (guidData[3] == gbeguid[3]))
-        {
-            //guid found!
-            guidFlashFound = TRUE;
-            gbeFlashOffset = nIndex; //this is the offset to GbE region (the first byte of its guid)
-            break;
-        }
-        else
-        {   //guid not found -> increase the index by 32 bits and keep searching
-            nIndex = nIndex + 4;
-        }
+        BiosFlashReportState(1, "\nERROR: Could not get flash size. Area locked??? Please try again with /ef flag");
+        return CG_MPFARET_OK; // MOD018
     }
+    else if(retVal == CG_BFRET_OK)
+    {
+        //guid found! gbeFlashOffset is the offset to GbE region (the first byte of its guid)
+        guidFlashFound = TRUE;
+    }                                                                           //MOD026 ^
     
     if (guidFlashFound == FALSE)
     {
         // no GUID found in BIOS Flash -> exit with error
         BiosFlashReportState(1, "\nERROR: Could not get flash size. Area locked??? Please try again with /ef flag\n");
-        printf("ERROR: Could not find GbE GUID in BIOS Flash!\n");
+        BiosFlashReportState(0, "ERROR: Could not find GbE GUID in BIOS Flash!");						//MOD043
         return CG_BFRET_OK; // MOD018 return OK, and flash BIOS anyway (GbE region will be written with default value)
     }
 
     // guidFlashFound == TRUE: A GbE GUID has been found in the BIOS file -> get the data
     
     // save the version dword
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, (gbeFlashOffset+EHL_GBE_REGION_NUMPORTS_OFFSET), (unsigned char*)&versionFlash, sizeof(versionFlash)))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_ALL, (gbeFlashOffset+EHL_GBE_REGION_VERSION_OFFSET), (unsigned char*)&versionFlash, sizeof(versionFlash)))	//MOD026 //MOD032
     {
-        printf("ERROR: Could not get version from BIOS flash\n");
+        BiosFlashReportState(0, "ERROR: Could not get version from BIOS flash");					//MOD043
         return CG_MPFARET_OK;  // MOD018 return OK, and flash BIOS anyway (GbE region will be written with default value)
     }
 
     // get the number of ports and the mac addresses
     
     // the number of Ports dword is at gbeFlashOffset + EHL_GBE_REGION_NUMPORTS_OFFSET
-    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, (gbeFlashOffset+EHL_GBE_REGION_NUMPORTS_OFFSET), (unsigned char*)&numberOfPortsFlash, sizeof(numberOfPortsFlash)))
+    if(!CgBfStorageRead(CG32_STORAGE_MPFA_ALL, (gbeFlashOffset+EHL_GBE_REGION_NUMPORTS_OFFSET), (unsigned char*)&numberOfPortsFlash, sizeof(numberOfPortsFlash)))	//MOD032
     {
-        printf("ERROR: Could not get number of ports from BIOS flash\n");
+        BiosFlashReportState(0, "ERROR: Could not get number of ports from BIOS flash");			//MOD043
         return CG_MPFARET_OK;  // MOD018 return OK, and flash BIOS anyway (GbE region will be written with default value)
     }
             
@@ -1231,7 +1207,7 @@ UINT16 CG_CheckPatchInputExtd_EHL
     if (numberOfPortsFlash > ((sizeof(macEntryFlash)/EHL_GBE_REGION_MAC_SIZE)))
     {
 
-        printf("\nERROR: Number of MAC addresses found in BIOS flash exceeds buffer!\n");
+        BiosFlashReportState(0, "ERROR: Number of MAC addresses found in BIOS flash exceeds buffer!");	//MOD043
         return CG_BFRET_OK;   // MOD018 return OK, and flash BIOS anyway (GbE region will be written with default value)
     }
     
@@ -1239,9 +1215,10 @@ UINT16 CG_CheckPatchInputExtd_EHL
     
     for (i = 0; i < numberOfPortsFlash; ++i)
     {
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, (gbeFlashOffset+EHL_GBE_REGION_MAC_OFFSET+(EHL_GBE_REGION_MAC_SIZE*i)), (unsigned char*)&macEntryFlash[i][0], EHL_GBE_REGION_MAC_SIZE))
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_ALL, (gbeFlashOffset+EHL_GBE_REGION_MAC_OFFSET+(EHL_GBE_REGION_MAC_SIZE*i)), (unsigned char*)&macEntryFlash[i][0], EHL_GBE_REGION_MAC_SIZE))	//MOD032
         {
-            printf("ERROR: Could not get MAC address %i from BIOS flash\n",i);
+            SPRINTF(&szMessage[0], "ERROR: Could not get MAC address %u from BIOS flash", i);	//MOD043 v
+            BiosFlashReportState(0, &szMessage[0]);								//MOD043 ^
             return CG_MPFARET_OK;  // MOD018 return OK, and flash BIOS anyway (GbE region will be written with default value)
         }
         
@@ -1253,30 +1230,17 @@ UINT16 CG_CheckPatchInputExtd_EHL
     
     //search for GbE GUID in BIOS flash file
 
-    nIndex = 0;
-    
-    while(nIndex < nInputDataSize)
+    if(CgBfFindPattern(pInputData, nInputDataSize, (unsigned char*)&gbeguid[0], sizeof(gbeguid), 4, &gbeFileOffset) == CG_BFRET_OK)	//MOD026 v
     {
-
-        if ((*(UINT32*)(pInputData+nIndex) == gbeguid[0]) && (*(UINT32*)(pInputData+nIndex+4) == gbeguid[1]) && (*(UINT32*)(pInputData+nIndex+8) == gbeguid[2]) && (*(UINT32*)(pInputData+nIndex+12) == gbeguid[3]))
-        {
-            // GUID found! 
-            guidFileFound = TRUE;
-            gbeFileOffset = nIndex; //this is the offset to GbE region (the first byte of its guid)
-            break;
-        }
-        else
-        {
-            //GUID not found (yet) -> keep on searching
-            nIndex = nIndex + 4;
-        }
-    }
+        // GUID found! gbeFileOffset is the offset to GbE region (the first byte of its guid)
+        guidFileFound = TRUE;
+    }                                                                           //MOD026 ^
     
     //exit if GUID has not been found
     if (guidFileFound == FALSE) 
     {
         // no GUID found in BIOS file -> exit with error
-        printf("\nERROR: Could not find GbE Region in BIOS File!");
+        BiosFlashReportState(0, "ERROR: Could not find GbE Region in BIOS File!");					//MOD043
         return CG_BFRET_OK;   // MOD018 return OK, and flash BIOS anyway (GbE region will be written with default value)
     }
 
@@ -1307,7 +1271,7 @@ UINT16 CG_CheckPatchInputExtd_EHL
         }
     }
 
-    printf("DONE!\n");
+    BiosFlashReportState(1, "DONE!");												//MOD043
 
     return CG_BFRET_OK; 
     
@@ -1337,10 +1301,8 @@ UINT16 CG_CheckPatchInputExtd
 )
 {
 	unsigned char macAddress[6];															
-	UINT32	data32;																//MOD008 v												
-	UINT32	FRBAfile, FRBAflash;			//Flash region base address			
-	UINT32	FLREG3file, FLREG3flash;		//GbE region base address			
-	UINT32	GbERegionfile, GbERegionflash;										//MOD008 ^
+	CG_IFD_INFO ifdFile, *pIfdFlash;	//Flash descriptors of file and flash part	//MOD027
+	UINT32	GbERegionfile, GbERegionflash;										//MOD008
 	UINT16	i;
 	UINT16	checkSum = 0;
 	UINT16	SharedICW0x13 = 0;													//MOD009
@@ -1358,78 +1320,31 @@ UINT16 CG_CheckPatchInputExtd
 	// has to be updated. 
 
 	//
-	// Verify correct flash descriptors
-
-	// Try to read flash descriptor signature from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, 0x10, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; // CG_BFRET_ERROR;
-	}
-
-	// Check flash descriptor signatures in flash part and in flash contents file 
-	if( (*((UINT32*)(pInputData+0x10)) != FLASH_DESCRIPTOR_SIGNATURE) ||  (data32 != FLASH_DESCRIPTOR_SIGNATURE))
-	{
-		// Invalid descriptor signature in flash or file -> Break.
-		return CG_BFRET_OK; 
-	}
-	
-	//
-	//
-	//
-	// Get flash region base address from input file
-	data32 = *((UINT32*)(pInputData+FLMAP0_OFFSET));
-	FRBAfile = (data32 & 0x00FF0000) >> 12;
+	// Verify correct flash descriptors									//MOD027 v
 
-	// Get flash region base address from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLMAP0_OFFSET, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; // CG_BFRET_ERROR;
-	}
-	FRBAflash = (data32 & 0x00FF0000) >> 12;
-	
-	// Check match
-	if(FRBAfile != FRBAflash)
+	// Parse flash descriptors of flash contents file and flash part
+	if((CgIfdParse(pInputData, nInputDataSize, &ifdFile) != CG_IFDRET_OK) ||
+	   (CgIfdGetFlash(&pIfdFlash) != CG_IFDRET_OK))
 	{
-		// No match. Break 
+		// Invalid descriptor in flash or file -> Break.
+		// If we cannot read the flash part at all, we might still only face a flash unlock issue.
 		return CG_BFRET_OK;
 	}
 
-	// Now that we have the flash region base address, check whether
-	// there is a used flash region 3, which is dedicated to GbE
-	FLREG3file	= FRBAfile + FLREG3_OFFSET;
-	FLREG3flash	= FRBAflash + FLREG3_OFFSET;
-
-	//
-	//
-	//
-	// Get GbE region base address from input file
-	data32 = *((UINT32*)(pInputData+FLREG3file));
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
+	// Check match of flash region base address
+	if(ifdFile.frba != pIfdFlash->frba)
 	{
-		// Region unused. Break.
+		// No match. Break 
 		return CG_BFRET_OK;
 	}
-	GbERegionfile = (data32 & 0x00007FFF) << 12;
 
-	// Get GbE region base address from flash part
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, FLREG3flash, (unsigned char*)(&data32), 4))
-    {
-		// If we cannot read at all, we have a problem !
-		// However, we might still only face a flash unlock issue.
-		return CG_BFRET_OK; // CG_BFRET_ERROR;
-	}
-	// Check whether region is used
-	if((data32 & 0x00001FFF) == 0x00001FFF)
+	// Check whether there is a used flash region 3, which is dedicated to GbE
+	if((CgIfdGetRegion(&ifdFile, CG_IFD_REGION_GBE, &GbERegionfile, NULL) != CG_IFDRET_OK) ||
+	   (CgIfdGetRegion(pIfdFlash, CG_IFD_REGION_GBE, &GbERegionflash, NULL) != CG_IFDRET_OK))
 	{
 		// Region unused. Break.
 		return CG_BFRET_OK;
-	}
-	GbERegionflash = (data32 & 0x00007FFF) << 12;
+	}																		//MOD027 ^
 	
 	// Check match
 	if(GbERegionfile != GbERegionflash)
@@ -1445,12 +1360,12 @@ UINT16 CG_CheckPatchInputExtd
 	// generally marked as valid/used via the 'Shared Init Control Word' (GbE NVM word 0x13) 
 	// than the address of the second region will be maintained. 
 	// If not the first location address is assumed to be valid and will be re-used.
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, GbERegionflash + 0x1000, &macAddress[0], 6))
+	if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, GbERegionflash + 0x1000, &macAddress[0], 6))	//MOD032
     {
         return CG_BFRET_ERROR;
     }
 	// Read shared init control word 0x13 from GbE NVM.							//MOD009 v
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, GbERegionflash + 0x1026, (UINT8*)(&SharedICW0x13), 2))
+	if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, GbERegionflash + 0x1026, (UINT8*)(&SharedICW0x13), 2))	//MOD032
     {
         return CG_BFRET_ERROR;
     }
@@ -1459,7 +1374,7 @@ UINT16 CG_CheckPatchInputExtd
 //MOD009	if( *((UINT32 *)(&macAddress[0])) == 0xFFFFFFFF )
 	{
 		// Check other location 
-		if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, GbERegionflash, &macAddress[0], 6))
+		if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, GbERegionflash, &macAddress[0], 6))	//MOD032
 		{
 			return CG_BFRET_ERROR;
 		}
@@ -1488,6 +1403,162 @@ UINT16 CG_CheckPatchInputExtd
 
 																				//MOD003 ^
 
+/*---------------------------------------------------------------------------
+ * Name: CgBfCheckRegionLayout
+ * Desc: Checks whether a region selective flash update is possible.
+ *       The flash descriptors of the flash contents file and of the flash
+ *       part have to be valid and have to describe the same flash region
+ *       layout. All selected regions have to be present.
+ * Inp:  pInputData     - Pointer to flash contents.
+ *       nInputDataSize - Size of flash contents.
+ *       nRegionMask    - Selected flash regions (bit n = flash region n).
+ *       pIfd           - Pointer to storage for the decoded descriptor.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR_REGION  - Region layouts do not match or selected
+ *                                region not present
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfCheckRegionLayout													//MOD028
+(
+	unsigned char *pInputData,
+	UINT32 nInputDataSize,
+	UINT32 nRegionMask,
+	CG_IFD_INFO *pIfd
+)
+{
+	CG_IFD_INFO *pIfdFlash;
+
+	if((CgIfdParse(pInputData, nInputDataSize, pIfd) != CG_IFDRET_OK) ||
+	   (CgIfdGetFlash(&pIfdFlash) != CG_IFDRET_OK))
+	{
+		return CG_BFRET_ERROR_REGION;
+	}
+
+	// Flash region base address and all region registers have to match
+	if((pIfd->frba != pIfdFlash->frba) ||
+	   (memcmp(&pIfd->flreg[0], &pIfdFlash->flreg[0], sizeof(pIfd->flreg)) != 0))
+	{
+		return CG_BFRET_ERROR_REGION;
+	}
+
+	if((pIfd->usedRegions & nRegionMask) != nRegionMask)
+	{
+		return CG_BFRET_ERROR_REGION;
+	}
+	return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfMergeRegionBlock
+ * Desc: Prepares a flash block that is only partly covered by the selected
+ *       flash regions. The parts outside of the selected regions are
+ *       replaced by the current flash contents, so they stay unchanged when
+ *       the block is written.
+ * Inp:  pIfd           - Pointer to decoded descriptor.
+ *       nRegionMask    - Selected flash regions (bit n = flash region n).
+ *       nOffset        - Offset of the block in the extended storage area.
+ *       pData          - Pointer to new block contents (updated).
+ *       nSize          - Block size.
+ *       pScratch       - Buffer of nSize bytes to read the flash block to.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_INTRF_ERROR   - Failed to read flash block
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfMergeRegionBlock														//MOD028
+(
+	CG_IFD_INFO *pIfd,
+	UINT32 nRegionMask,
+	UINT32 nOffset,
+	unsigned char *pData,
+	UINT32 nSize,
+	unsigned char *pScratch
+)
+{
+	UINT32 nPos, nLength;
+
+	if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, nOffset, pScratch, nSize))	//MOD031
+	{
+		return CG_BFRET_INTRF_ERROR;
+	}
+
+	// Flash regions are 4k aligned
+	for(nPos = 0; nPos < nSize; nPos = nPos + 0x1000)
+	{
+		nLength = ((nSize - nPos) < 0x1000) ? (nSize - nPos) : 0x1000;
+		if(!(CgIfdGetRegionMask(pIfd, nOffset + nPos, nLength) & nRegionMask))
+		{
+			memcpy(pData + nPos, pScratch + nPos, nLength);
+		}
+	}
+	return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfStitchBiosRegion
+ * Desc: Replaces the BIOS region of a full flash image by the contents of a
+ *       BIOS image file, e.g. a Slim Bootloader image, like the stitch tools
+ *       do. The BIOS region is taken from the flash descriptor of the image.
+ *       A smaller BIOS image is placed at the end of the region, as the
+ *       reset vector is at its top, and the rest is filled with 0xFF.
+ * Inp:  pImage         - Pointer to full flash image (updated).
+ *       nImageSize     - Size of the full flash image.
+ *       lpszStitchFile - Name of the BIOS image file.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR_REGION  - No flash descriptor or no BIOS region
+ *       CG_BFRET_ERROR_SIZE    - BIOS image bigger than the BIOS region
+ *       CG_BFRET_ERROR_FILE    - File processing error
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfStitchBiosRegion														//MOD036
+(
+	unsigned char *pImage,
+	UINT32 nImageSize,
+	_TCHAR *lpszStitchFile
+)
+{
+	CG_IFD_INFO ifdImage;
+	FILE *fpStitchFile;
+	UINT32 nBase, nLimit, nRegionSize, nStitchSize;
+	UINT16 retVal;
+
+	if((CgIfdParse(pImage, nImageSize, &ifdImage) != CG_IFDRET_OK) ||
+	   (CgIfdGetRegion(&ifdImage, CG_IFD_REGION_BIOS, &nBase, &nLimit) != CG_IFDRET_OK) ||
+	   ((nLimit + 0x1000) > nImageSize))
+	{
+		return CG_BFRET_ERROR_REGION;
+	}
+	nRegionSize = nLimit + 0x1000 - nBase;
+
+	if((fpStitchFile = fopen(lpszStitchFile, "rb")) == NULL)
+	{
+		return CG_BFRET_ERROR_FILE;
+	}
+	if((retVal = CgBfGetFileSize(fpStitchFile, &nStitchSize)) != CG_BFRET_OK)
+	{
+		fclose(fpStitchFile);
+		return retVal;
+	}
+	if((nStitchSize == 0) || (nStitchSize > nRegionSize))
+	{
+		fclose(fpStitchFile);
+		return CG_BFRET_ERROR_SIZE;
+	}
+
+	// Read the BIOS image straight to its place in the flash image
+	memset(pImage + nBase, 0xFF, nRegionSize - nStitchSize);
+	fseek(fpStitchFile, 0, SEEK_SET);
+	if(fread(pImage + nBase + nRegionSize - nStitchSize, nStitchSize, 1, fpStitchFile) != 1)
+	{
+		fclose(fpStitchFile);
+		return CG_BFRET_ERROR_FILE;
+	}
+	fclose(fpStitchFile);
+	return CG_BFRET_OK;
+}
+
 /*---------------------------------------------------------------------------
  * Name: CG_BiosSave
  * Desc: Save system BIOS to file.
@@ -1502,7 +1573,8 @@ UINT16 CG_CheckPatchInputExtd
  */
 UINT16 CG_BiosSave( _TCHAR* lpszBiosFile)
 {   
-    UINT32 nTransfered;
+    UINT32 nTransfered, nReadSize;												//MOD031
+    UINT16 retVal;																//MOD033
     unsigned char *pBuffer;
     FILE *fpBiosRomfile = NULL;
 	UINT32 ulStorageSelector;											//MOD003        
@@ -1543,6 +1615,19 @@ GWETODO ^*/
 //GWETODO	}
 																				//MOD003 ^
 
+    if(bBfSparseBackup)															//MOD033 v
+    {
+        BiosFlashReportState(0, " ");
+        BiosFlashReportState(0, "Saving system BIOS. . . . . . ");
+        if((retVal = CgBkSave(lpszBiosFile, ulStorageSelector, nLocalFlashSize)) != CG_BFRET_OK)
+        {
+            BiosFlashReportState(1, "FAILED!");
+            return retVal;
+        }
+        BiosFlashReportState(1, "DONE!");
+        return CG_BFRET_OK;
+    }																			//MOD033 ^
+
     // Check ROM file
     fpBiosRomfile = fopen(lpszBiosFile, "wb");
     if (!fpBiosRomfile)
@@ -1550,8 +1635,13 @@ GWETODO ^*/
         return CG_BFRET_ERROR_FILE;
     }
 
-    // Allocate buffer for system BIOS    
-    pBuffer = (unsigned char*)malloc(nLocalFlashSize);
+    // Allocate buffer for one read transfer									//MOD031 v
+    nReadSize = CgBfGetReadSize();
+    if((nLocalFlashSize % nReadSize) != 0)
+    {
+        nReadSize = nFlashBlockSize;
+    }																			//MOD031 ^
+    pBuffer = (unsigned char*)malloc(nReadSize);								//MOD031
     if(!pBuffer)
     {
         fclose(fpBiosRomfile);
@@ -1565,27 +1655,26 @@ GWETODO ^*/
     // We have to split up MPFA transfers in reasonable block sizes due to limitations
     // of some CGOS driver implementations.
     nTransfered = 0;
-    // Read flash contens to buffer
+    // Read flash contents block by block and save each block to file right away	//MOD025
     do
     {
-        if(!CgosStorageAreaRead(hCgos, ulStorageSelector, nTransfered, pBuffer + nTransfered, nFlashBlockSize))
+        if(!CgBfStorageRead(ulStorageSelector, nTransfered, pBuffer, nReadSize))	//MOD031 //MOD032
         {
             BiosFlashReportState(1, "FAILED!");
             free(pBuffer); 
             fclose(fpBiosRomfile);
             return CG_BFRET_INTRF_ERROR;
         }
-        nTransfered = nTransfered + nFlashBlockSize;
+        if(fwrite(pBuffer, nReadSize, 1, fpBiosRomfile ) != 1)					//MOD025 v //MOD031
+        {
+            BiosFlashReportState(1, "FAILED!");
+            free(pBuffer); 
+            fclose(fpBiosRomfile);
+            return CG_BFRET_ERROR_FILE;
+        }																		//MOD025 ^
+        nTransfered = nTransfered + nReadSize;								//MOD031
     }while(nTransfered < nLocalFlashSize);
     
-    // Save buffer to file
-    if(fwrite(pBuffer, nLocalFlashSize, 1, fpBiosRomfile ) != 1)
-    {
-        BiosFlashReportState(1, "FAILED!");
-        free(pBuffer); 
-        fclose(fpBiosRomfile);
-        return CG_BFRET_ERROR_FILE;
-    }
     free(pBuffer); 
     fclose(fpBiosRomfile);
     BiosFlashReportState(1, "DONE!");
@@ -1642,17 +1731,19 @@ UINT16 CG_BiosFlashPrepare(void)
  *       CG_BFRET_ERROR_SIZE    - Sizes of ROM file and target flash don't match
  *       CG_BFRET_ERROR_FILE    - File processing error
  *       CG_BFRET_ERROR         - General processing error.
+ *       CG_BFRET_ERROR_REGION  - Region layout mismatch (CG_BFFLAG_REGION)
  *
  *---------------------------------------------------------------------------
  */
 UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
 {   
     UINT16 retVal;
-    UINT32 nRomfileSize, nBlockCount, nCount, nCheckLength, nTransfered;
+    UINT32 nRomfileSize, nBlockCount;											//MOD023
     char szFileBiosName[9] = {0x00};
-    unsigned char *pBuffer, *pCheckBuffer;
+    unsigned char *pBuffer;														//MOD023
     unsigned char nCmosVal = 0x00;
     FILE *fpBiosRomfile = NULL;
+    FILE *fpContainerImage = NULL;												//MOD033
     char strBlockInfo[80] = {0};
     unsigned char nRetryCount = 0;
 	UINT32 bufferOffset = 0;												//MOD003 v	
@@ -1662,7 +1753,23 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
 	unsigned char bExtdUpdate;				
 	UINT32 nLocalFlashBlockSize;											//MOD014
 																			//MOD003 ^
-	pCheckBuffer = NULL;													//MOD014
+	unsigned char *pFlashBlock;												//MOD021
+	UINT32 nSkippedBlocks;													//MOD021
+	UINT32 nBlockState, nEraseSkippedBlocks;								//MOD022
+	UINT16 nVerifyRet;														//MOD023
+	CG_IFD_INFO ifdRegion;													//MOD028
+	UINT32 nBlockRegions, nRegionSkippedBlocks;								//MOD028
+	CG_BF_JOURNAL_HEADER journalHeader;										//MOD029
+	UINT32 nJournalResumed, nJournalSkippedBlocks;							//MOD029
+	UINT32 nTmStart;														//MOD035
+	UINT32 bReadOk;															//MOD044
+	CG_SBL_INFO sblInfo;													//MOD037
+	UINT32 nSblSkippedBlocks = 0;											//MOD037
+	pFlashBlock = NULL;														//MOD021
+	nJournalSkippedBlocks = 0;												//MOD029
+	nRegionSkippedBlocks = 0;												//MOD028
+	nSkippedBlocks = 0;														//MOD021
+	nEraseSkippedBlocks = 0;												//MOD022
 
 
     if(!hCgos)
@@ -1707,6 +1814,22 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
         return CG_BFRET_ERROR_FILE;
     }
     
+    if(CgBkIsContainer(fpBiosRomfile))										//MOD033 v
+    {
+        // Backup container: Continue with the expanded image. Blocks that
+        // already match are skipped.
+        nTmStart = CgTmTimeStamp();											//MOD035
+        retVal = CgBkExpand(fpBiosRomfile, &fpContainerImage);
+        fclose(fpBiosRomfile);
+        if(retVal != CG_BFRET_OK)
+        {
+            return retVal;
+        }
+        CgTmPhase(CG_TM_PHASE_READFILE, nTmStart);							//MOD035
+        fpBiosRomfile = fpContainerImage;
+        nFlags = nFlags | CG_BFFLAG_DIFF;
+    }																		//MOD033 ^
+    
     if((retVal = CgBfGetFileSize(fpBiosRomfile, &nRomfileSize)) != CG_BFRET_OK)
     {
         fclose(fpBiosRomfile);
@@ -1868,29 +1991,99 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
 
 																											//MOD003 ^
 #endif								
-    // Allocate buffer for BIOS file    
-    pBuffer = (unsigned char*)malloc(nRomfileSize);
-    if(!pBuffer)
-    {
-        fclose(fpBiosRomfile);
-        return CG_BFRET_ERROR;
-    }
-
-    // Read contents of BIOS file to buffer
+    // Get contents of BIOS file
     BiosFlashReportState(0, " ");   //Placeholder for next string
     BiosFlashReportState(0, "Reading BIOS file. . . . ");
-    fseek(fpBiosRomfile,0, SEEK_SET);
-    fread(pBuffer, nRomfileSize, 1, fpBiosRomfile );
-    if( ferror( fpBiosRomfile ) )      
+    nTmStart = CgTmTimeStamp();												//MOD035
+    if((retVal = CgBfMapRomfile(fpBiosRomfile, nRomfileSize, &pBuffer)) != CG_BFRET_OK)	//MOD025
     {
         BiosFlashReportState(1, "FAILED!");
         fclose(fpBiosRomfile);
-        return CG_BFRET_ERROR_FILE;
+        return retVal;
     }
 
     fclose(fpBiosRomfile);
+    CgTmPhase(CG_TM_PHASE_READFILE, nTmStart);									//MOD035
     BiosFlashReportState(1, "DONE!");
+
+	if(nFlags & CG_BFFLAG_STITCH)												//MOD036 v
+	{
+		// The BIOS region is located through the flash descriptor and thus
+		// requires a full flash update.
+		if(!bExtdUpdate)
+		{
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			return CG_BFRET_ERROR_NOEXTD;
+		}
+		BiosFlashReportState(0, "Stitching BIOS region . . . ");
+		nTmStart = CgTmTimeStamp();
+		if((retVal = CgBfStitchBiosRegion(pBuffer + bufferOffset, nLocalFlashSize, &szBfStitchFile[0])) != CG_BFRET_OK)
+		{
+			BiosFlashReportState(1, "FAILED!");
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			return retVal;
+		}
+		CgTmPhase(CG_TM_PHASE_READFILE, nTmStart);
+		BiosFlashReportState(1, "DONE!");
+	}																			//MOD036 ^
+
+	if(nFlags & CG_BFFLAG_JOURNAL)												//MOD029 v
+	{
+		// Identify the update by the unpatched file contents. Patches like the
+		// MAC address recovery depend on the current flash contents.
+		memset(&journalHeader, 0, sizeof(journalHeader));
+		journalHeader.nImageCrc = CgBfCrc32c(0, pBuffer, nRomfileSize);
+	}																			//MOD029 ^
+
+	if(nFlags & CG_BFFLAG_REGION)												//MOD028 v
+	{
+		// Region selective updates address the whole flash part and require
+		// matching flash region layouts in file and flash part.
+		if(!bExtdUpdate)
+		{
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			return CG_BFRET_ERROR_NOEXTD;
+		}
+		if((retVal = CgBfCheckRegionLayout(pBuffer, nRomfileSize, nBfRegionMask, &ifdRegion)) != CG_BFRET_OK)
+		{
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			return retVal;
+		}
+	}																			//MOD028 ^
+
+	if(nFlags & (CG_BFFLAG_DIFF | CG_BFFLAG_BACKUP))							//MOD032 v
+	{
+		// Read the flash contents once. The backup, the block compare and the
+		// MAC address recovery are served from this snapshot.
+		// The snapshot holds the whole area, so /DIFF and /BACKUP need a	//MOD042
+		// buffer of the flash size. It is released on every exit.			//MOD042
+		BiosFlashReportState(0, "Reading flash contents . . . ");
+		nTmStart = CgTmTimeStamp();											//MOD035
+		if((retVal = CgBfSnapshotLoad(ulStorageSelector, nLocalFlashSize)) != CG_BFRET_OK)
+		{
+			BiosFlashReportState(1, "FAILED!");
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			return retVal;
+		}
+		CgTmPhase(CG_TM_PHASE_READFLASH, nTmStart);							//MOD035
+		BiosFlashReportState(1, "DONE!");
+		if(nFlags & CG_BFFLAG_BACKUP)
+		{
+			BiosFlashReportState(0, "Saving flash contents to backup file . . . ");
+			nTmStart = CgTmTimeStamp();										//MOD035
+			if((retVal = CgBfSnapshotSave(&szBfBackupFile[0])) != CG_BFRET_OK)
+			{
+				BiosFlashReportState(1, "FAILED!");
+				CgBfSnapshotFree();
+				CgBfUnmapRomfile(pBuffer, nRomfileSize);
+				return retVal;
+			}
+			CgTmPhase(CG_TM_PHASE_BACKUP, nTmStart);						//MOD035
+			BiosFlashReportState(1, "DONE!");
+		}
+	}																			//MOD032 ^
     
+    nTmStart = CgTmTimeStamp();												//MOD035
     //MOD018 v 
     // Check if platform is Elkhart Lake (QA70, SA70, TA70, PA70, MA70). If yes, perform EHL MAC address recovery.
     //MOD905 added "3AWN" for customer Omron to perform MAC address recovery
@@ -1900,7 +2093,8 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
                 if(CG_CheckPatchInputExtd_EHL(pBuffer,nRomfileSize,*((UINT32 *)(&szBoardBiosName[0])),nFlags) != CG_BFRET_OK)
                 {
                     // Failed to perform required input data patch or check. Quit.
-                    free(pBuffer);
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
                     return CG_BFRET_ERROR;
                 }
                 if (nFlags & CG_BFFLAG_KEEP_LANAREAS)
@@ -1912,7 +2106,13 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
 																				//MOD003 v
 	// For a real extended flash update special handling of the additional flash content might be required,
 	// like restoring the MAC address stored in the flash or other things. This can be handled here.
-	if(bExtdUpdate)
+	if(bExtdUpdate && (nFlags & CG_BFFLAG_REGION) &&							//MOD028 v
+	   (!(nBfRegionMask & ((1 << CG_IFD_REGION_GBE) | (1 << CG_IFD_REGION_LANCTRL0) | (1 << CG_IFD_REGION_LANCTRL1)))))
+	{
+		// The LAN regions are not selected for update. The MAC addresses
+		// stored there remain untouched and need not be restored.
+	}
+	else if(bExtdUpdate)														//MOD028 ^
 	{
         //MOD015 v
         //Check if we want to flash a DSAC. If yes, use the special handling for DSAC.
@@ -1922,7 +2122,8 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
                 if(CG_CheckPatchInputExtd_DSAC(pBuffer,nRomfileSize,*((UINT32 *)(&szBoardBiosName[0])),nFlags) != CG_BFRET_OK)
                 {
                     // Failed to perform required input data patch or check. Quit.
-                    free(pBuffer);
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
                     return CG_BFRET_ERROR;
                 }
         }
@@ -1936,7 +2137,8 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
                 if(CG_CheckPatchInputExtd_ICL(pBuffer,nRomfileSize,*((UINT32 *)(&szBoardBiosName[0])),nFlags) != CG_BFRET_OK)
                 {
                     // Failed to perform required input data patch or check. Quit.
-                    free(pBuffer);
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
                     return CG_BFRET_ERROR;
                 }
         } 
@@ -1950,7 +2152,8 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
                 if(CG_CheckPatchInputExtd_EHL(pBuffer,nRomfileSize,*((UINT32 *)(&szBoardBiosName[0])),nFlags) != CG_BFRET_OK)
                 {
                     // Failed to perform required input data patch or check. Quit.
-                    free(pBuffer);
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
                     return CG_BFRET_ERROR;
                 }
                 if (nFlags & CG_BFFLAG_KEEP_LANAREAS)
@@ -1964,7 +2167,8 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
             if(CG_CheckPatchInputExtd(pBuffer,nRomfileSize,*((UINT32 *)(&szBoardBiosName[0]))) != CG_BFRET_OK)
             {
                 // Failed to perform required input data patch or check. Quit.
-                free(pBuffer);
+                CgBfSnapshotFree();												//MOD042
+                CgBfUnmapRomfile(pBuffer, nRomfileSize);
                 return CG_BFRET_ERROR;
             }
             if (nFlags & CG_BFFLAG_KEEP_LANAREAS)
@@ -1984,6 +2188,7 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
         }
     }
     //MOD015 ^
+    CgTmPhase(CG_TM_PHASE_MACRECOVERY, nTmStart);								//MOD035
 
     																			//MOD003 ^
 																	
@@ -2005,27 +2210,194 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
     //MOD013 ^
                                                                         //MOD014 v
 	// Distinguish between new BIOSes supporting 512k update blocks and older ones supporting only 64k	
-	ulAreaBlocksize = CgosStorageAreaBlockSize(hCgos, CG32_STORAGE_MPFA_EXTD);
-	if(( ulAreaBlocksize == 0x80000) && ((nLocalFlashSize & 0x0007FFFF ) == 0))	// Check BIOS supports 512KB update.
-	{ 		
-    BiosFlashReportState(0, " ");   //Placeholder for next string
-       BiosFlashReportState(0, "BIOS supports 512KB update data block size !\n");   	//Placeholder for next string
-	   nLocalFlashBlockSize = 0x80000;		// Updating 512kb block everytime
-		for(nBlockCount = 0; nBlockCount < (nLocalFlashSize /nLocalFlashBlockSize ) ; nBlockCount++) 
-		{	
-        	for(nRetryCount=0; nRetryCount <= MAX_FLASH_RETRIES; nRetryCount++)
-			{      		
-				SPRINTF(&strBlockInfo[0],"Update flash block %d of %d", nBlockCount + 1, (nLocalFlashSize /nLocalFlashBlockSize ) );
-				BiosFlashReportState(2, &strBlockInfo[0]);
-				// Erase is performed only if current data is not matched with data in flash block
-	    		// Erase was done by BIOS routine before performing flash write
+	// Only the BIOS erases 512k update blocks itself. Other backends (MTD) always	//MOD045 v
+	// take the regular erase path, with their erase block size as flash block size.
+	ulAreaBlocksize = CgStoreIsCgos() ? CgStoreBlockSize(CG32_STORAGE_MPFA_EXTD) : 0;	//MOD038 //MOD045 ^
+																				//MOD021 v
+	// Allocate a buffer to hold the current contents of one flash block for the
+	// differential update and the block verification.							//MOD023
+	// It has to be big enough for the 512k update block size as well.
+	pFlashBlock = (unsigned char*)malloc((ulAreaBlocksize == 0x80000) ? 0x80000 : nFlashBlockSize);
+	if(!pFlashBlock)
+	{
+		CgBfSnapshotFree();														//MOD042
+		CgBfUnmapRomfile(pBuffer, nRomfileSize);
+		return CG_BFRET_ERROR;
+	}																			//MOD021 ^
+	if(nFlags & CG_BFFLAG_UPTODATE)												//MOD039 v
+	{
+		// Pre-flight check: nothing to do if the flash part already holds the
+		// final image (after MAC address recovery etc.).
+		BiosFlashReportState(0, "Checking flash contents . . . ");
+		nTmStart = CgTmTimeStamp();
+		retVal = CgBfDigestCheck(lpszBiosFile, ulStorageSelector, pBuffer + bufferOffset, nLocalFlashSize, pFlashBlock);
+		CgTmPhase(CG_TM_PHASE_COMPARE, nTmStart);
+		if(retVal == CG_BFRET_UPTODATE)
+		{
+			BiosFlashReportState(1, "DONE!");
+			BiosFlashReportState(0, "Flash already holds the BIOS file contents, nothing to update.");
+			CgBfSnapshotFree();
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			free(pFlashBlock);
+			// Nothing has been written. Restore the lock without restart.
+			if(bExtdUpdate && !CgosStorageAreaLock(hCgos, CG32_STORAGE_MPFA_EXTD, 0x00000000, NULL, 0))
+			{
+				return CG_BFRET_ERROR_LOCK_EXTD;
+			}
+			return CG_BFRET_UPTODATE;
+		}
+		if(retVal != CG_BFRET_OK)
+		{
+			BiosFlashReportState(1, "FAILED!");
+			CgBfSnapshotFree();
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			free(pFlashBlock);
+			return retVal;
+		}
+		BiosFlashReportState(1, "DONE!");
+	}																			//MOD039 ^
+	if(nFlags & CG_BFFLAG_SBL)													//MOD037 v
+	{
+		// Only write the Slim Bootloader components that differ from the
+		// flash part. Blocks outside of the components are written as usual.
+		BiosFlashReportState(0, "Comparing Slim Bootloader components . . . ");
+		nTmStart = CgTmTimeStamp();
+		if((retVal = CgSblParse(pBuffer + bufferOffset, nLocalFlashSize, &sblInfo)) == CG_BFRET_OK)
+		{
+			retVal = CgSblCompareFlash(&sblInfo, pBuffer + bufferOffset, ulStorageSelector, pFlashBlock, nFlashBlockSize);
+		}
+		CgTmPhase(CG_TM_PHASE_COMPARE, nTmStart);
+		if(retVal == CG_BFRET_ERROR_REGION)
+		{
+			// All components are marked as changed
+			BiosFlashReportState(1, "DONE!");
+			BiosFlashReportState(0, "Flash map differs, updating all components.");
+		}
+		else if(retVal != CG_BFRET_OK)
+		{
+			BiosFlashReportState(1, "FAILED!");
+			CgBfSnapshotFree();													//MOD042
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			free(pFlashBlock);
+			CgBfDigestClose(FALSE);									//MOD039
+			return retVal;
+		}
+		else
+		{
+			BiosFlashReportState(1, "DONE!");
+		}
+		for(nBlockCount = 0; nBlockCount < sblInfo.nComponents; nBlockCount++)
+		{
+			SPRINTF(&strBlockInfo[0], "%.4s%s at 0x%08X, %6d KB: %s", (char*)&sblInfo.components[nBlockCount].nSignature,
+			        (sblInfo.components[nBlockCount].nFlags & CG_SBL_FLAG_BACKUP) ? " (B)" : "    ",
+			        sblInfo.components[nBlockCount].nBase, sblInfo.components[nBlockCount].nSize / 1024,
+			        sblInfo.components[nBlockCount].bChanged ? "update" : "unchanged");
+			BiosFlashReportState(0, &strBlockInfo[0]);
+		}
+	}																			//MOD037 ^
+	// The flash descriptor may be rewritten from here on. Drop the cached copy.	//MOD027
+	CgIfdInvalidateFlash();
+	if(nFlags & CG_BFFLAG_JOURNAL)												//MOD029 v
+	{
+		journalHeader.nSignature = CG_BF_JOURNAL_SIGNATURE;
+		journalHeader.nVersion = CG_BF_JOURNAL_VERSION;
+		journalHeader.nImageSize = nRomfileSize;
+		journalHeader.nStorageSelector = ulStorageSelector;
+		journalHeader.nBlockSize = (( ulAreaBlocksize == 0x80000) && ((nLocalFlashSize & 0x0007FFFF ) == 0)) ? 0x80000 : nFlashBlockSize;
+		journalHeader.nBlockCount = nLocalFlashSize / journalHeader.nBlockSize;
+		journalHeader.nRegionMask = (nFlags & CG_BFFLAG_REGION) ? nBfRegionMask : 0;
+		if((retVal = CgBfJournalOpen(lpszBiosFile, &journalHeader, &nJournalResumed)) != CG_BFRET_OK)
+		{
+			CgBfSnapshotFree();													//MOD042
+			CgBfUnmapRomfile(pBuffer, nRomfileSize);
+			free(pFlashBlock);
+			CgBfDigestClose(FALSE);									//MOD039
+			return retVal;
+		}
+		if(nJournalResumed)
+		{
+			SPRINTF(&strBlockInfo[0],"Resuming update, %d of %d flash blocks already done.", nJournalResumed, journalHeader.nBlockCount);
+			BiosFlashReportState(0, &strBlockInfo[0]);
+		}
+	}																			//MOD029 ^
+	// The flash part is written from now on, cached digests are outdated.		//MOD046
+	CgBfDigestInvalidate();														//MOD046
+	if(( ulAreaBlocksize == 0x80000) && ((nLocalFlashSize & 0x0007FFFF ) == 0))	// Check BIOS supports 512KB update.
+	{ 		
+    BiosFlashReportState(0, " ");   //Placeholder for next string
+       BiosFlashReportState(0, "BIOS supports 512KB update data block size !\n");   	//Placeholder for next string
+	   nLocalFlashBlockSize = 0x80000;		// Updating 512kb block everytime
+		for(nBlockCount = 0; nBlockCount < (nLocalFlashSize /nLocalFlashBlockSize ) ; nBlockCount++) 
+		{	
+			if((nFlags & CG_BFFLAG_JOURNAL) &&									//MOD029 v
+			   CgBfJournalCheckBlock(nBlockCount, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize, pFlashBlock))
+			{
+				// Already written by an interrupted run and still intact.
+				nJournalSkippedBlocks++;
+				continue;
+			}																	//MOD029 ^
+			if(nFlags & CG_BFFLAG_REGION)										//MOD028 v
+			{
+				// Only update blocks of the selected flash regions. Keep the
+				// contents of other regions that share a block with them.
+				nBlockRegions = CgIfdGetRegionMask(&ifdRegion, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize);
+				if(!(nBlockRegions & nBfRegionMask))
+				{
+					nRegionSkippedBlocks++;
+					continue;
+				}
+				if((nBlockRegions & (~nBfRegionMask)) &&
+				   (CgBfMergeRegionBlock(&ifdRegion, nBfRegionMask, (nBlockCount * nLocalFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nLocalFlashBlockSize)), nLocalFlashBlockSize, pFlashBlock) != CG_BFRET_OK))
+				{
+					BiosFlashReportState(1, "FAILED!");
+					CgBfSnapshotFree();											//MOD042
+					CgBfUnmapRomfile(pBuffer, nRomfileSize);
+					CgBfJournalClose(FALSE);										//MOD029
+					CgBfDigestClose(FALSE);										//MOD039
+					free(pFlashBlock);
+					return CG_BFRET_INTRF_ERROR;
+				}
+			}																	//MOD028 ^
+			if((nFlags & CG_BFFLAG_SBL) &&										//MOD037 v
+			   CgSblIsBlockUnchanged(&sblInfo, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize))
+			{
+				// Only holds Slim Bootloader components that are up to date.
+				nSblSkippedBlocks++;
+				continue;
+			}																	//MOD037 ^
+			if(nFlags & CG_BFFLAG_DIFF)											//MOD021 v MOD023
+			{
+				// Skip the block if the flash already holds the new contents.
+				nTmStart = CgTmTimeStamp();										//MOD035
+				bReadOk = CgBfStorageRead(ulStorageSelector, (nBlockCount * nLocalFlashBlockSize), pFlashBlock, nLocalFlashBlockSize);	//MOD031 //MOD044
+				CgTmBlock(CG_TM_PHASE_COMPARE, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize, nTmStart, 0, bReadOk);	//MOD035 //MOD044
+				if(bReadOk &&													//MOD044
+				   (memcmp(pFlashBlock, pBuffer + bufferOffset + (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize) == 0))
+				{
+					nSkippedBlocks++;
+					continue;
+				}
+			}																	//MOD021 ^
+        	for(nRetryCount=0; nRetryCount <= MAX_FLASH_RETRIES; nRetryCount++)
+			{      		
+				SPRINTF(&strBlockInfo[0],"Update flash block %d of %d", nBlockCount + 1, (nLocalFlashSize /nLocalFlashBlockSize ) );
+				CgBfSnapshotInvalidate(ulStorageSelector, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize);	//MOD032
+				BiosFlashReportState(2, &strBlockInfo[0]);
+				// Erase is performed only if current data is not matched with data in flash block
+	    		// Erase was done by BIOS routine before performing flash write
     			// Check CGMPProgramFlash_Ex() in CgMpfaSmmLib.c
-            	if(!CgosStorageAreaWrite(hCgos, ulStorageSelector, (nBlockCount * nLocalFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nLocalFlashBlockSize)), nLocalFlashBlockSize)) 
+				nTmStart = CgTmTimeStamp();										//MOD035
+            	if(!CgStoreWrite(ulStorageSelector, (nBlockCount * nLocalFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nLocalFlashBlockSize)), nLocalFlashBlockSize))	//MOD038
 				{ 
+					CgTmBlock(CG_TM_PHASE_PROGRAM, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize, nTmStart, nRetryCount, FALSE);	//MOD035
 					if(nRetryCount >= MAX_FLASH_RETRIES) 
 					{
                        BiosFlashReportState(1, "FAILED!");
-                       free(pBuffer);
+                       CgBfSnapshotFree();										//MOD042
+                       CgBfUnmapRomfile(pBuffer, nRomfileSize);
+                       CgBfJournalClose(FALSE);										//MOD029
+                       CgBfDigestClose(FALSE);										//MOD039
+                       free(pFlashBlock);											//MOD021
                        return CG_BFRET_INTRF_ERROR;
                 	}
 					BiosFlashReportState(1, "RETRY!");
@@ -2033,14 +2405,63 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
             	} 
 				else 
 				{
-                 	break;
+					// Read back and compare the block right away. The BIOS routine	//MOD024 v
+					// verifies as well, but a failure there is not reported to us.
+					CgTmBlock(CG_TM_PHASE_PROGRAM, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize, nTmStart, nRetryCount, TRUE);	//MOD035
+					nTmStart = CgTmTimeStamp();										//MOD035
+					nVerifyRet = CgBfVerifyBlock(ulStorageSelector, (nBlockCount * nLocalFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nLocalFlashBlockSize)), nLocalFlashBlockSize, pFlashBlock, nFlags);	//MOD048
+					CgTmBlock(CG_TM_PHASE_VERIFY, (nBlockCount * nLocalFlashBlockSize), nLocalFlashBlockSize, nTmStart, nRetryCount, (nVerifyRet == CG_BFRET_OK));	//MOD035
+					if(nVerifyRet == CG_BFRET_OK)
+					{
+						CgBfJournalSetBlock(nBlockCount, (pBuffer + bufferOffset + (nBlockCount * nLocalFlashBlockSize)), nLocalFlashBlockSize);	//MOD029
+                 		break;
+					}
+					if(nRetryCount >= MAX_FLASH_RETRIES) 
+					{
+                       BiosFlashReportState(1, "VERIFY FAILED!");
+                       CgBfSnapshotFree();										//MOD042
+                       CgBfUnmapRomfile(pBuffer, nRomfileSize);
+                       CgBfJournalClose(FALSE);										//MOD029
+                       CgBfDigestClose(FALSE);										//MOD039
+                       free(pFlashBlock);
+                       return nVerifyRet;
+                	}
+					BiosFlashReportState(1, "RETRY!");
+					BiosFlashReportState(0, " ");   //Placeholder for next string		//MOD024 ^
             	}				
         	}
 		}
+		CgBfJournalClose(TRUE);											//MOD029
+		// Blocks outside of the selected regions and the restored preserved data	//MOD039 v
+		// may differ from the image, don't cache the image digests then.
+		CgBfDigestClose(!(nFlags & (CG_BFFLAG_REGION | CG_BFFLAG_PRESERVE)));	//MOD039 ^
+		CgBfSnapshotFree();												//MOD032
+		free(pFlashBlock);														//MOD021 v
+		if(nFlags & CG_BFFLAG_DIFF)
+		{
+			SPRINTF(&strBlockInfo[0],"%d of %d flash blocks unchanged and skipped.", nSkippedBlocks, (nLocalFlashSize /nLocalFlashBlockSize ) );
+			BiosFlashReportState(0, &strBlockInfo[0]);
+		}																		//MOD021 ^
+		if(nFlags & CG_BFFLAG_REGION)											//MOD028 v
+		{
+			SPRINTF(&strBlockInfo[0],"%d of %d flash blocks outside of selected regions.", nRegionSkippedBlocks, (nLocalFlashSize /nLocalFlashBlockSize ) );
+			BiosFlashReportState(0, &strBlockInfo[0]);
+		}																		//MOD028 ^
+		if(nFlags & CG_BFFLAG_SBL)												//MOD037 v
+		{
+			SPRINTF(&strBlockInfo[0],"%d of %d flash blocks hold unchanged SBL components.", nSblSkippedBlocks, (nLocalFlashSize /nLocalFlashBlockSize ) );
+			BiosFlashReportState(0, &strBlockInfo[0]);
+		}																		//MOD037 ^
+		if(nFlags & CG_BFFLAG_JOURNAL)											//MOD029 v
+		{
+			SPRINTF(&strBlockInfo[0],"%d of %d flash blocks already done according to journal.", nJournalSkippedBlocks, (nLocalFlashSize /nLocalFlashBlockSize ) );
+			BiosFlashReportState(0, &strBlockInfo[0]);
+		}																		//MOD029 ^
+		CgBfUnmapRomfile(pBuffer, nRomfileSize);															//MOD024
 		BiosFlashReportState(0, "Verify BIOS update . . . . . ");
     	// Verification was done by BIOS routine after performing flash write
     	// Check CGMPProgramFlash_Ex() in CgMpfaSmmLib.c
-    	// Avoid verifying multiple times
+		// MOD024: and by us right after each block write.
     	BiosFlashReportState(1, "DONE!");
 	}
 	else 
@@ -2050,97 +2471,188 @@ UINT16 CG_BiosFlash( _TCHAR* lpszBiosFile, UINT32 nFlags)
 	    for(nBlockCount = 0; nBlockCount < (nLocalFlashSize /nFlashBlockSize ) ; nBlockCount++)
 	    {
         // MOD011: Removed outdated special handling for 'bootblock'. Does not exist anymore in this form.
+
+		nBlockState = CG_BFBLK_ERASE;												//MOD022
+		if((nFlags & CG_BFFLAG_JOURNAL) &&									//MOD029 v
+		   CgBfJournalCheckBlock(nBlockCount, (nBlockCount * nFlashBlockSize), nFlashBlockSize, pFlashBlock))
+		{
+			// Already written by an interrupted run and still intact.
+			nJournalSkippedBlocks++;
+			continue;
+		}																	//MOD029 ^
+		if(nFlags & CG_BFFLAG_REGION)										//MOD028 v
+		{
+			// Only update blocks of the selected flash regions. Keep the
+			// contents of other regions that share a block with them.
+			nBlockRegions = CgIfdGetRegionMask(&ifdRegion, (nBlockCount * nFlashBlockSize), nFlashBlockSize);
+			if(!(nBlockRegions & nBfRegionMask))
+			{
+				nRegionSkippedBlocks++;
+				continue;
+			}
+			if((nBlockRegions & (~nBfRegionMask)) &&
+			   (CgBfMergeRegionBlock(&ifdRegion, nBfRegionMask, (nBlockCount * nFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nFlashBlockSize)), nFlashBlockSize, pFlashBlock) != CG_BFRET_OK))
+			{
+				BiosFlashReportState(1, "FAILED!");
+				CgBfSnapshotFree();												//MOD042
+				CgBfUnmapRomfile(pBuffer, nRomfileSize);
+				CgBfJournalClose(FALSE);										//MOD029
+				CgBfDigestClose(FALSE);										//MOD039
+				free(pFlashBlock);
+				return CG_BFRET_INTRF_ERROR;
+			}
+		}																	//MOD028 ^
+		if((nFlags & CG_BFFLAG_SBL) &&										//MOD037 v
+		   CgSblIsBlockUnchanged(&sblInfo, (nBlockCount * nFlashBlockSize), nFlashBlockSize))
+		{
+			// Only holds Slim Bootloader components that are up to date.
+			nSblSkippedBlocks++;
+			continue;
+		}																	//MOD037 ^
+		if(nFlags & CG_BFFLAG_DIFF)												//MOD021 v MOD023
+		{
+			// Differential update: skip erase and write if the flash block 
+			// already holds the new contents. Skip only the erase if the new
+			// contents can be programmed on top of the current ones.			//MOD022
+			nTmStart = CgTmTimeStamp();											//MOD035
+			bReadOk = CgBfStorageRead(ulStorageSelector, (nBlockCount * nFlashBlockSize), pFlashBlock, nFlashBlockSize);	//MOD031 //MOD044
+			if(bReadOk)															//MOD044
+			{
+				nBlockState = CgBfCheckBlock(pFlashBlock, pBuffer + bufferOffset + (nBlockCount * nFlashBlockSize), nFlashBlockSize);	//MOD022
+			}
+			CgTmBlock(CG_TM_PHASE_COMPARE, (nBlockCount * nFlashBlockSize), nFlashBlockSize, nTmStart, 0, bReadOk);	//MOD035 //MOD044
+			if(nBlockState == CG_BFBLK_EQUAL)									//MOD022
+			{
+				nSkippedBlocks++;
+				continue;
+			}
+			if(nBlockState == CG_BFBLK_PROGRAM)									//MOD022
+			{
+				nEraseSkippedBlocks++;
+			}
+		}																		//MOD021 ^
         
 		// Standard block processing         
         for(nRetryCount=0; nRetryCount <= MAX_FLASH_RETRIES; nRetryCount++)     
         {            
 			SPRINTF(&strBlockInfo[0],"Update flash block %d of %d", nBlockCount + 1, (nLocalFlashSize /nFlashBlockSize ) );
+			CgBfSnapshotInvalidate(ulStorageSelector, (nBlockCount * nFlashBlockSize), nFlashBlockSize);	//MOD032
 			BiosFlashReportState(2, &strBlockInfo[0]);
-            if(!CgosStorageAreaErase(hCgos, ulStorageSelector, (nBlockCount * nFlashBlockSize), nFlashBlockSize))
+			nTmStart = CgTmTimeStamp();											//MOD035
+            if((nBlockState == CG_BFBLK_ERASE) &&										//MOD022
+               ((!CgStoreErase(ulStorageSelector, (nBlockCount * nFlashBlockSize), nFlashBlockSize)) ||	//MOD038
+                (CgBfWaitEraseDone(ulStorageSelector, (nBlockCount * nFlashBlockSize), nFlashBlockSize) != CG_BFRET_OK)))	//MOD030
             {
+                CgTmBlock(CG_TM_PHASE_ERASE, (nBlockCount * nFlashBlockSize), nFlashBlockSize, nTmStart, nRetryCount, FALSE);	//MOD035
                 if(nRetryCount >= MAX_FLASH_RETRIES)
                 {
                     BiosFlashReportState(1, "FAILED!");
-                    free(pBuffer);
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
+                    CgBfJournalClose(FALSE);										//MOD029
+                    CgBfDigestClose(FALSE);										//MOD039
+                    free(pFlashBlock);											//MOD021
                     return CG_BFRET_INTRF_ERROR;
                 }
 				BiosFlashReportState(1, "RETRY!");
 				BiosFlashReportState(0, " ");   //Placeholder for next string
-				break;
+				continue;	//MOD023: Really retry. There is no later full verification pass anymore.
             }
+			if(nBlockState == CG_BFBLK_ERASE)									//MOD035 v
+			{
+				CgTmBlock(CG_TM_PHASE_ERASE, (nBlockCount * nFlashBlockSize), nFlashBlockSize, nTmStart, nRetryCount, TRUE);
+			}
+			nTmStart = CgTmTimeStamp();											//MOD035 ^
 
-			Sleep(20L);	//Add a little bit of extra security in case the BIOS erase routines don't. MOD004
-
-            if(!CgosStorageAreaWrite(hCgos, ulStorageSelector, (nBlockCount * nFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nFlashBlockSize)), nFlashBlockSize))	//MOD003
+            if(!CgStoreWrite(ulStorageSelector, (nBlockCount * nFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nFlashBlockSize)), nFlashBlockSize))	//MOD003 //MOD038
             {
+                CgTmBlock(CG_TM_PHASE_PROGRAM, (nBlockCount * nFlashBlockSize), nFlashBlockSize, nTmStart, nRetryCount, FALSE);	//MOD035
                 if(nRetryCount >= MAX_FLASH_RETRIES)
                 {
                     BiosFlashReportState(1, "FAILED!");
-                    free(pBuffer);
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
+                    CgBfJournalClose(FALSE);										//MOD029
+                    CgBfDigestClose(FALSE);										//MOD039
+                    free(pFlashBlock);											//MOD021
                     return CG_BFRET_INTRF_ERROR;
                 }
 				BiosFlashReportState(1, "RETRY!");
 				BiosFlashReportState(0, " ");   //Placeholder for next string
+				if(nBlockState == CG_BFBLK_PROGRAM)										//MOD022 v
+				{
+					// Program without erase failed. Retry with erase.
+					nBlockState = CG_BFBLK_ERASE;
+					nEraseSkippedBlocks--;
+				}																	//MOD022 ^
             }
             else
             {
-                break;
-            }
-        }
-    }
-
-	// GWETODO v
-	// As long as readback of the extended flash area is so extremely slow we only check 
-	// the BIOS content !
-	nLocalFlashSize = nFlashSize;
-	ulStorageSelector = CG32_STORAGE_MPFA_ALL;
-	bufferOffset = nRomfileSize - nLocalFlashSize;
-	// GWETODO  ^
-
-    BiosFlashReportState(0, "Verify BIOS update . . . . . ");
-    // Now verify that the update was o.k.
-    retVal = CG_BFRET_OK;
-    pCheckBuffer = (unsigned char*)malloc(nRomfileSize);
-    if(pCheckBuffer != NULL)
-    {
-        nTransfered = 0;
-        do
-        {
-            if(!CgosStorageAreaRead(hCgos, ulStorageSelector, nTransfered, pCheckBuffer + nTransfered, nFlashBlockSize))
-            {
-                retVal = CG_BFRET_INTRF_ERROR;
-				break;
-            }
-            nTransfered = nTransfered + nFlashBlockSize;
-        }while(nTransfered < nLocalFlashSize);
-
-        if(retVal == CG_BFRET_OK)
-        {
-			nCheckLength = nLocalFlashSize / 4;	//MOD011: Always check whole file.
-												//       Removed special 'bootblock' handling.
-			for(nCount = 0; nCount < nCheckLength; nCount++)
-            {
-                if( *(((UINT32*)pBuffer)+ (bufferOffset/4) + nCount) != *(((UINT32*)pCheckBuffer)+ nCount))
+				// Verify the block right away and only repeat this block on error.	//MOD023 v
+				CgTmBlock(CG_TM_PHASE_PROGRAM, (nBlockCount * nFlashBlockSize), nFlashBlockSize, nTmStart, nRetryCount, TRUE);	//MOD035
+				nTmStart = CgTmTimeStamp();										//MOD035
+				nVerifyRet = CgBfVerifyBlock(ulStorageSelector, (nBlockCount * nFlashBlockSize), (pBuffer + bufferOffset + (nBlockCount * nFlashBlockSize)), nFlashBlockSize, pFlashBlock, nFlags);	//MOD048
+				CgTmBlock(CG_TM_PHASE_VERIFY, (nBlockCount * nFlashBlockSize), nFlashBlockSize, nTmStart, nRetryCount, (nVerifyRet == CG_BFRET_OK));	//MOD035
+				if(nVerifyRet == CG_BFRET_OK)
+				{
+					CgBfJournalSetBlock(nBlockCount, (pBuffer + bufferOffset + (nBlockCount * nFlashBlockSize)), nFlashBlockSize);	//MOD029
+					break;
+				}
+                if(nRetryCount >= MAX_FLASH_RETRIES)
                 {
-                    retVal = CG_BFRET_ERROR;
-                    break;
+                    BiosFlashReportState(1, "VERIFY FAILED!");
+                    CgBfSnapshotFree();											//MOD042
+                    CgBfUnmapRomfile(pBuffer, nRomfileSize);
+                    CgBfJournalClose(FALSE);										//MOD029
+                    CgBfDigestClose(FALSE);										//MOD039
+                    free(pFlashBlock);
+                    return nVerifyRet;
                 }
+				BiosFlashReportState(1, "RETRY!");
+				BiosFlashReportState(0, " ");   //Placeholder for next string
+				if(nBlockState == CG_BFBLK_PROGRAM)
+				{
+					// Program without erase did not result in the expected contents. Retry with erase.
+					nBlockState = CG_BFBLK_ERASE;
+					nEraseSkippedBlocks--;
+				}																	//MOD023 ^
             }
         }
     }
-    else
-    {
-        retVal = CG_BFRET_ERROR; 
-    }
 
-    free(pCheckBuffer);
-    free(pBuffer); 
+	CgBfJournalClose(TRUE);											//MOD029
+	// Blocks outside of the selected regions and the restored preserved data	//MOD039 v
+	// may differ from the image, don't cache the image digests then.
+	CgBfDigestClose(!(nFlags & (CG_BFFLAG_REGION | CG_BFFLAG_PRESERVE)));	//MOD039 ^
+	CgBfSnapshotFree();												//MOD032
+	free(pFlashBlock);															//MOD021 v
+	if(nFlags & CG_BFFLAG_DIFF)
+	{
+		SPRINTF(&strBlockInfo[0],"%d of %d flash blocks unchanged and skipped.", nSkippedBlocks, (nLocalFlashSize /nFlashBlockSize ) );
+		BiosFlashReportState(0, &strBlockInfo[0]);
+		SPRINTF(&strBlockInfo[0],"%d of %d flash blocks programmed without erase.", nEraseSkippedBlocks, (nLocalFlashSize /nFlashBlockSize ) );	//MOD022
+		BiosFlashReportState(0, &strBlockInfo[0]);								//MOD022
+	}																			//MOD021 ^
+	if(nFlags & CG_BFFLAG_REGION)												//MOD028 v
+	{
+		SPRINTF(&strBlockInfo[0],"%d of %d flash blocks outside of selected regions.", nRegionSkippedBlocks, (nLocalFlashSize /nFlashBlockSize ) );
+		BiosFlashReportState(0, &strBlockInfo[0]);
+	}																			//MOD028 ^
+	if(nFlags & CG_BFFLAG_SBL)													//MOD037 v
+	{
+		SPRINTF(&strBlockInfo[0],"%d of %d flash blocks hold unchanged SBL components.", nSblSkippedBlocks, (nLocalFlashSize /nFlashBlockSize ) );
+		BiosFlashReportState(0, &strBlockInfo[0]);
+	}																			//MOD037 ^
+	if(nFlags & CG_BFFLAG_JOURNAL)												//MOD029 v
+	{
+		SPRINTF(&strBlockInfo[0],"%d of %d flash blocks already done according to journal.", nJournalSkippedBlocks, (nLocalFlashSize /nFlashBlockSize ) );
+		BiosFlashReportState(0, &strBlockInfo[0]);
+	}																			//MOD029 ^
 
-    if(retVal != CG_BFRET_OK)
-    {
-        BiosFlashReportState(1, "FAILED!");
-        return retVal;
-    }
+    CgBfUnmapRomfile(pBuffer, nRomfileSize); 
+
+    BiosFlashReportState(0, "Verify BIOS update . . . . . ");
+	// MOD023: Each block has already been verified right after it has been written.
     BiosFlashReportState(1, "DONE!");
 
 	}// end of Check BIOS supports 512KB update									//MOD014
@@ -2340,27 +2852,27 @@ UINT16 CgBfGetBiosInfoFlash(void)
     UINT32 nFlashSize, nIndex;
    
     // Get flash size 
-    if((nFlashSize = CgosStorageAreaSize(hCgos, CG32_STORAGE_MPFA_ALL)) < 1)
+    if((nFlashSize = CgStoreSize(CG32_STORAGE_MPFA_ALL)) < 1)	//MOD038
     {
         return CG_MPFARET_ERROR; 
     }
     nIndex = 0;
     while(nIndex < nFlashSize)
     {
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash.infoIDLow, sizeof(CgBiosInfoFlash.infoIDLow)))
+        if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash.infoIDLow, sizeof(CgBiosInfoFlash.infoIDLow)))	//MOD038
         {
             return CG_MPFARET_ERROR;
         }
         else if(CgBiosInfoFlash.infoIDLow == CG_SYS_BIOS_INFO_ID_L)
         {
-            if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgBiosInfoFlash.infoIDLow), (unsigned char*)&CgBiosInfoFlash.infoIDHigh, sizeof(CgBiosInfoFlash.infoIDHigh)))
+            if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgBiosInfoFlash.infoIDLow), (unsigned char*)&CgBiosInfoFlash.infoIDHigh, sizeof(CgBiosInfoFlash.infoIDHigh)))	//MOD038
             {
                 return CG_MPFARET_ERROR;
             }
             else if(CgBiosInfoFlash.infoIDHigh == CG_SYS_BIOS_INFO_ID_H)
             {
                 // BIOS info structure found, now copy whole structure
-                if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash, sizeof(CgBiosInfoFlash)))
+                if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash, sizeof(CgBiosInfoFlash)))	//MOD038
                 {
                     return CG_MPFARET_ERROR;
                 }
@@ -2383,20 +2895,20 @@ UINT16 CgBfGetBiosInfoFlash(void)
         nIndex = 0;
         while(nIndex < nFlashSize)
         {
-            if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash.infoIDLow, sizeof(CgBiosInfoFlash.infoIDLow)))
+            if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash.infoIDLow, sizeof(CgBiosInfoFlash.infoIDLow)))	//MOD038
             {
                 return CG_MPFARET_ERROR;
             }
             else if(CgBiosInfoFlash.infoIDLow == CG_SYS_BIOS_INFO_ID_L)
             {
-                if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgBiosInfoFlash.infoIDLow), (unsigned char*)&CgBiosInfoFlash.infoIDHigh, sizeof(CgBiosInfoFlash.infoIDHigh)))
+                if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgBiosInfoFlash.infoIDLow), (unsigned char*)&CgBiosInfoFlash.infoIDHigh, sizeof(CgBiosInfoFlash.infoIDHigh)))	//MOD038
                 {
                     return CG_MPFARET_ERROR;
                 }
                 else if(CgBiosInfoFlash.infoIDHigh == CG_SYS_BIOS_INFO_ID_H)
                 {
                     // BIOS info structure found, now copy whole structure
-                    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash, sizeof(CgBiosInfoFlash)))
+                    if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgBiosInfoFlash, sizeof(CgBiosInfoFlash)))	//MOD038
                     {
                         return CG_MPFARET_ERROR;
                     }
@@ -2522,19 +3034,24 @@ UINT16 CgBfGetFlashSize
         return CG_BFRET_INTRF_ERROR;
     }
 
-    *pFlashSize = CgosStorageAreaSize(hCgos, CG32_STORAGE_MPFA_ALL); 
+    *pFlashSize = CgStoreSize(CG32_STORAGE_MPFA_ALL);	//MOD038
     //GWETODO: FIX after CGOS driver is fixed to return correct blocksize pFlashBlockSize = (CgosStorageAreaBlockSize(hCgos, pCG32_STORAGE_MPFA_ALL))*1024; 
     *pFlashBlockSize = 64 * 1024;//GWETODO
+    if(!CgStoreIsCgos() && (CgStoreBlockSize(CG32_STORAGE_MPFA_ALL) > *pFlashBlockSize))	//MOD045 v
+    {
+        // Other backends can only erase complete erase blocks of the flash part
+        *pFlashBlockSize = CgStoreBlockSize(CG32_STORAGE_MPFA_ALL);
+    }																			//MOD045 ^
 																				//MOD003 v
 	// Try to get extended flash size (e.g. full SPI flash size) as well
-	if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_EXTD, 0, &dummy, 1))
+	if(!CgStoreRead(CG32_STORAGE_MPFA_EXTD, 0, &dummy, 1))	//MOD038
 	{
 		// If we cannot read from extended flash area, we assume that there is no such area !
 		*pExtdFlashSize = 0;
 	}
 	else
 	{
-		*pExtdFlashSize = CgosStorageAreaSize(hCgos, CG32_STORAGE_MPFA_EXTD);
+		*pExtdFlashSize = CgStoreSize(CG32_STORAGE_MPFA_EXTD);	//MOD038
 		// If the extended flash area has the same size as the standard BIOS (MPFA_ALL) area,
 		// there is in fact no special extended area !
 		if(*pExtdFlashSize == *pFlashSize)
@@ -2586,3 +3103,1172 @@ UINT16 CgBfGetFileSize
     return CG_BFRET_ERROR_FILE;
 }
 
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfCheckBlock     
+ * Desc: Compares the current contents of a flash block with the new 
+ *       contents and determines what is required to update the block.
+ *       A block can be programmed without erase if no bit has to change 
+ *       from 0 to 1.
+ * Inp:  pFlashData - Pointer to current flash block contents.
+ *       pNewData   - Pointer to new flash block contents.
+ *       nSize      - Block size in bytes (DWORD aligned).
+ * Outp: block state:
+ *       CG_BFBLK_EQUAL         - Block contents match, no update required
+ *       CG_BFBLK_PROGRAM       - Block can be programmed without erase
+ *       CG_BFBLK_ERASE         - Block has to be erased and programmed
+ *
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgBfCheckBlock															//MOD022
+(
+    unsigned char *pFlashData,
+    unsigned char *pNewData,
+    UINT32 nSize
+)
+{
+    UINT32 nCount;
+    UINT32 nSetBits = 0;														//MOD040
+
+    // Most blocks are unchanged. memcmp of the runtime library is vectorized.	//MOD040 v
+    if(memcmp(pFlashData, pNewData, nSize) == 0)
+    {
+        return CG_BFBLK_EQUAL;
+    }
+    // Collect the bits that have to change from 0 to 1. The loop has no
+    // branches, so the compiler can vectorize it.
+    for(nCount = 0; nCount < nSize / 4; nCount++)
+    {
+        nSetBits = nSetBits | (*(((UINT32*)pNewData) + nCount) & ~(*(((UINT32*)pFlashData) + nCount)));
+    }
+    return (nSetBits != 0) ? CG_BFBLK_ERASE : CG_BFBLK_PROGRAM;				//MOD040 ^
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfVerifyBlock     
+ * Desc: Reads back a flash block that has just been written and compares
+ *       it with the expected contents.
+ *       As long as readback of the extended flash area is so extremely slow,
+ *       only the BIOS content part of the extended area is checked. It is
+ *       read back through the standard (MPFA_ALL) area. (GWETODO)
+ *       A region update (CG_BFFLAG_REGION) only writes the blocks of the
+ *       selected regions, so these are read back through the extended area.
+ * Inp:  ulStorageSelector  - Storage area the block has been written to.
+ *       nOffset            - Offset of the block within the storage area.
+ *       pData              - Pointer to expected block contents.
+ *       nSize              - Block size in bytes.
+ *       pScratch           - Pointer to buffer for nSize bytes of read data.
+ *       nFlags             - BIOS flash flags of the update.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success, block contents match
+ *       CG_BFRET_INTRF_ERROR   - Failed to read back block
+ *       CG_BFRET_ERROR         - Block contents do not match
+ *
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfVerifyBlock															//MOD023
+(
+    UINT32 ulStorageSelector,
+    UINT32 nOffset,
+    unsigned char *pData,
+    UINT32 nSize,
+    unsigned char *pScratch,
+    UINT32 nFlags																//MOD048
+)
+{
+    UINT32 nBiosBase;
+
+	// GWETODO v
+    if((ulStorageSelector == CG32_STORAGE_MPFA_EXTD) && !(nFlags & CG_BFFLAG_REGION))	//MOD048
+    {
+        // The BIOS content is located at the end of the extended area.
+        nBiosBase = (nExtdFlashSize > nFlashSize) ? (nExtdFlashSize - nFlashSize) : 0;
+        if((nOffset + nSize) <= nBiosBase)
+        {
+            // Block does not contain BIOS content. Not checked.
+            return CG_BFRET_OK;
+        }
+        if(nOffset < nBiosBase)
+        {
+            // Only check the BIOS content part of the block.
+            pData = pData + (nBiosBase - nOffset);
+            nSize = nSize - (nBiosBase - nOffset);
+            nOffset = nBiosBase;
+        }
+        nOffset = nOffset - nBiosBase;
+        ulStorageSelector = CG32_STORAGE_MPFA_ALL;
+    }
+	// GWETODO ^
+
+    if(!CgBfStorageRead(ulStorageSelector, nOffset, pScratch, nSize))	//MOD031
+    {
+        return CG_BFRET_INTRF_ERROR;
+    }
+    if(memcmp(pScratch, pData, nSize) != 0)
+    {
+        return CG_BFRET_ERROR;
+    }
+    return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfMapRomfile     
+ * Desc: Provides the contents of a BIOS file in memory.
+ *       For LINUX the file is mapped privately, so pages are only loaded when
+ *       accessed and only pages that are patched (e.g. MAC address recovery)
+ *       occupy additional memory. Otherwise, or if mapping is not possible,
+ *       the file is read to an allocated buffer.
+ *       Release the contents with CgBfUnmapRomfile.
+ * Inp:  fpBiosRomfile  - BIOS file handle.
+ *       nRomfileSize   - Size of BIOS file.
+ *       ppBuffer       - Pointer to storage for the BIOS file contents pointer.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR_FILE    - File processing error
+ *       CG_BFRET_ERROR         - Failed to allocate buffer
+ *
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfMapRomfile															//MOD025
+(
+    FILE *fpBiosRomfile,
+    UINT32 nRomfileSize,
+    unsigned char **ppBuffer
+)
+{
+    unsigned char *pBuffer;
+
+#ifdef LINUX
+    pBuffer = (unsigned char*)mmap(NULL, nRomfileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fpBiosRomfile), 0);
+    if(pBuffer != (unsigned char*)MAP_FAILED)
+    {
+        bRomfileMapped = 1;
+        *ppBuffer = pBuffer;
+        return CG_BFRET_OK;
+    }
+#endif
+    bRomfileMapped = 0;
+
+    // Allocate buffer for BIOS file    
+    pBuffer = (unsigned char*)malloc(nRomfileSize);
+    if(!pBuffer)
+    {
+        return CG_BFRET_ERROR;
+    }
+
+    // Read contents of BIOS file to buffer
+    fseek(fpBiosRomfile,0, SEEK_SET);
+    fread(pBuffer, nRomfileSize, 1, fpBiosRomfile );
+    if( ferror( fpBiosRomfile ) )      
+    {
+        free(pBuffer);
+        return CG_BFRET_ERROR_FILE;
+    }
+    *ppBuffer = pBuffer;
+    return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfUnmapRomfile     
+ * Desc: Releases BIOS file contents provided by CgBfMapRomfile.
+ * Inp:  pBuffer        - Pointer to BIOS file contents.
+ *       nRomfileSize   - Size of BIOS file.
+ * Outp: None
+ *
+ *---------------------------------------------------------------------------
+ */
+void CgBfUnmapRomfile															//MOD025
+(
+    unsigned char *pBuffer,
+    UINT32 nRomfileSize
+)
+{
+#ifdef LINUX
+    if(bRomfileMapped)
+    {
+        munmap(pBuffer, nRomfileSize);
+        bRomfileMapped = 0;
+        return;
+    }
+#endif
+    free(pBuffer);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfFindPattern     
+ * Desc: Searches a memory buffer for the first occurrence of a pattern.
+ *       Only offsets that are a multiple of nAlign are checked.
+ * Inp:  pData          - Pointer to data to be searched.
+ *       nDataSize      - Size of data in bytes.
+ *       pPattern       - Pointer to pattern (at least 4 bytes).
+ *       nPatternSize   - Size of pattern in bytes.
+ *       nAlign         - Search step in bytes (multiple of 4).
+ *       pOffset        - Pointer to storage for the pattern offset.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success, pattern found
+ *       CG_BFRET_ERROR         - Pattern not found
+ *
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfFindPattern															//MOD026
+(
+    unsigned char *pData,
+    UINT32 nDataSize,
+    unsigned char *pPattern,
+    UINT32 nPatternSize,
+    UINT32 nAlign,
+    UINT32 *pOffset
+)
+{
+    UINT32 nIndex, nFirst;
+
+    if(nDataSize < nPatternSize)
+    {
+        return CG_BFRET_ERROR;
+    }
+    nFirst = *((UINT32*)pPattern);
+    for(nIndex = 0; nIndex <= (nDataSize - nPatternSize); nIndex = nIndex + nAlign)
+    {
+        // Check the first DWORD before comparing the whole pattern.
+        if((*((UINT32*)(pData + nIndex)) == nFirst) && 
+           (memcmp(pData + nIndex, pPattern, nPatternSize) == 0))
+        {
+            *pOffset = nIndex;
+            return CG_BFRET_OK;
+        }
+    }
+    return CG_BFRET_ERROR;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfFindPatternFlash     
+ * Desc: Searches a storage area for the first occurrence of a pattern.
+ *       The area is read in chunks of CG_BF_SCAN_CHUNK_SIZE bytes. Each read 
+ *       overlaps the next chunk so that a pattern spanning a chunk boundary
+ *       is found as well. The search stops as soon as the pattern is found.
+ * Inp:  ulStorageSelector  - Storage area to be searched.
+ *       nAreaSize          - Size of storage area in bytes.
+ *       pPattern           - Pointer to pattern (at least 4 bytes).
+ *       nPatternSize       - Size of pattern in bytes.
+ *       nAlign             - Search step in bytes (multiple of 4).
+ *       pOffset            - Pointer to storage for the pattern offset.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success, pattern found
+ *       CG_BFRET_ERROR         - Pattern not found or general processing error
+ *       CG_BFRET_INTRF_ERROR   - Failed to read storage area
+ *
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfFindPatternFlash														//MOD026
+(
+    UINT32 ulStorageSelector,
+    UINT32 nAreaSize,
+    unsigned char *pPattern,
+    UINT32 nPatternSize,
+    UINT32 nAlign,
+    UINT32 *pOffset
+)
+{
+    unsigned char *pChunk;
+    UINT32 nChunkBase, nReadSize, nFoundOffset;
+    UINT16 retVal = CG_BFRET_ERROR;
+
+    pChunk = (unsigned char*)malloc(CG_BF_SCAN_CHUNK_SIZE + nPatternSize);
+    if(!pChunk)
+    {
+        return CG_BFRET_ERROR;
+    }
+
+    for(nChunkBase = 0; (nChunkBase + nPatternSize) <= nAreaSize; nChunkBase = nChunkBase + CG_BF_SCAN_CHUNK_SIZE)
+    {
+        // Read the chunk plus the bytes required to match a pattern starting 
+        // at the last checked offset of this chunk.
+        nReadSize = CG_BF_SCAN_CHUNK_SIZE + nPatternSize - nAlign;
+        if(nReadSize > (nAreaSize - nChunkBase))
+        {
+            nReadSize = nAreaSize - nChunkBase;
+        }
+        if(!CgBfStorageRead(ulStorageSelector, nChunkBase, pChunk, nReadSize))	//MOD032
+        {
+            retVal = CG_BFRET_INTRF_ERROR;
+            break;
+        }
+        if(CgBfFindPattern(pChunk, nReadSize, pPattern, nPatternSize, nAlign, &nFoundOffset) == CG_BFRET_OK)
+        {
+            *pOffset = nChunkBase + nFoundOffset;
+            retVal = CG_BFRET_OK;
+            break;
+        }
+    }
+
+    free(pChunk);
+    return retVal;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfCrc32c
+ * Desc: Calculates the CRC32C (Castagnoli) checksum of a data buffer.
+ *       Pass 0 as nCrc for the first buffer and the previous result to
+ *       continue the checksum over several buffers.
+ * Inp:  nCrc           - Start value.
+ *       pData          - Pointer to data.
+ *       nSize          - Size of data in bytes.
+ * Outp: CRC32C checksum.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgBfCrc32c																//MOD029
+(
+    UINT32 nCrc,
+    unsigned char *pData,
+    UINT32 nSize
+)
+{
+    UINT32 i, j, nValue;
+
+    if(!bCrc32cTableValid)
+    {
+        for(i = 0; i < 256; i++)
+        {
+            nValue = i;
+            for(j = 0; j < 8; j++)
+            {
+                nValue = (nValue & 1) ? ((nValue >> 1) ^ 0x82F63B78) : (nValue >> 1);
+            }
+            nCrc32cTable[i] = nValue;
+        }
+        bCrc32cTableValid = 1;
+    }
+
+    nCrc = ~nCrc;
+    for(i = 0; i < nSize; i++)
+    {
+        nCrc = nCrc32cTable[(nCrc ^ pData[i]) & 0xFF] ^ (nCrc >> 8);
+    }
+    return ~nCrc;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfJournalOpen
+ * Desc: Opens the update journal of a BIOS file. An existing journal is
+ *       continued if it has been written for the same BIOS file contents,
+ *       target storage area and update block layout. Otherwise a new
+ *       journal with all blocks pending is created.
+ * Inp:  lpszBiosFile   - Pointer to name of BIOS file.
+ *       pHeader        - Pointer to journal header describing the update.
+ *       pResumed       - Pointer to storage for the number of blocks already
+ *                        done according to the journal.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR_FILE    - Failed to create journal file
+ *       CG_BFRET_ERROR         - General processing error.
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfJournalOpen															//MOD029
+(
+    _TCHAR *lpszBiosFile,
+    CG_BF_JOURNAL_HEADER *pHeader,
+    UINT32 *pResumed
+)
+{
+    CG_BF_JOURNAL_HEADER oldHeader;
+    UINT32 i;
+
+    *pResumed = 0;
+    CgBfJournalClose(FALSE);
+
+    // The journal file name must fit into the name buffer				//MOD041
+    if((strlen(lpszBiosFile) + strlen(CG_BF_JOURNAL_EXT)) >= sizeof(szJournalFile))
+    {
+        return CG_BFRET_ERROR_FILE;
+    }
+    pJournal = (CG_BF_JOURNAL_ENTRY*)malloc(pHeader->nBlockCount * sizeof(CG_BF_JOURNAL_ENTRY));
+    if(!pJournal)
+    {
+        return CG_BFRET_ERROR;
+    }
+    memset(pJournal, 0, pHeader->nBlockCount * sizeof(CG_BF_JOURNAL_ENTRY));
+    nJournalBlocks = pHeader->nBlockCount;
+    nJournalStorageSelector = pHeader->nStorageSelector;
+    SPRINTF(&szJournalFile[0], "%s%s", lpszBiosFile, CG_BF_JOURNAL_EXT);
+
+    // Try to continue an existing journal
+    fpJournal = fopen(&szJournalFile[0], "r+b");
+    if(fpJournal)
+    {
+        if((fread(&oldHeader, sizeof(oldHeader), 1, fpJournal) == 1) &&
+           (memcmp(&oldHeader, pHeader, sizeof(oldHeader)) == 0) &&
+           (fread(pJournal, sizeof(CG_BF_JOURNAL_ENTRY), nJournalBlocks, fpJournal) == nJournalBlocks))
+        {
+            for(i = 0; i < nJournalBlocks; i++)
+            {
+                if(pJournal[i].nState == CG_BF_JOURNAL_DONE)
+                {
+                    (*pResumed)++;
+                }
+            }
+            return CG_BFRET_OK;
+        }
+        // Journal of another update. Start over.
+        fclose(fpJournal);
+        memset(pJournal, 0, nJournalBlocks * sizeof(CG_BF_JOURNAL_ENTRY));
+    }
+
+    fpJournal = fopen(&szJournalFile[0], "w+b");
+    if(!fpJournal)
+    {
+        CgBfJournalClose(FALSE);
+        return CG_BFRET_ERROR_FILE;
+    }
+    if((fwrite(pHeader, sizeof(CG_BF_JOURNAL_HEADER), 1, fpJournal) != 1) ||
+       (fwrite(pJournal, sizeof(CG_BF_JOURNAL_ENTRY), nJournalBlocks, fpJournal) != nJournalBlocks) ||
+       (fflush(fpJournal) != 0))
+    {
+        CgBfJournalClose(FALSE);
+        return CG_BFRET_ERROR_FILE;
+    }
+    return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfJournalCheckBlock
+ * Desc: Checks whether a block has already been written according to the
+ *       journal and the flash block still holds the recorded contents.
+ *       Only the checksum of the flash block is compared, the block is not
+ *       rewritten.
+ * Inp:  nBlock         - Block number.
+ *       nOffset        - Offset of block in target storage area.
+ *       nSize          - Block size.
+ *       pScratch       - Buffer of nSize bytes to read the flash block to.
+ * Outp: TRUE if the block can be skipped, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgBfJournalCheckBlock													//MOD029
+(
+    UINT32 nBlock,
+    UINT32 nOffset,
+    UINT32 nSize,
+    unsigned char *pScratch
+)
+{
+    if((!fpJournal) || (nBlock >= nJournalBlocks) || (pJournal[nBlock].nState != CG_BF_JOURNAL_DONE))
+    {
+        return FALSE;
+    }
+    if(!CgBfStorageRead(nJournalStorageSelector, nOffset, pScratch, nSize))	//MOD032
+    {
+        return FALSE;
+    }
+    return (CgBfCrc32c(0, pScratch, nSize) == pJournal[nBlock].nCrc) ? TRUE : FALSE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfJournalSetBlock
+ * Desc: Records a written and verified block in the journal.
+ * Inp:  nBlock         - Block number.
+ *       pData          - Pointer to written block contents.
+ *       nSize          - Block size.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgBfJournalSetBlock														//MOD029
+(
+    UINT32 nBlock,
+    unsigned char *pData,
+    UINT32 nSize
+)
+{
+    if((!fpJournal) || (nBlock >= nJournalBlocks))
+    {
+        return;
+    }
+    pJournal[nBlock].nState = CG_BF_JOURNAL_DONE;
+    pJournal[nBlock].nCrc = CgBfCrc32c(0, pData, nSize);
+
+    // Update the entry on disk right away. A failure only costs a rewrite
+    // of this block on resume.
+    if(fseek(fpJournal, sizeof(CG_BF_JOURNAL_HEADER) + (nBlock * sizeof(CG_BF_JOURNAL_ENTRY)), SEEK_SET) == 0)
+    {
+        fwrite(&pJournal[nBlock], sizeof(CG_BF_JOURNAL_ENTRY), 1, fpJournal);
+        fflush(fpJournal);
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfJournalClose
+ * Desc: Closes the update journal. The journal file is deleted if the
+ *       update has been completed, else it is kept to resume the update.
+ * Inp:  bCompleted     - TRUE if the update has been completed.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgBfJournalClose															//MOD029
+(
+    UINT32 bCompleted
+)
+{
+    if(fpJournal)
+    {
+        fclose(fpJournal);
+        fpJournal = NULL;
+        if(bCompleted)
+        {
+            remove(&szJournalFile[0]);
+        }
+    }
+    if(pJournal)
+    {
+        free(pJournal);
+        pJournal = NULL;
+    }
+    nJournalBlocks = 0;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfGetFlashGeneration
+ * Desc: Reads the flash write generation from CG_BF_FLASHGEN_FILE.
+ * Inp:  None
+ * Outp: Flash write generation, 0 if not stored yet.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 CgBfGetFlashGeneration(void)										//MOD046
+{
+    FILE *fpGeneration;
+    UINT32 nGeneration = 0;
+
+    if((fpGeneration = fopen(CG_BF_FLASHGEN_FILE, "r")) != NULL)
+    {
+        if(fscanf(fpGeneration, "%x", &nGeneration) != 1)
+        {
+            nGeneration = 0;
+        }
+        fclose(fpGeneration);
+    }
+    return nGeneration;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfDigestInvalidate
+ * Desc: Invalidates all cached digest manifests by counting up the flash
+ *       write generation. Has to be called before the flash part is written.
+ *       The manifest of an update in progress (CgBfDigestCheck) gets the
+ *       new generation, as it describes the flash contents after the update.
+ * Inp:  None
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgBfDigestInvalidate(void)													//MOD046
+{
+    FILE *fpGeneration;
+    UINT32 nGeneration;
+
+    CgutlLock();
+    nGeneration = CgBfGetFlashGeneration() + 1;
+    if((fpGeneration = fopen(CG_BF_FLASHGEN_FILE, "w")) != NULL)
+    {
+        fprintf(fpGeneration, "%X\n", nGeneration);
+        fclose(fpGeneration);
+    }
+    CgutlUnlock();
+    if(pBfDigest)
+    {
+        bfDigestHeader.nGeneration = nGeneration;
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfDigestCheck
+ * Desc: Checks whether the flash part already holds the update image.
+ *       The CRC32C digests of the image blocks are compared with the
+ *       digests of the flash blocks read from the flash part. The read stops
+ *       at the first differing block.
+ *       The manifest cached next to the journal is only used as a hint: if it
+ *       has been written for this board during the current boot and the
+ *       flash write generation is unchanged (see CgBfDigestInvalidate), the
+ *       first block it reports as different is read first. The flash part is
+ *       always read completely before reporting it up to date, as other
+ *       tools, hosts or the firmware may have written it meanwhile.
+ *       The image digests are kept for CgBfDigestClose. The cached manifest
+ *       is removed if the update has to be performed.
+ * Inp:  lpszBiosFile       - BIOS file name, base of the manifest name.
+ *       ulStorageSelector  - Target storage area.
+ *       pImage             - Pointer to final update image.
+ *       nSize              - Size of update image (storage area size).
+ *       pScratch           - Buffer of nFlashBlockSize bytes.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Update required
+ *       CG_BFRET_UPTODATE      - Flash part already holds the image
+ *       CG_BFRET_ERROR         - Out of memory
+ *       CG_BFRET_INTRF_ERROR   - Failed to read flash part
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfDigestCheck															//MOD039
+(
+    _TCHAR *lpszBiosFile,
+    UINT32 ulStorageSelector,
+    unsigned char *pImage,
+    UINT32 nSize,
+    unsigned char *pScratch
+)
+{
+    CGOSBOARDINFO boardInfo;
+    CG_BF_DIGEST_HEADER cachedHeader;
+    UINT32 *pFlashDigest;
+    FILE *fpDigest;
+    UINT32 i, j, nBootCounter = 0;
+    UINT32 nFirstBlock = 0;														//MOD047
+    UINT16 bCached = FALSE;
+    INT32 nNameSize;															//MOD047
+
+    CgBfDigestClose(FALSE);
+    if((nSize == 0) || (nSize % nFlashBlockSize))
+    {
+        return CG_BFRET_OK;
+    }
+    memset(&bfDigestHeader, 0, sizeof(bfDigestHeader));
+    bfDigestHeader.nSignature = CG_BF_DIGEST_SIGNATURE;
+    bfDigestHeader.nVersion = CG_BF_DIGEST_VERSION;
+    bfDigestHeader.nStorageSelector = ulStorageSelector;
+    bfDigestHeader.nAreaSize = nSize;
+    bfDigestHeader.nBlockSize = nFlashBlockSize;
+    bfDigestHeader.nBlockCount = nSize / nFlashBlockSize;
+
+    // Without serial number or boot counter the digests can't be cached
+    memset(&boardInfo, 0, sizeof(boardInfo));
+    boardInfo.dwSize = sizeof(boardInfo);
+    if(CgosBoardGetInfo(hCgos, &boardInfo) && (boardInfo.szSerialNumber[0] != 0) &&
+       CgosBoardGetBootCounter(hCgos, &nBootCounter))
+    {
+        // The header is zeroed, the last character remains the terminator	//MOD047
+        memcpy(&bfDigestHeader.szSerialNumber[0], &boardInfo.szSerialNumber[0], sizeof(bfDigestHeader.szSerialNumber) - 1);
+        bfDigestHeader.nBootCounter = nBootCounter;
+        bfDigestHeader.nGeneration = CgBfGetFlashGeneration();					//MOD046
+        // Not cached if the manifest name does not fit							//MOD046 v //MOD047 v
+        nNameSize = SNPRINTF(&szBfDigestFile[0], sizeof(szBfDigestFile), "%s.%s%s",
+                             lpszBiosFile, &bfDigestHeader.szSerialNumber[0], CG_BF_DIGEST_EXT);
+        if((nNameSize < 0) || (nNameSize >= (INT32)sizeof(szBfDigestFile)))
+        {
+            szBfDigestFile[0] = 0;
+        }																		//MOD046 ^ //MOD047 ^
+    }
+
+    pBfDigest = (UINT32*)malloc(bfDigestHeader.nBlockCount * sizeof(UINT32));
+    pFlashDigest = (UINT32*)malloc(bfDigestHeader.nBlockCount * sizeof(UINT32));
+    if((!pBfDigest) || (!pFlashDigest))
+    {
+        free(pFlashDigest);
+        CgBfDigestClose(FALSE);
+        return CG_BFRET_ERROR;
+    }
+    for(i = 0; i < bfDigestHeader.nBlockCount; i++)
+    {
+        pBfDigest[i] = CgBfCrc32c(0, pImage + (i * nFlashBlockSize), nFlashBlockSize);
+    }
+
+    if(szBfDigestFile[0] && ((fpDigest = fopen(&szBfDigestFile[0], "rb")) != NULL))
+    {
+        bCached = (fread(&cachedHeader, sizeof(cachedHeader), 1, fpDigest) == 1) &&
+                  (memcmp(&cachedHeader, &bfDigestHeader, sizeof(cachedHeader)) == 0) &&
+                  (fread(pFlashDigest, sizeof(UINT32), bfDigestHeader.nBlockCount, fpDigest) == bfDigestHeader.nBlockCount);
+        fclose(fpDigest);
+    }
+    // Start with the first block the manifest reports as different			//MOD047 v
+    for(i = 0; bCached && (i < bfDigestHeader.nBlockCount); i++)
+    {
+        if(pFlashDigest[i] != pBfDigest[i])
+        {
+            nFirstBlock = i;
+            break;
+        }
+    }
+    free(pFlashDigest);
+
+    for(j = 0; j < bfDigestHeader.nBlockCount; j++)
+    {
+        i = (nFirstBlock + j) % bfDigestHeader.nBlockCount;
+        if(!CgBfStorageRead(ulStorageSelector, i * nFlashBlockSize, pScratch, nFlashBlockSize))
+        {
+            CgBfDigestClose(FALSE);
+            return CG_BFRET_INTRF_ERROR;
+        }
+        if(CgBfCrc32c(0, pScratch, nFlashBlockSize) != pBfDigest[i])
+        {
+            // The flash part is going to change. Drop the manifest until the
+            // update has been completed.
+            if(szBfDigestFile[0])
+            {
+                remove(&szBfDigestFile[0]);
+            }
+            return CG_BFRET_OK;
+        }
+    }
+
+    // Cache the digests just confirmed
+    CgBfDigestClose(TRUE);
+    return CG_BFRET_UPTODATE;													//MOD047 ^
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfDigestClose
+ * Desc: Releases the image digests of CgBfDigestCheck. If the update has
+ *       been completed, the flash part holds the image and its digests are
+ *       written to the manifest.
+ * Inp:  bCompleted     - TRUE if the flash part holds the update image.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgBfDigestClose															//MOD039
+(
+    UINT32 bCompleted
+)
+{
+    FILE *fpDigest;
+
+    if(bCompleted && pBfDigest && szBfDigestFile[0])
+    {
+        // The manifest is just a cache. On failure the flash is read next time.
+        if((fpDigest = fopen(&szBfDigestFile[0], "wb")) != NULL)
+        {
+            if((fwrite(&bfDigestHeader, sizeof(bfDigestHeader), 1, fpDigest) != 1) ||
+               (fwrite(pBfDigest, sizeof(UINT32), bfDigestHeader.nBlockCount, fpDigest) != bfDigestHeader.nBlockCount))
+            {
+                fclose(fpDigest);
+                remove(&szBfDigestFile[0]);
+            }
+            else
+            {
+                fclose(fpDigest);
+            }
+        }
+    }
+    if(pBfDigest)
+    {
+        free(pBfDigest);
+        pBfDigest = NULL;
+    }
+    szBfDigestFile[0] = 0;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfWaitEraseDone
+ * Desc: Waits until a storage area erase has completed. The erase status is
+ *       polled instead of waiting a fixed time. If the interface does not
+ *       support the erase status query, the former fixed delay is used.
+ * Inp:  ulStorageSelector  - Storage area that has been erased.
+ *       nOffset            - Offset of erased range.
+ *       nSize              - Size of erased range.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Erase completed
+ *       CG_BFRET_ERROR         - Erase failed or timed out
+ *       CG_BFRET_INTRF_ERROR   - Failed to query erase status
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfWaitEraseDone														//MOD030
+(
+    UINT32 ulStorageSelector,
+    UINT32 nOffset,
+    UINT32 nSize
+)
+{
+    UINT32 nStatus, nStart;
+    UINT16 bFirstPoll = TRUE;													//MOD049
+
+    // Sleep(1) may last a whole timer tick (e.g. 15ms on WIN32), so the	//MOD049
+    // timeout is based on the elapsed time, not on the number of polls.
+    nStart = CgutlGetTickCount();												//MOD049
+    for(;;)																		//MOD049
+    {
+        if(!CgStoreEraseStatus(ulStorageSelector, nOffset, nSize, &nStatus))	//MOD038
+        {
+            if(bFirstPoll)														//MOD049
+            {
+                // Erase status not supported. Add a little bit of extra security
+                // in case the BIOS erase routines don't.
+                Sleep(20L);
+                return CG_BFRET_OK;
+            }
+            return CG_BFRET_INTRF_ERROR;
+        }
+        if(nStatus == CG_BF_ERASE_STATUS_DONE)
+        {
+            return CG_BFRET_OK;
+        }
+        if(nStatus != CG_BF_ERASE_STATUS_BUSY)
+        {
+            return CG_BFRET_ERROR;
+        }
+        if((CgutlGetTickCount() - nStart) > CG_BF_ERASE_TIMEOUT)				//MOD049 v
+        {
+            return CG_BFRET_ERROR;
+        }
+        bFirstPoll = FALSE;														//MOD049 ^
+        Sleep(1L);
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfGetBoardName
+ * Desc: Returns the board name used to store the tuned read size.
+ * Inp:  lpszBoard      - Pointer to storage for board name
+ *                        (CGOS_BOARD_MAX_SIZE_ID_STRING bytes).
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_INTRF_ERROR   - Failed to access CGOS interface
+ *---------------------------------------------------------------------------
+ */
+static UINT16 CgBfGetBoardName(char *lpszBoard)								//MOD031
+{
+    CGOSBOARDINFOA boardInfo;
+    UINT32 i;
+
+    boardInfo.dwSize = sizeof(boardInfo);
+    if(!hCgos || !CgosBoardGetInfoA(hCgos, &boardInfo))
+    {
+        return CG_BFRET_INTRF_ERROR;
+    }
+    // The name is used as single word in the read size file
+    for(i = 0; (i < (CGOS_BOARD_MAX_SIZE_ID_STRING - 1)) && (boardInfo.szBoard[i] > ' '); i++)
+    {
+        lpszBoard[i] = boardInfo.szBoard[i];
+    }
+    lpszBoard[i] = 0;
+    return (i != 0) ? CG_BFRET_OK : CG_BFRET_INTRF_ERROR;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfGetReadSize
+ * Desc: Returns the transfer size to be used for bulk storage area reads.
+ *       On the first call the tuned read size of the board is taken from
+ *       the read size file (CG_BF_READSIZE_FILE). Each line of the file
+ *       holds a board name and the read size in hex, e.g. 'BEXL 40000'.
+ * Inp:  None
+ * Outp: Read size in bytes.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgBfGetReadSize(void)													//MOD031
+{
+    FILE *fpReadSize;
+    char szLine[80], szName[CGOS_BOARD_MAX_SIZE_ID_STRING];
+    char szBoard[CGOS_BOARD_MAX_SIZE_ID_STRING];
+    UINT32 nSize;
+
+    if(nBfReadSize != 0)
+    {
+        return nBfReadSize;
+    }
+    nBfReadSize = CG_BF_READSIZE_DEFAULT;
+    if((CgBfGetBoardName(&szBoard[0]) != CG_BFRET_OK) ||
+       ((fpReadSize = fopen(CG_BF_READSIZE_FILE, "r")) == NULL))
+    {
+        return nBfReadSize;
+    }
+    while(fgets(&szLine[0], sizeof(szLine), fpReadSize) != NULL)
+    {
+        if((SSCANF(&szLine[0], "%15s %x", &szName[0], &nSize) == 2) &&
+           (strcmp(&szName[0], &szBoard[0]) == 0) &&
+           (nSize >= CG_BF_READSIZE_MIN) && (nSize <= CG_BF_READSIZE_MAX))
+        {
+            nBfReadSize = nSize;
+            break;
+        }
+    }
+    fclose(fpReadSize);
+    return nBfReadSize;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfSetReadSize
+ * Desc: Sets the transfer size for bulk storage area reads and optionally
+ *       stores it for the board in the read size file.
+ * Inp:  nReadSize      - Read size in bytes, 0 to return to the default
+ *                        (the entry of the board is removed from the file).
+ *       bStore         - TRUE to store the read size for the board.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR         - Invalid read size
+ *       CG_BFRET_INTRF_ERROR   - Failed to get board name
+ *       CG_BFRET_ERROR_FILE    - Failed to update read size file
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfSetReadSize(UINT32 nReadSize, UINT16 bStore)							//MOD031
+{
+    FILE *fpReadSize;
+    char *pLines = NULL;
+    char szLine[80], szName[CGOS_BOARD_MAX_SIZE_ID_STRING];
+    char szBoard[CGOS_BOARD_MAX_SIZE_ID_STRING];
+    UINT32 nLinesSize = 0, nSize;
+
+    if((nReadSize != 0) && ((nReadSize < CG_BF_READSIZE_MIN) || (nReadSize > CG_BF_READSIZE_MAX)))
+    {
+        return CG_BFRET_ERROR;
+    }
+    nBfReadSize = (nReadSize != 0) ? nReadSize : CG_BF_READSIZE_DEFAULT;
+    if(!bStore)
+    {
+        return CG_BFRET_OK;
+    }
+    if(CgBfGetBoardName(&szBoard[0]) != CG_BFRET_OK)
+    {
+        return CG_BFRET_INTRF_ERROR;
+    }
+
+    // Keep the entries of all other boards
+    if((fpReadSize = fopen(CG_BF_READSIZE_FILE, "r")) != NULL)
+    {
+        while(fgets(&szLine[0], sizeof(szLine), fpReadSize) != NULL)
+        {
+            if((SSCANF(&szLine[0], "%15s %x", &szName[0], &nSize) == 2) &&
+               (strcmp(&szName[0], &szBoard[0]) != 0))
+            {
+                pLines = (char*)realloc(pLines, nLinesSize + sizeof(szLine));
+                if(!pLines)
+                {
+                    fclose(fpReadSize);
+                    return CG_BFRET_ERROR;
+                }
+                nLinesSize = nLinesSize + sprintf(pLines + nLinesSize, "%s %X\n", &szName[0], nSize);
+            }
+        }
+        fclose(fpReadSize);
+    }
+
+    if((fpReadSize = fopen(CG_BF_READSIZE_FILE, "w")) == NULL)
+    {
+        free(pLines);
+        return CG_BFRET_ERROR_FILE;
+    }
+    if(nLinesSize != 0)
+    {
+        fwrite(pLines, 1, nLinesSize, fpReadSize);
+    }
+    if(nReadSize != 0)
+    {
+        fprintf(fpReadSize, "%s %X\n", &szBoard[0], nReadSize);
+    }
+    free(pLines);
+    return (fclose(fpReadSize) == 0) ? CG_BFRET_OK : CG_BFRET_ERROR_FILE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfSnapshotGet
+ * Desc: Returns the snapshot contents of a storage area range.
+ *       The BIOS area is located at the end of an extended area snapshot.
+ * Inp:  ulStorageSelector  - Storage area.
+ *       nOffset            - Offset within the storage area.
+ *       nLen               - Number of bytes.
+ * Outp: Pointer to snapshot data or NULL if the range is not covered by
+ *       valid snapshot pages.
+ *---------------------------------------------------------------------------
+ */
+static unsigned char *CgBfSnapshotGet(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen)	//MOD032
+{
+    UINT32 nPage;
+
+    if(!pBfSnapshot || (nLen == 0))
+    {
+        return NULL;
+    }
+    if((ulStorageSelector == CG32_STORAGE_MPFA_ALL) && (nBfSnapshotSelector == CG32_STORAGE_MPFA_EXTD))
+    {
+        if(nFlashSize > nBfSnapshotSize)
+        {
+            return NULL;
+        }
+        nOffset = nOffset + (nBfSnapshotSize - nFlashSize);
+    }
+    else if(ulStorageSelector != nBfSnapshotSelector)
+    {
+        return NULL;
+    }
+    if((nOffset > nBfSnapshotSize) || (nLen > (nBfSnapshotSize - nOffset)))
+    {
+        return NULL;
+    }
+    for(nPage = nOffset / CG_BF_SNAPSHOT_PAGE; nPage <= ((nOffset + nLen - 1) / CG_BF_SNAPSHOT_PAGE); nPage++)
+    {
+        if(!pBfSnapshotValid[nPage])
+        {
+            return NULL;
+        }
+    }
+    return pBfSnapshot + nOffset;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfSnapshotLoad
+ * Desc: Reads a complete storage area once and keeps it as snapshot. Later
+ *       reads by CgBfStorageRead are served from the snapshot until the
+ *       respective pages are invalidated.
+ * Inp:  ulStorageSelector  - Storage area (CG32_STORAGE_MPFA_ALL/EXTD).
+ *       nSize              - Size of storage area.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR         - Out of memory
+ *       CG_BFRET_INTRF_ERROR   - Failed to read storage area
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfSnapshotLoad(UINT32 ulStorageSelector, UINT32 nSize)				//MOD032
+{
+    unsigned char *pData;
+    UINT32 nPages;
+
+    CgBfSnapshotFree();
+    nPages = (nSize + CG_BF_SNAPSHOT_PAGE - 1) / CG_BF_SNAPSHOT_PAGE;
+    pData = (unsigned char*)malloc(nSize);
+    pBfSnapshotValid = (unsigned char*)malloc(nPages);
+    if(!pData || !pBfSnapshotValid)
+    {
+        free(pData);
+        CgBfSnapshotFree();
+        return CG_BFRET_ERROR;
+    }
+    if(!CgBfStorageRead(ulStorageSelector, 0, pData, nSize))
+    {
+        free(pData);
+        CgBfSnapshotFree();
+        return CG_BFRET_INTRF_ERROR;
+    }
+    memset(pBfSnapshotValid, 1, nPages);
+    pBfSnapshot = pData;
+    nBfSnapshotSelector = ulStorageSelector;
+    nBfSnapshotSize = nSize;
+    return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfSnapshotSave
+ * Desc: Writes the complete flash snapshot to a file.
+ * Inp:  lpszFile       - Pointer to file name.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR         - No complete snapshot available
+ *       CG_BFRET_ERROR_FILE    - File processing error
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBfSnapshotSave(_TCHAR *lpszFile)										//MOD032
+{
+    FILE *fpFile;
+    UINT16 retVal = CG_BFRET_OK;
+
+    if(!CgBfSnapshotGet(nBfSnapshotSelector, 0, nBfSnapshotSize))
+    {
+        return CG_BFRET_ERROR;
+    }
+    if(bBfSparseBackup)															//MOD033 v
+    {
+        return CgBkSave(lpszFile, nBfSnapshotSelector, nBfSnapshotSize);
+    }																			//MOD033 ^
+    if((fpFile = fopen(lpszFile, "wb")) == NULL)
+    {
+        return CG_BFRET_ERROR_FILE;
+    }
+    if(fwrite(pBfSnapshot, nBfSnapshotSize, 1, fpFile) != 1)
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+    }
+    if(fclose(fpFile) != 0)
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+    }
+    return retVal;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfSnapshotInvalidate
+ * Desc: Marks a storage area range as modified. Following reads of this range
+ *       access the flash part again.
+ * Inp:  ulStorageSelector  - Storage area.
+ *       nOffset            - Offset of modified range.
+ *       nSize              - Size of modified range.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgBfSnapshotInvalidate(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nSize)	//MOD032
+{
+    UINT32 nPage;
+
+    if(!pBfSnapshot || (nSize == 0))
+    {
+        return;
+    }
+    if((ulStorageSelector == CG32_STORAGE_MPFA_ALL) && (nBfSnapshotSelector == CG32_STORAGE_MPFA_EXTD) &&
+       (nFlashSize <= nBfSnapshotSize))
+    {
+        nOffset = nOffset + (nBfSnapshotSize - nFlashSize);
+    }
+    else if(ulStorageSelector != nBfSnapshotSelector)
+    {
+        // Relation to snapshot unknown, drop it completely
+        CgBfSnapshotFree();
+        return;
+    }
+    for(nPage = nOffset / CG_BF_SNAPSHOT_PAGE;
+        (nPage <= ((nOffset + nSize - 1) / CG_BF_SNAPSHOT_PAGE)) && ((nPage * CG_BF_SNAPSHOT_PAGE) < nBfSnapshotSize);
+        nPage++)
+    {
+        pBfSnapshotValid[nPage] = 0;
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfSnapshotFree
+ * Desc: Releases the flash snapshot.
+ * Inp:  None
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgBfSnapshotFree(void)														//MOD032
+{
+    if(pBfSnapshot)
+    {
+        free(pBfSnapshot);
+        pBfSnapshot = NULL;
+    }
+    if(pBfSnapshotValid)
+    {
+        free(pBfSnapshotValid);
+        pBfSnapshotValid = NULL;
+    }
+    nBfSnapshotSize = 0;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBfStorageRead
+ * Desc: Reads a range of a storage area using the tuned read size
+ *       (see CgBfGetReadSize) as transfer size. Ranges covered by a valid
+ *       flash snapshot are taken from the snapshot.
+ * Inp:  ulStorageSelector  - Storage area to read from.
+ *       nOffset            - Offset within the storage area.
+ *       pBuffer            - Pointer to storage for read data.
+ *       nLen               - Number of bytes to read.
+ * Outp: TRUE on success, FALSE on interface error.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgBfStorageRead															//MOD031
+(
+    UINT32 ulStorageSelector,
+    UINT32 nOffset,
+    unsigned char *pBuffer,
+    UINT32 nLen
+)
+{
+    UINT32 nReadSize, nTransfer;
+    unsigned char *pSnapshot;													//MOD032
+
+    nReadSize = CgBfGetReadSize();
+    while(nLen != 0)
+    {
+        nTransfer = (nLen < nReadSize) ? nLen : nReadSize;
+        if((pSnapshot = CgBfSnapshotGet(ulStorageSelector, nOffset, nTransfer)) != NULL)	//MOD032 v
+        {
+            memcpy(pBuffer, pSnapshot, nTransfer);
+        }																		//MOD032 ^
+        else if(!CgStoreRead(ulStorageSelector, nOffset, pBuffer, nTransfer))	//MOD032 //MOD038
+        {
+            return FALSE;
+        }
+        nOffset = nOffset + nTransfer;
+        pBuffer = pBuffer + nTransfer;
+        nLen = nLen - nTransfer;
+    }
+    return TRUE;
+}
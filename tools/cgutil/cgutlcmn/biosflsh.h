@@ -29,6 +29,44 @@
  *
  * $Log:   S:/CG/archives/CGTOOLS/CGUTIL/CGUTLCMN/BIOSFLSH.H-arc  $
  * 
+ * MOD025: CgBfVerifyBlock gets the update flags (biosflsh.c MOD048).
+ * 
+ * MOD024: Flash write generation for the digest manifest (biosflsh.c MOD046).
+ * 
+ * MOD023: Added CG_BFFLAG_UPTODATE and the digest manifest (biosflsh.c MOD039).
+ * 
+ * MOD022: Added CG_BFFLAG_SBL (biosflsh.c MOD037).
+ * 
+ * MOD021: Added CG_BFFLAG_STITCH (biosflsh.c MOD036).
+ * 
+ * MOD020: Added CG_BFFLAG_BACKUP and the flash snapshot (biosflsh.c MOD032).
+ * 
+ * MOD019: Added the storage area read size (biosflsh.c MOD031).
+ * 
+ * MOD018: Added the erase status polling (biosflsh.c MOD030).
+ * 
+ * MOD017: Added CG_BFFLAG_JOURNAL and the update journal (biosflsh.c MOD029).
+ * 
+ * MOD016: Added CG_BFFLAG_REGION (biosflsh.c MOD028).
+ * 
+ * MOD015: Added the pattern search (biosflsh.c MOD026).
+ * 
+ * MOD014: Added the BIOS file mapping (biosflsh.c MOD025).
+ * 
+ * MOD013: Added the block verification (biosflsh.c MOD023).
+ * 
+ * MOD012: Added the flash block states of the differential update (biosflsh.c MOD022).
+ * 
+ * MOD011: Added CG_BFFLAG_DIFF (biosflsh.c MOD021).
+ * 
+ * MOD010: Added Icelake MAC address recovery definitions (biosflsh.c MOD020).
+ * 
+ * MOD009: Added EHL GbE region definitions (biosflsh.c MOD016).
+ * 
+ * MOD008: Added CG_BFFLAG_KEEP_LANAREAS and DSAC definitions (biosflsh.c MOD015).
+ * 
+ * MOD007: Added CG_BFFLAG_PRESERVE (biosflsh.c MOD013).
+ * 
  *    Rev 1.7   Sep 06 2016 15:44:48   congatec
  * Added BSD header.
  * MOD006: Added flag to control immediate/auto off-on cycle for BIOS unlock. Mark old BB update control flag as obsolete. 
@@ -91,6 +129,13 @@ extern "C" {
 #define CG_BFFLAG_AUTO_OFFON	0x0800	// Perform immediate/auto off-on cycle for BIOS unlock.	//MOD006
 #define CG_BFFLAG_PRESERVE		0x1000	// Preserve pre-defined NVRAM settings (e.g. PASSWORD)	//MOD007
 #define CG_BFFLAG_KEEP_LANAREAS 0x2000  // Save LAN CTRL 0 and LAN CTRL 1 areas (DSAC)          //MOD008
+#define CG_BFFLAG_DIFF          0x4000  // Differential update, only flash blocks that differ  //MOD011
+#define CG_BFFLAG_REGION        0x8000  // Only update the selected flash descriptor regions   //MOD016
+#define CG_BFFLAG_JOURNAL       0x10000 // Journal block progress, resume interrupted update   //MOD017
+#define CG_BFFLAG_BACKUP        0x20000 // Save flash contents to backup file before update    //MOD020
+#define CG_BFFLAG_STITCH        0x40000 // Replace BIOS region of the file by another image     //MOD021
+#define CG_BFFLAG_SBL           0x80000 // Skip blocks of unchanged Slim Bootloader components  //MOD022
+#define CG_BFFLAG_UPTODATE      0x100000 // Skip update if flash already holds the file contents //MOD023
 
 //-------------------------
 // BIOS flash return codes
@@ -107,6 +152,84 @@ extern "C" {
 #define	CG_BFRET_ERROR_UNLOCK_EXTD	0x09	// Failed to unlock flash for extended update			//MOD002
 #define	CG_BFRET_ERROR_LOCK_EXTD	0x0A	// Failed to lock flash after extended update			//MOD002
 #define CG_BFRET_NOTCOMP_EXTD 0x0B		// Extend update not (yet) completed						//MOD002
+#define CG_BFRET_ERROR_REGION 0x0C		// Flash region layouts do not match or region not present	//MOD016
+#define CG_BFRET_UPTODATE     0x0D		// Flash already holds the file contents, nothing written	//MOD023
+
+//--------------------------------------------
+// BIOS flash block states (differential update)	//MOD012 v
+//--------------------------------------------
+#define CG_BFBLK_EQUAL        0x00    // Flash block already holds new contents
+#define CG_BFBLK_PROGRAM      0x01    // Flash block can be programmed without erase
+#define CG_BFBLK_ERASE        0x02    // Flash block has to be erased and programmed		//MOD012 ^
+
+//--------------------------------------------
+// BIOS flash update journal							//MOD017 v
+//--------------------------------------------
+#define CG_BF_JOURNAL_SIGNATURE 0x4A464243	// 'CBFJ'
+#define CG_BF_JOURNAL_VERSION   0x00000001
+#define CG_BF_JOURNAL_EXT       ".jnl"		// Appended to the name of the BIOS file
+
+#define CG_BF_JOURNAL_PENDING   0x00		// Block not (yet) written
+#define CG_BF_JOURNAL_DONE      0x01		// Block written and verified
+
+typedef struct {
+	UINT32 nSignature;						// CG_BF_JOURNAL_SIGNATURE
+	UINT32 nVersion;						// CG_BF_JOURNAL_VERSION
+	UINT32 nImageSize;						// Size of BIOS file
+	UINT32 nImageCrc;						// CRC32C of BIOS file
+	UINT32 nStorageSelector;				// Target storage area
+	UINT32 nBlockSize;						// Update block size
+	UINT32 nBlockCount;						// Number of block entries following
+	UINT32 nRegionMask;						// Selected flash regions (CG_BFFLAG_REGION) or 0
+} CG_BF_JOURNAL_HEADER;
+
+typedef struct {
+	UINT32 nState;							// CG_BF_JOURNAL_xxx
+	UINT32 nCrc;							// CRC32C of written block contents
+} CG_BF_JOURNAL_ENTRY;												//MOD017 ^
+
+//--------------------------------------------
+// Storage area erase status							//MOD018 v
+//--------------------------------------------
+#define CG_BF_ERASE_STATUS_DONE  0x00		// Erase completed
+#define CG_BF_ERASE_STATUS_BUSY  0x01		// Erase in progress
+#define CG_BF_ERASE_TIMEOUT      5000		// Max. time in ms to wait for an erase	//MOD018 ^
+
+//--------------------------------------------
+// Storage area read transfer size						//MOD019 v
+//--------------------------------------------
+#define CG_BF_READSIZE_FILE      "CGRDSIZE.CFG"	// Tuned read sizes per board name
+#define CG_BF_READSIZE_DEFAULT   0x10000		// Read size if no tuned size is stored
+#define CG_BF_READSIZE_MIN       0x1000		// Smallest read size
+#define CG_BF_READSIZE_MAX       0x100000	// Largest read size					//MOD019 ^
+
+//--------------------------------------------
+// Flash snapshot									//MOD020 v
+//--------------------------------------------
+#define CG_BF_SNAPSHOT_PAGE      0x1000		// Invalidation granularity of the snapshot	//MOD020 ^
+
+//--------------------------------------------
+// Flash digest manifest (CG_BFFLAG_UPTODATE)		//MOD023 v
+//--------------------------------------------
+// CRC32C digests of the flash blocks, cached per board next to the journal.
+// Only valid as long as board serial number, boot counter and flash write
+// generation match.
+#define CG_BF_DIGEST_SIGNATURE  0x44464243	// 'CBFD'
+#define CG_BF_DIGEST_VERSION    0x00000002	//MOD024
+#define CG_BF_DIGEST_EXT        ".dgm"		// Appended to BIOS file name and board serial number
+#define CG_BF_FLASHGEN_FILE     "CGFLGEN.CFG"	// Flash write generation, counted up by each flash write	//MOD024
+
+typedef struct {
+	UINT32 nSignature;						// CG_BF_DIGEST_SIGNATURE
+	UINT32 nVersion;						// CG_BF_DIGEST_VERSION
+	char szSerialNumber[CGOS_BOARD_MAX_SIZE_SERIAL_STRING];	// Board serial number
+	UINT32 nBootCounter;					// Boot counter at the time of the digests
+	UINT32 nGeneration;						// Flash write generation (CG_BF_FLASHGEN_FILE)	//MOD024
+	UINT32 nStorageSelector;				// Storage area
+	UINT32 nAreaSize;						// Size of storage area
+	UINT32 nBlockSize;						// Digest block size
+	UINT32 nBlockCount;						// Number of CRC32C digests following
+} CG_BF_DIGEST_HEADER;												//MOD023 ^
 
 
 //---------------------
@@ -121,6 +244,28 @@ extern UINT16 CgBfGetFileSize(FILE *fpFile, UINT32 *pFileSize);
 extern UINT16 CG_BiosFlashPrepare(void);
 extern UINT16 CgBfCheckExtendedCompatibility(FILE *fpBiosRomfile, UINT32 nRomfileSize);	//MOD002
 extern UINT16 CgBfGetBiosInfoFlash(void);										//MOD002 
+extern UINT32 CgBfCheckBlock(unsigned char *pFlashData, unsigned char *pNewData, UINT32 nSize);	//MOD012
+extern UINT16 CgBfVerifyBlock(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pData, UINT32 nSize, unsigned char *pScratch, UINT32 nFlags);	//MOD013 //MOD025
+extern UINT16 CgBfMapRomfile(FILE *fpBiosRomfile, UINT32 nRomfileSize, unsigned char **ppBuffer);	//MOD014
+extern void CgBfUnmapRomfile(unsigned char *pBuffer, UINT32 nRomfileSize);		//MOD014
+extern UINT16 CgBfFindPattern(unsigned char *pData, UINT32 nDataSize, unsigned char *pPattern, UINT32 nPatternSize, UINT32 nAlign, UINT32 *pOffset);	//MOD015
+extern UINT16 CgBfFindPatternFlash(UINT32 ulStorageSelector, UINT32 nAreaSize, unsigned char *pPattern, UINT32 nPatternSize, UINT32 nAlign, UINT32 *pOffset);	//MOD015
+extern UINT32 CgBfCrc32c(UINT32 nCrc, unsigned char *pData, UINT32 nSize);		//MOD017
+extern UINT16 CgBfJournalOpen(_TCHAR *lpszBiosFile, CG_BF_JOURNAL_HEADER *pHeader, UINT32 *pResumed);	//MOD017
+extern UINT32 CgBfJournalCheckBlock(UINT32 nBlock, UINT32 nOffset, UINT32 nSize, unsigned char *pScratch);	//MOD017
+extern void CgBfJournalSetBlock(UINT32 nBlock, unsigned char *pData, UINT32 nSize);	//MOD017
+extern void CgBfJournalClose(UINT32 bCompleted);								//MOD017
+extern UINT16 CgBfWaitEraseDone(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nSize);	//MOD018
+extern UINT32 CgBfGetReadSize(void);											//MOD019
+extern UINT16 CgBfSetReadSize(UINT32 nReadSize, UINT16 bStore);					//MOD019
+extern UINT32 CgBfStorageRead(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen);	//MOD019
+extern UINT16 CgBfSnapshotLoad(UINT32 ulStorageSelector, UINT32 nSize);		//MOD020
+extern UINT16 CgBfSnapshotSave(_TCHAR *lpszFile);								//MOD020
+extern void CgBfSnapshotInvalidate(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nSize);	//MOD020
+extern void CgBfSnapshotFree(void);												//MOD020
+extern UINT16 CgBfDigestCheck(_TCHAR *lpszBiosFile, UINT32 ulStorageSelector, unsigned char *pImage, UINT32 nSize, unsigned char *pScratch);	//MOD023
+extern void CgBfDigestClose(UINT32 bCompleted);									//MOD023
+extern void CgBfDigestInvalidate(void);											//MOD024
 
 
 																				//MOD005 v
@@ -0,0 +1,511 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Sparse, compressed flash backup container.
+ *           Erased blocks are only recorded in the block index, all other
+ *           blocks are stored LZ compressed (LZ4 block format) or raw if
+ *           they do not compress. Each block is protected by a CRC32C.
+ *           CG_BiosFlash expands a container to a temporary image file.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "biosflsh.h"
+#include "cgbkup.h"
+
+/*--------------
+ * Externs used
+ *--------------
+ */
+extern void BiosFlashReportState(UINT32 nControl, _TCHAR *szReportString);
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+#define CG_BK_HASH_BITS         12
+#define CG_BK_MIN_MATCH         4
+#define CG_BK_MAX_OFFSET        0xFFFF
+#define CG_BK_LAST_LITERALS     5           // Last bytes of a block are always literals
+#define CG_BK_MATCH_LIMIT       12          // No match starts within the last bytes
+
+#define CG_BK_READ32(p)         ((UINT32)(p)[0] | ((UINT32)(p)[1] << 8) | ((UINT32)(p)[2] << 16) | ((UINT32)(p)[3] << 24))
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkWriteLength
+ * Desc: Writes the extension bytes of a literal or match length >= 15.
+ * Inp:  pDst           - Output position.
+ *       nLength        - Remaining length (length - 15).
+ * Outp: New output position.
+ *---------------------------------------------------------------------------
+ */
+static unsigned char *CgBkWriteLength(unsigned char *pDst, UINT32 nLength)
+{
+    while(nLength >= 255)
+    {
+        *pDst++ = 255;
+        nLength = nLength - 255;
+    }
+    *pDst++ = (unsigned char)nLength;
+    return pDst;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkCompress
+ * Desc: Compresses a block. Uses a single entry hash table of 4 byte
+ *       sequences, which is fast and good enough for the padding and
+ *       repeated structures found in flash images.
+ * Inp:  pSrc           - Block data.
+ *       nSize          - Block size.
+ *       pDst           - Output buffer.
+ *       nDstSize       - Size of output buffer.
+ * Outp: Size of compressed data or 0 if it does not fit into the output
+ *       buffer.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 CgBkCompress(unsigned char *pSrc, UINT32 nSize, unsigned char *pDst, UINT32 nDstSize)
+{
+    UINT32 hashTable[1 << CG_BK_HASH_BITS];
+    UINT32 nPos = 0, nAnchor = 0, nRef, nHash, nLiterals, nMatch;
+    unsigned char *pOut = pDst;
+    unsigned char *pToken;
+
+    memset(hashTable, 0, sizeof(hashTable));
+    while((nSize > CG_BK_MATCH_LIMIT) && (nPos < (nSize - CG_BK_MATCH_LIMIT)))
+    {
+        nHash = (CG_BK_READ32(pSrc + nPos) * 2654435761U) >> (32 - CG_BK_HASH_BITS);
+        nRef = hashTable[nHash];
+        hashTable[nHash] = nPos + 1;
+        if((nRef == 0) || ((nPos - (nRef - 1)) > CG_BK_MAX_OFFSET) ||
+           (CG_BK_READ32(pSrc + nRef - 1) != CG_BK_READ32(pSrc + nPos)))
+        {
+            nPos++;
+            continue;
+        }
+        nRef = nRef - 1;
+        nMatch = CG_BK_MIN_MATCH;
+        while(((nPos + nMatch) < (nSize - CG_BK_LAST_LITERALS)) && (pSrc[nRef + nMatch] == pSrc[nPos + nMatch]))
+        {
+            nMatch++;
+        }
+
+        // Worst case size of this sequence
+        nLiterals = nPos - nAnchor;
+        if(((UINT32)(pOut - pDst) + 1 + (nLiterals / 255) + 1 + nLiterals + 2 + (nMatch / 255) + 1) > nDstSize)
+        {
+            return 0;
+        }
+        pToken = pOut++;
+        *pToken = (unsigned char)(((nLiterals >= 15) ? 15 : nLiterals) << 4);
+        if(nLiterals >= 15)
+        {
+            pOut = CgBkWriteLength(pOut, nLiterals - 15);
+        }
+        memcpy(pOut, pSrc + nAnchor, nLiterals);
+        pOut = pOut + nLiterals;
+        *pOut++ = (unsigned char)(nPos - nRef);
+        *pOut++ = (unsigned char)((nPos - nRef) >> 8);
+        *pToken |= (unsigned char)(((nMatch - CG_BK_MIN_MATCH) >= 15) ? 15 : (nMatch - CG_BK_MIN_MATCH));
+        if((nMatch - CG_BK_MIN_MATCH) >= 15)
+        {
+            pOut = CgBkWriteLength(pOut, nMatch - CG_BK_MIN_MATCH - 15);
+        }
+        nPos = nPos + nMatch;
+        nAnchor = nPos;
+    }
+
+    // Last literals
+    nLiterals = nSize - nAnchor;
+    if(((UINT32)(pOut - pDst) + 1 + (nLiterals / 255) + 1 + nLiterals) > nDstSize)
+    {
+        return 0;
+    }
+    *pOut++ = (unsigned char)(((nLiterals >= 15) ? 15 : nLiterals) << 4);
+    if(nLiterals >= 15)
+    {
+        pOut = CgBkWriteLength(pOut, nLiterals - 15);
+    }
+    memcpy(pOut, pSrc + nAnchor, nLiterals);
+    pOut = pOut + nLiterals;
+    return (UINT32)(pOut - pDst);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkDecompress
+ * Desc: Decompresses a block.
+ * Inp:  pSrc           - Compressed data.
+ *       nSrcSize       - Size of compressed data.
+ *       pDst           - Output buffer.
+ *       nDstSize       - Expected block size.
+ * Outp: TRUE if exactly nDstSize bytes have been decompressed, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+static UINT16 CgBkDecompress(unsigned char *pSrc, UINT32 nSrcSize, unsigned char *pDst, UINT32 nDstSize)
+{
+    UINT32 nIn = 0, nOut = 0, nLength, nOffset;
+    unsigned char nToken, nByte;
+
+    while(nIn < nSrcSize)
+    {
+        nToken = pSrc[nIn++];
+
+        // Literals
+        nLength = nToken >> 4;
+        if(nLength == 15)
+        {
+            do
+            {
+                if(nIn >= nSrcSize)
+                {
+                    return FALSE;
+                }
+                nByte = pSrc[nIn++];
+                nLength = nLength + nByte;
+            }while(nByte == 255);
+        }
+        if((nLength > (nSrcSize - nIn)) || (nLength > (nDstSize - nOut)))
+        {
+            return FALSE;
+        }
+        memcpy(pDst + nOut, pSrc + nIn, nLength);
+        nIn = nIn + nLength;
+        nOut = nOut + nLength;
+        if(nIn >= nSrcSize)
+        {
+            // Last sequence has no match
+            break;
+        }
+
+        // Match
+        if((nSrcSize - nIn) < 2)
+        {
+            return FALSE;
+        }
+        nOffset = pSrc[nIn] | (pSrc[nIn + 1] << 8);
+        nIn = nIn + 2;
+        if((nOffset == 0) || (nOffset > nOut))
+        {
+            return FALSE;
+        }
+        nLength = nToken & 0x0F;
+        if(nLength == 15)
+        {
+            do
+            {
+                if(nIn >= nSrcSize)
+                {
+                    return FALSE;
+                }
+                nByte = pSrc[nIn++];
+                nLength = nLength + nByte;
+            }while(nByte == 255);
+        }
+        nLength = nLength + CG_BK_MIN_MATCH;
+        if(nLength > (nDstSize - nOut))
+        {
+            return FALSE;
+        }
+        // Byte wise copy, source and destination may overlap
+        while(nLength--)
+        {
+            pDst[nOut] = pDst[nOut - nOffset];
+            nOut++;
+        }
+    }
+    return (nOut == nDstSize) ? TRUE : FALSE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkIsErased
+ * Desc: Checks whether all bytes of a block are 0xFF.
+ * Inp:  pData          - Block data.
+ *       nSize          - Block size.
+ * Outp: TRUE if erased, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+static UINT16 CgBkIsErased(unsigned char *pData, UINT32 nSize)
+{
+    UINT32 i;
+
+    for(i = 0; i < nSize; i++)
+    {
+        if(pData[i] != 0xFF)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkSave
+ * Desc: Reads a storage area and saves it as backup container. The storage
+ *       area is read with CgBfStorageRead, i.e. from a flash snapshot if
+ *       available.
+ * Inp:  lpszFile           - Pointer to container file name.
+ *       ulStorageSelector  - Storage area to save.
+ *       nImageSize         - Size of storage area.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_INTRF_ERROR   - Failed to read storage area
+ *       CG_BFRET_ERROR_FILE    - File processing error
+ *       CG_BFRET_ERROR         - General processing error
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBkSave(_TCHAR *lpszFile, UINT32 ulStorageSelector, UINT32 nImageSize)
+{
+    CG_BK_HEADER header;
+    CG_BK_INDEX *pIndex = NULL;
+    unsigned char *pBlock = NULL, *pPacked = NULL;
+    FILE *fpFile = NULL;
+    UINT32 i, nSize, nPacked, nFileOffset, nErased = 0, nCompressed = 0;
+    UINT16 retVal = CG_BFRET_OK;
+    char strInfo[80];
+
+    memset(&header, 0, sizeof(header));
+    header.nSignature = CG_BK_SIGNATURE;
+    header.nVersion = CG_BK_VERSION;
+    header.nImageSize = nImageSize;
+    header.nBlockSize = CG_BK_BLOCK_SIZE;
+    header.nBlockCount = (nImageSize + CG_BK_BLOCK_SIZE - 1) / CG_BK_BLOCK_SIZE;
+    header.nStorageSelector = ulStorageSelector;
+
+    pIndex = (CG_BK_INDEX*)calloc(header.nBlockCount, sizeof(CG_BK_INDEX));
+    pBlock = (unsigned char*)malloc(CG_BK_BLOCK_SIZE);
+    pPacked = (unsigned char*)malloc(CG_BK_BLOCK_SIZE);
+    if(!pIndex || !pBlock || !pPacked)
+    {
+        retVal = CG_BFRET_ERROR;
+        goto CgBkSaveExit;
+    }
+    if((fpFile = fopen(lpszFile, "wb")) == NULL)
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+        goto CgBkSaveExit;
+    }
+
+    // Block data follows header and index. Both are written when complete.
+    nFileOffset = sizeof(CG_BK_HEADER) + (header.nBlockCount * sizeof(CG_BK_INDEX));
+    if(fseek(fpFile, nFileOffset, SEEK_SET) != 0)
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+        goto CgBkSaveExit;
+    }
+
+    for(i = 0; i < header.nBlockCount; i++)
+    {
+        nSize = ((nImageSize - (i * CG_BK_BLOCK_SIZE)) < CG_BK_BLOCK_SIZE) ? (nImageSize - (i * CG_BK_BLOCK_SIZE)) : CG_BK_BLOCK_SIZE;
+        if(!CgBfStorageRead(ulStorageSelector, i * CG_BK_BLOCK_SIZE, pBlock, nSize))
+        {
+            retVal = CG_BFRET_INTRF_ERROR;
+            goto CgBkSaveExit;
+        }
+        header.nImageCrc = CgBfCrc32c(header.nImageCrc, pBlock, nSize);
+        pIndex[i].nCrc = CgBfCrc32c(0, pBlock, nSize);
+        pIndex[i].nOffset = nFileOffset;
+        if(CgBkIsErased(pBlock, nSize))
+        {
+            pIndex[i].nType = CG_BK_BLOCK_ERASED;
+            nErased++;
+            continue;
+        }
+        // Store raw if the block does not get smaller
+        nPacked = CgBkCompress(pBlock, nSize, pPacked, nSize - 1);
+        if(nPacked != 0)
+        {
+            pIndex[i].nType = CG_BK_BLOCK_LZ;
+            pIndex[i].nLength = nPacked;
+            nCompressed++;
+        }
+        else
+        {
+            pIndex[i].nType = CG_BK_BLOCK_RAW;
+            pIndex[i].nLength = nSize;
+        }
+        if(fwrite((nPacked != 0) ? pPacked : pBlock, pIndex[i].nLength, 1, fpFile) != 1)
+        {
+            retVal = CG_BFRET_ERROR_FILE;
+            goto CgBkSaveExit;
+        }
+        nFileOffset = nFileOffset + pIndex[i].nLength;
+    }
+
+    if((fseek(fpFile, 0, SEEK_SET) != 0) ||
+       (fwrite(&header, sizeof(header), 1, fpFile) != 1) ||
+       (fwrite(pIndex, sizeof(CG_BK_INDEX), header.nBlockCount, fpFile) != header.nBlockCount))
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+        goto CgBkSaveExit;
+    }
+    SPRINTF(&strInfo[0], "(%d erased, %d LZ, %d raw blocks, %d KB) ", nErased, nCompressed,
+            header.nBlockCount - nErased - nCompressed, nFileOffset / 1024);
+    BiosFlashReportState(1, &strInfo[0]);
+
+CgBkSaveExit:
+    if(fpFile && (fclose(fpFile) != 0) && (retVal == CG_BFRET_OK))
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+    }
+    if((retVal != CG_BFRET_OK) && fpFile)
+    {
+        remove(lpszFile);
+    }
+    free(pIndex);
+    free(pBlock);
+    free(pPacked);
+    return retVal;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkIsContainer
+ * Desc: Checks whether a file is a backup container.
+ * Inp:  fpFile         - Opened file.
+ * Outp: TRUE if the file starts with a container header, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBkIsContainer(FILE *fpFile)
+{
+    CG_BK_HEADER header;
+    UINT16 bContainer;
+
+    fseek(fpFile, 0, SEEK_SET);
+    bContainer = ((fread(&header, sizeof(header), 1, fpFile) == 1) &&
+                  (header.nSignature == CG_BK_SIGNATURE)) ? TRUE : FALSE;
+    fseek(fpFile, 0, SEEK_SET);
+    return bContainer;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgBkExpand
+ * Desc: Expands a backup container to a temporary image file. The CRC32C
+ *       of each block and of the whole image is checked.
+ * Inp:  fpContainer    - Opened container file.
+ *       ppImage        - Pointer to storage for the temporary image file.
+ *                        The file is deleted when it is closed.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_INVALID       - Invalid or corrupted container
+ *       CG_BFRET_ERROR_FILE    - File processing error
+ *       CG_BFRET_ERROR         - General processing error
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgBkExpand(FILE *fpContainer, FILE **ppImage)
+{
+    CG_BK_HEADER header;
+    CG_BK_INDEX *pIndex = NULL;
+    unsigned char *pBlock = NULL, *pPacked = NULL;
+    FILE *fpImage = NULL;
+    UINT32 i, nSize, nImageCrc = 0;
+    UINT16 retVal = CG_BFRET_OK;
+
+    *ppImage = NULL;
+    fseek(fpContainer, 0, SEEK_SET);
+    if((fread(&header, sizeof(header), 1, fpContainer) != 1) ||
+       (header.nSignature != CG_BK_SIGNATURE) || (header.nVersion != CG_BK_VERSION) ||
+       (header.nBlockSize == 0) || (header.nBlockSize > CG_BF_READSIZE_MAX) ||
+       (header.nBlockCount != ((header.nImageSize + header.nBlockSize - 1) / header.nBlockSize)))
+    {
+        return CG_BFRET_INVALID;
+    }
+
+    pIndex = (CG_BK_INDEX*)calloc(header.nBlockCount, sizeof(CG_BK_INDEX));
+    pBlock = (unsigned char*)malloc(header.nBlockSize);
+    pPacked = (unsigned char*)malloc(header.nBlockSize);
+    if(!pIndex || !pBlock || !pPacked)
+    {
+        retVal = CG_BFRET_ERROR;
+        goto CgBkExpandExit;
+    }
+    if(fread(pIndex, sizeof(CG_BK_INDEX), header.nBlockCount, fpContainer) != header.nBlockCount)
+    {
+        retVal = CG_BFRET_INVALID;
+        goto CgBkExpandExit;
+    }
+    if((fpImage = tmpfile()) == NULL)
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+        goto CgBkExpandExit;
+    }
+
+    for(i = 0; i < header.nBlockCount; i++)
+    {
+        nSize = ((header.nImageSize - (i * header.nBlockSize)) < header.nBlockSize) ? (header.nImageSize - (i * header.nBlockSize)) : header.nBlockSize;
+        if(pIndex[i].nType == CG_BK_BLOCK_ERASED)
+        {
+            memset(pBlock, 0xFF, nSize);
+        }
+        else if(((pIndex[i].nType != CG_BK_BLOCK_LZ) && (pIndex[i].nType != CG_BK_BLOCK_RAW)) ||
+                (pIndex[i].nLength > nSize) ||
+                (fseek(fpContainer, pIndex[i].nOffset, SEEK_SET) != 0) ||
+                (fread((pIndex[i].nType == CG_BK_BLOCK_LZ) ? pPacked : pBlock, pIndex[i].nLength, 1, fpContainer) != 1) ||
+                ((pIndex[i].nType == CG_BK_BLOCK_RAW) && (pIndex[i].nLength != nSize)) ||
+                ((pIndex[i].nType == CG_BK_BLOCK_LZ) && !CgBkDecompress(pPacked, pIndex[i].nLength, pBlock, nSize)))
+        {
+            retVal = CG_BFRET_INVALID;
+            goto CgBkExpandExit;
+        }
+        if(CgBfCrc32c(0, pBlock, nSize) != pIndex[i].nCrc)
+        {
+            retVal = CG_BFRET_INVALID;
+            goto CgBkExpandExit;
+        }
+        nImageCrc = CgBfCrc32c(nImageCrc, pBlock, nSize);
+        if(fwrite(pBlock, nSize, 1, fpImage) != 1)
+        {
+            retVal = CG_BFRET_ERROR_FILE;
+            goto CgBkExpandExit;
+        }
+    }
+    if(nImageCrc != header.nImageCrc)
+    {
+        retVal = CG_BFRET_INVALID;
+        goto CgBkExpandExit;
+    }
+    if(fflush(fpImage) != 0)
+    {
+        retVal = CG_BFRET_ERROR_FILE;
+        goto CgBkExpandExit;
+    }
+    fseek(fpImage, 0, SEEK_SET);
+    *ppImage = fpImage;
+    fpImage = NULL;
+
+CgBkExpandExit:
+    if(fpImage)
+    {
+        fclose(fpImage);
+    }
+    free(pIndex);
+    free(pBlock);
+    free(pPacked);
+    return retVal;
+}
@@ -0,0 +1,84 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Sparse, compressed flash backup container definitions.
+ *
+ *           Layout of a container file:
+ *           CG_BK_HEADER
+ *           CG_BK_INDEX[nBlockCount]
+ *           Block data of all blocks that are not erased
+ *
+ *---------------------------------------------------------------------------
+ */
+
+#ifndef _INC_CGBKUP
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma pack(push,1)
+
+//-----------------------------
+// Backup container definitions
+//-----------------------------
+#define CG_BK_SIGNATURE         0x4B424743  // 'CGBK'
+#define CG_BK_VERSION           1
+#define CG_BK_BLOCK_SIZE        0x10000     // Block size used for new containers
+
+// Block types
+#define CG_BK_BLOCK_ERASED      0x00        // All bytes 0xFF, no data stored
+#define CG_BK_BLOCK_LZ          0x01        // LZ compressed data
+#define CG_BK_BLOCK_RAW         0x02        // Uncompressed data
+
+typedef struct {
+    UINT32 nSignature;                      // CG_BK_SIGNATURE
+    UINT32 nVersion;                        // CG_BK_VERSION
+    UINT32 nImageSize;                      // Size of the flash image
+    UINT32 nBlockSize;                      // Size of one block
+    UINT32 nBlockCount;                     // Number of index entries
+    UINT32 nImageCrc;                       // CRC32C of the flash image
+    UINT32 nStorageSelector;                // Storage area the image was read from
+    UINT32 nReserved;
+} CG_BK_HEADER;
+
+typedef struct {
+    UINT32 nType;                           // CG_BK_BLOCK_xxx
+    UINT32 nOffset;                         // File offset of block data
+    UINT32 nLength;                         // Length of block data in file
+    UINT32 nCrc;                            // CRC32C of the uncompressed block
+} CG_BK_INDEX;
+
+#pragma pack(pop)
+
+//---------------------
+// Function prototypes
+//---------------------
+extern UINT16 CgBkSave(_TCHAR *lpszFile, UINT32 ulStorageSelector, UINT32 nImageSize);
+extern UINT16 CgBkIsContainer(FILE *fpFile);
+extern UINT16 CgBkExpand(FILE *fpContainer, FILE **ppImage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _INC_CGBKUP
+#endif
@@ -29,6 +29,12 @@
  *
  * $Log:   S:/CG/archives/CGTOOLS/CGUTIL/CGUTLCMN/cgbmod.h-arc  $
  * 
+ * MOD006: Added CgMpfaGetFreeSpace.
+ * 
+ * MOD005: Added the dirty map of the section buffers (CgMpfaMarkDirty).
+ * 
+ * MOD004: Section info is kept per thread (CG_TLS).
+ * 
  *    Rev 1.7   Sep 08 2016 09:53:04   congatec
  * MOD003: Adapted for correct Linux build.
  * 
@@ -238,6 +244,9 @@ typedef struct
 //+---------------------------------------------------------------------------
 //       MPFA module section info structure
 //+---------------------------------------------------------------------------
+// Granularity of the section dirty map											//MOD005
+#define CG_MPFA_DIRTY_SIZE  0x1000												//MOD005
+
 typedef struct
 {
         UINT32 sectionType;
@@ -246,6 +255,9 @@ typedef struct
         UINT32 physAccess;
         unsigned char *pSectionBuffer;
         UINT32 addIndex;
+        unsigned char *pDirtyMap;   // One entry per CG_MPFA_DIRTY_SIZE bytes of	//MOD005
+                                    // pSectionBuffer changed since the last load	//MOD005
+                                    // or apply. NULL: treat all as changed.		//MOD005
 } CG_MPFA_SECTION_INFO;
 
 
@@ -316,6 +328,10 @@ extern UINT16 CgMpfaSaveModule(CG_MPFA_MODULE_HEADER *pMpfaHeader,
                                        UINT32 nSearchFlags, 
                                        UINT32 nSaveFlags );
 extern UINT16 CgMpfaRebuildSection(CG_MPFA_SECTION_INFO *pSectionInfo);
+extern void CgMpfaMarkDirty(CG_MPFA_SECTION_INFO *pSectionInfo,				//MOD005
+                                    UINT32 nOffset,
+                                    UINT32 nSize);
+extern UINT32 CgMpfaGetFreeSpace(CG_MPFA_SECTION_INFO *pSectionInfo);			//MOD006
 UINT16 CgMpfaFindModule(CG_MPFA_SECTION_INFO *pSectionInfo, 
                                 CG_MPFA_MODULE_HEADER *pMpfaHeader,
                                 UINT32 nStartIndex,
@@ -339,11 +355,11 @@ extern UINT16 CgMpfaSetBUPInactive( _TCHAR* lpszPassword);
 //+---------------------------------------------------------------------------
 extern CG_MPFA_TYPE g_MpfaTypeList[];
 extern CG_MPFA_POST_HOOK g_MpfaPostHookList[];
-extern CG_MPFA_SECTION_INFO* g_MpfaSectionList[];
-extern CG_MPFA_SECTION_INFO CgMpfaStaticInfo;
-extern CG_MPFA_SECTION_INFO CgMpfaUserInfo;
-extern CG_MPFA_SECTION_INFO CgMpfaDynamicInfo;
-extern CG_MPFA_SECTION_INFO CgMpfaAllInfo;
+extern CG_TLS CG_MPFA_SECTION_INFO* g_MpfaSectionList[];					//MOD004 v
+extern CG_TLS CG_MPFA_SECTION_INFO CgMpfaStaticInfo;
+extern CG_TLS CG_MPFA_SECTION_INFO CgMpfaUserInfo;
+extern CG_TLS CG_MPFA_SECTION_INFO CgMpfaDynamicInfo;
+extern CG_TLS CG_MPFA_SECTION_INFO CgMpfaAllInfo;								//MOD004 ^
 
 extern UINT32 g_nNoMpfaTypes;
 extern UINT32 g_nNoPostHooks;
@@ -73,8 +73,8 @@
  */
 
 extern UINT16 g_nOperationTarget;
-extern HCGOS hCgos;
-extern FILE *g_fpBiosRomfile;
+extern CG_TLS HCGOS hCgos;
+extern CG_TLS FILE *g_fpBiosRomfile;
 extern _TCHAR *g_lpszBiosFilename;
 
 /*--------------------
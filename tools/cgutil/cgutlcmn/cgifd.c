@@ -0,0 +1,241 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Intel SPI flash descriptor (IFD) parser.
+ *           Decodes the flash region layout of a flash contents buffer or of
+ *           the flash part. The flash part descriptor is read once with a
+ *           single storage area access and kept for the rest of the session.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "biosflsh.h"
+#include "cgifd.h"
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+static CG_TLS CG_IFD_INFO CgIfdFlash;
+static CG_TLS UINT16 nIfdFlashState = 0xFFFF;		// 0xFFFF: not read yet, else result of parsing
+
+
+/*---------------------------------------------------------------------------
+ * Name: CgIfdParse
+ * Desc: Decodes the flash descriptor at the start of the given data.
+ *
+ *       - The descriptor signature is located at offset 0x10.
+ *       - Bits [23:16] of the flash map 0 register (FLMAP0) contain bits
+ *         [11:4] of the flash region base address (FRBA).
+ *       - The flash region registers FLREGx are located at FRBA + x*4.
+ *         Bits [14:0] hold bits [26:12] of the region base, bits [30:16]
+ *         hold bits [26:12] of the region limit.
+ *         A region with base bits [12:0] all set is unused.
+ *
+ * Inp:  pData          - Pointer to flash contents.
+ *       nDataSize      - Size of flash contents in bytes.
+ *       pIfd           - Pointer to storage for the decoded descriptor.
+ * Outp: return code:
+ *       CG_IFDRET_OK           - Success
+ *       CG_IFDRET_INVALID      - No valid flash descriptor found
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgIfdParse
+(
+    unsigned char *pData,
+    UINT32 nDataSize,
+    CG_IFD_INFO *pIfd
+)
+{
+    UINT32 i, data32;
+
+    memset(pIfd, 0, sizeof(CG_IFD_INFO));
+
+    if(nDataSize < CG_IFD_SIZE)
+    {
+        return CG_IFDRET_INVALID;
+    }
+
+    // Check flash descriptor signature
+    if(*((UINT32*)(pData + CG_IFD_SIGNATURE_OFFSET)) != FLASH_DESCRIPTOR_SIGNATURE)
+    {
+        return CG_IFDRET_INVALID;
+    }
+
+    // Get flash region base address
+    pIfd->flmap0 = *((UINT32*)(pData + FLMAP0_OFFSET));
+    pIfd->frba = (pIfd->flmap0 & 0x00FF0000) >> 12;
+
+    // Decode all flash region registers that are located within the descriptor
+    for(i = 0; i < CG_IFD_MAX_REGIONS; i++)
+    {
+        if((pIfd->frba + ((i + 1) * 4)) > CG_IFD_SIZE)
+        {
+            break;
+        }
+        data32 = *((UINT32*)(pData + pIfd->frba + (i * 4)));
+        pIfd->flreg[i] = data32;
+        pIfd->regionBase[i] = (data32 & 0x00007FFF) << 12;
+        pIfd->regionLimit[i] = (data32 & 0x7FFF0000) >> 4;
+
+        // Check whether region is used
+        if((data32 & 0x00001FFF) != 0x00001FFF)
+        {
+            pIfd->usedRegions |= (1 << i);
+        }
+    }
+    return CG_IFDRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgIfdGetFlash
+ * Desc: Provides the decoded flash descriptor of the flash part.
+ *       The descriptor is read from the extended storage area with a single
+ *       access on the first call. Later calls return the cached result until
+ *       CgIfdInvalidateFlash is called.
+ * Inp:  ppIfd          - Pointer to storage for the descriptor pointer.
+ * Outp: return code:
+ *       CG_IFDRET_OK           - Success
+ *       CG_IFDRET_INVALID      - No valid flash descriptor found
+ *       CG_IFDRET_INTRF_ERROR  - Failed to read flash descriptor
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgIfdGetFlash
+(
+    CG_IFD_INFO **ppIfd
+)
+{
+    unsigned char *pDescriptor;
+
+    if(nIfdFlashState == 0xFFFF)
+    {
+        pDescriptor = (unsigned char*)malloc(CG_IFD_SIZE);
+        if(!pDescriptor)
+        {
+            return CG_IFDRET_INTRF_ERROR;
+        }
+        if(!CgBfStorageRead(CG32_STORAGE_MPFA_EXTD, 0, pDescriptor, CG_IFD_SIZE))
+        {
+            // If we cannot read at all, we might only face a flash unlock issue.
+            // Do not cache this result, a later attempt may succeed.
+            free(pDescriptor);
+            return CG_IFDRET_INTRF_ERROR;
+        }
+        nIfdFlashState = CgIfdParse(pDescriptor, CG_IFD_SIZE, &CgIfdFlash);
+        free(pDescriptor);
+    }
+    *ppIfd = &CgIfdFlash;
+    return nIfdFlashState;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgIfdInvalidateFlash
+ * Desc: Discards the cached flash part descriptor, e.g. after the descriptor
+ *       region has been written.
+ * Inp:  None
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+void CgIfdInvalidateFlash(void)
+{
+    nIfdFlashState = 0xFFFF;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgIfdGetRegion
+ * Desc: Returns base and limit of a flash region.
+ * Inp:  pIfd           - Pointer to decoded descriptor.
+ *       nRegion        - Flash region number (CG_IFD_REGION_xxx).
+ *       pBase          - Pointer to storage for region base (may be NULL).
+ *       pLimit         - Pointer to storage for region limit, i.e. address
+ *                        of the last 4k block of the region (may be NULL).
+ * Outp: return code:
+ *       CG_IFDRET_OK           - Success
+ *       CG_IFDRET_UNUSED       - Region not used
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgIfdGetRegion
+(
+    CG_IFD_INFO *pIfd,
+    UINT32 nRegion,
+    UINT32 *pBase,
+    UINT32 *pLimit
+)
+{
+    if((nRegion >= CG_IFD_MAX_REGIONS) || (!(pIfd->usedRegions & (1 << nRegion))))
+    {
+        return CG_IFDRET_UNUSED;
+    }
+    if(pBase != NULL)
+    {
+        *pBase = pIfd->regionBase[nRegion];
+    }
+    if(pLimit != NULL)
+    {
+        *pLimit = pIfd->regionLimit[nRegion];
+    }
+    return CG_IFDRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgIfdGetRegionMask
+ * Desc: Returns the used flash regions that overlap with the given address
+ *       range of the flash part.
+ * Inp:  pIfd           - Pointer to decoded descriptor.
+ *       nOffset        - Start address of range.
+ *       nSize          - Size of range in bytes.
+ * Outp: Bit mask of overlapping regions (bit n = flash region n).
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgIfdGetRegionMask
+(
+    CG_IFD_INFO *pIfd,
+    UINT32 nOffset,
+    UINT32 nSize
+)
+{
+    UINT32 i, nMask = 0;
+
+    for(i = 0; i < CG_IFD_MAX_REGIONS; i++)
+    {
+        if(!(pIfd->usedRegions & (1 << i)))
+        {
+            continue;
+        }
+        // The region limit is the address of the last 4k block of the region
+        if((pIfd->regionBase[i] < (nOffset + nSize)) &&
+           ((pIfd->regionLimit[i] + 0x1000) > nOffset))
+        {
+            nMask |= (1 << i);
+        }
+    }
+    return nMask;
+}
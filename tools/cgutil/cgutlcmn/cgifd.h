@@ -0,0 +1,84 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Intel SPI flash descriptor (IFD) parser definitions.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+#ifndef _INC_CGIFD
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//----------------------------------
+// SPI flash descriptor definitions
+//----------------------------------
+#define CG_IFD_SIZE             0x1000  // Size of the descriptor region
+#define CG_IFD_SIGNATURE_OFFSET 0x10    // Offset of the descriptor signature
+#define CG_IFD_MAX_REGIONS      16      // Max. number of flash region registers (FLREG0-15)
+
+// Flash regions
+#define CG_IFD_REGION_DESC      0       // Flash descriptor
+#define CG_IFD_REGION_BIOS      1       // BIOS
+#define CG_IFD_REGION_ME        2       // Intel ME / CSE
+#define CG_IFD_REGION_GBE       3       // GbE
+#define CG_IFD_REGION_PDR       4       // Platform data
+#define CG_IFD_REGION_EC        8       // Embedded controller / BMC
+#define CG_IFD_REGION_LANCTRL0  11      // LAN CTRL 0 / NAC NIS
+#define CG_IFD_REGION_LANCTRL1  12      // LAN CTRL 1
+
+//-------------------------
+// IFD parser return codes
+//-------------------------
+#define CG_IFDRET_OK            0x00    // Success
+#define CG_IFDRET_INVALID       0x01    // No valid flash descriptor
+#define CG_IFDRET_INTRF_ERROR   0x02    // Interface access error
+#define CG_IFDRET_UNUSED        0x03    // Flash region not used
+
+//-------------------------
+// Decoded flash descriptor
+//-------------------------
+typedef struct {
+    UINT32 flmap0;                              // Flash map 0 register
+    UINT32 frba;                                // Flash region base address
+    UINT32 flreg[CG_IFD_MAX_REGIONS];           // Raw flash region registers
+    UINT32 regionBase[CG_IFD_MAX_REGIONS];      // Region base address
+    UINT32 regionLimit[CG_IFD_MAX_REGIONS];     // Region limit (address of last 4k block of region)
+    UINT32 usedRegions;                         // Bit mask of used regions
+} CG_IFD_INFO;
+
+//---------------------
+// Function prototypes
+//---------------------
+extern UINT16 CgIfdParse(unsigned char *pData, UINT32 nDataSize, CG_IFD_INFO *pIfd);
+extern UINT16 CgIfdGetFlash(CG_IFD_INFO **ppIfd);
+extern void CgIfdInvalidateFlash(void);
+extern UINT16 CgIfdGetRegion(CG_IFD_INFO *pIfd, UINT32 nRegion, UINT32 *pBase, UINT32 *pLimit);
+extern UINT32 CgIfdGetRegionMask(CG_IFD_INFO *pIfd, UINT32 nOffset, UINT32 nSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _INC_CGIFD
+#endif
@@ -29,6 +29,37 @@
  *
  * $Log:   S:/CG/archives/CGTOOLS/CGUTIL/CGUTLCMN/CGMPFA.C-arc  $
  * 
+ * MOD020: Report the free space of a section including the free gaps (CgMpfaGetFreeSpace).
+ * 
+ * MOD019: Invalidate the cached flash digests of the BIOS update before writing the sections.
+ * 
+ * MOD018: Modules keep their place in the section. Deleted modules remain as gaps that
+ *         new modules fill best fit. A section is only compacted if the gaps exceed
+ *         CG_MPFA_COMPACT_THRESHOLD or a module does not fit otherwise.
+ * 
+ * MOD017: Keep a dirty map of the section buffers (CgMpfaMarkDirty). Applying changes to
+ *         the board skips section blocks that have not been changed.
+ * 
+ * MOD016: Only verify the section blocks written when applying changes to the board.
+ *         Retries only process the blocks that failed.
+ * 
+ * MOD015: Compare each section block with one bulk read (CheckSectionBlock) and only
+ *         write the changed range of blocks that need no erase.
+ * 
+ * MOD014: Access the flash through the selected storage backend (CGOS or Linux MTD).
+ * 
+ * MOD013: Keep the section info and BIOS info per thread to modify several boards in
+ *         parallel. The section list is set up by CgMpfaCreateSectionInfo.
+ * 
+ * MOD012: Release the flash snapshot before changes are applied, as it would become stale.
+ * 
+ * MOD011: Read the sections with the tuned read size instead of the erase block size.
+ * 
+ * MOD010: Poll the erase status with a timeout instead of a fixed delay after each erase.
+ * 
+ * MOD009: Current setup settings are located in the dynamic, default setup settings in
+ *         the static section.
+ * 
  *    Rev 1.18   Sep 07 2016 12:29:38   congatec
  * Fix type conversion warnings.
  * 
@@ -114,6 +145,8 @@
 #include "amiimage.h"
 #endif
 #include "dmstobin.h"															//MOD008
+#include "biosflsh.h"															//MOD010
+#include "cgstore.h"															//MOD014
 #include <math.h>																//MOD008
 
 /*--------------
@@ -122,8 +155,8 @@
  */
 
 extern UINT16 g_nOperationTarget;
-extern HCGOS hCgos;
-extern FILE *g_fpBiosRomfile;
+extern CG_TLS HCGOS hCgos;
+extern CG_TLS FILE *g_fpBiosRomfile;
 extern _TCHAR *g_lpszBiosFilename;
 extern UINT16 CheckEdid13Data(unsigned char *pbDataBuffer,UINT32 ulDataSize);
 
@@ -133,6 +166,13 @@ extern UINT16 CheckEdid13Data(unsigned char *pbDataBuffer,UINT32 ulDataSize);
  */
 #define CG_MPFA_RTC_SKIP_SIZE   16      // 16 bytes of RTC data can be skipped in CMOS maps
 #define MAX_MODULE_FLASH_RETRIES	10	// Max. retries when trying to update parts o the flash MOD002
+#define CG_MPFA_COMPACT_THRESHOLD	50	// Compact a section if more than x% of it are free gaps MOD018
+
+/*---------------------------
+ * Local function prototypes
+ *---------------------------
+ */
+static UINT16 UpdateSectionLayout(CG_MPFA_SECTION_INFO *pSectionInfo, UINT16 bCompact);	//MOD018
 
 /*------------------
  * Global variables
@@ -221,47 +261,48 @@ CG_MPFA_POST_HOOK g_MpfaPostHookList[] =   {
 {CG_MPFA_POST_SETUP_EXTENSION,  "Load/execute as setup screen extension.",      "SETUP_EXTENSION"},
 {CG_MPFA_POST_BEFORE_BOOT,      "Load/execute at end of BIOS POST.",            "BEFORE_BOOT"}};
 
-CG_MPFA_SECTION_INFO CgMpfaStaticInfo = {CG_MPFA_STATIC,
+CG_TLS CG_MPFA_SECTION_INFO CgMpfaStaticInfo = {CG_MPFA_STATIC,
                                                 0,
                                                 0,
                                                 CG32_STORAGE_MPFA_STATIC,
                                                 NULL,
-                                                0xFFFFFFFF};
+                                                0xFFFFFFFF,
+                                                NULL};							//MOD017
 
-CG_MPFA_SECTION_INFO CgMpfaUserInfo =   {CG_MPFA_USER,
+CG_TLS CG_MPFA_SECTION_INFO CgMpfaUserInfo =   {CG_MPFA_USER,
                                                 0,
                                                 0,
                                                 CG32_STORAGE_FLASH,
                                                 NULL,
-                                                0xFFFFFFFF};
+                                                0xFFFFFFFF,
+                                                NULL};							//MOD017
 
-CG_MPFA_SECTION_INFO CgMpfaDynamicInfo ={CG_MPFA_DYNAMIC,
+CG_TLS CG_MPFA_SECTION_INFO CgMpfaDynamicInfo ={CG_MPFA_DYNAMIC,
                                                 0,
                                                 0,
                                                 CG32_STORAGE_MPFA_DYNAMIC,
                                                 NULL,
-                                                0xFFFFFFFF};
+                                                0xFFFFFFFF,
+                                                NULL};							//MOD017
 
-CG_MPFA_SECTION_INFO CgMpfaAllInfo =    {CG_MPFA_ALL,
+CG_TLS CG_MPFA_SECTION_INFO CgMpfaAllInfo =    {CG_MPFA_ALL,
                                                 0,
                                                 0,
                                                 CG32_STORAGE_MPFA_ALL,
                                                 NULL,
-                                                0xFFFFFFFF};
+                                                0xFFFFFFFF,
+                                                NULL};							//MOD017
 																				//MOD001 v
-CG_MPFA_SECTION_INFO CgMpfaExtdInfo =    {CG_MPFA_EXTD,
+CG_TLS CG_MPFA_SECTION_INFO CgMpfaExtdInfo =    {CG_MPFA_EXTD,
                                                 0,
                                                 0,
                                                 CG32_STORAGE_MPFA_EXTD,
                                                 NULL,
-                                                0xFFFFFFFF};
+                                                0xFFFFFFFF,
+                                                NULL};							//MOD017
 																				// MOD001 ^
-CG_MPFA_SECTION_INFO* g_MpfaSectionList[] = {
-		&CgMpfaExtdInfo,		//MUST BE FIRST ENTRY TO EASE OUTPUT CREATION IN ROMFILE MODE !	//MOD001
-        &CgMpfaAllInfo,																			//MOD001		
-        &CgMpfaDynamicInfo,
-        &CgMpfaStaticInfo,
-        &CgMpfaUserInfo};
+// Section info is kept per thread. The list is set up by CgMpfaCreateSectionInfo.	//MOD013
+CG_TLS CG_MPFA_SECTION_INFO* g_MpfaSectionList[CG_MPFA_SECTION_COUNT];		//MOD013
 
 UINT32 g_nNoMpfaTypes = sizeof g_MpfaTypeList / sizeof g_MpfaTypeList[0];
 UINT32 g_nNoPostHooks = sizeof g_MpfaPostHookList / sizeof g_MpfaPostHookList[0];
@@ -290,7 +331,9 @@ static CG_MPFA_MODULE_HEADER localMpfaHdr = {CG_MPFA_MOD_HDR_ID,     //hdrID
                                                 0                       //modChecksum
                                                 };   
 // Storage location for BIOS information
-CG_BIOS_INFO CgMpfaBiosInfo = {0};
+CG_TLS CG_BIOS_INFO CgMpfaBiosInfo = {0};				//MOD013
+// Blocks of each section written by ApplyChangesToCgos and not yet verified	//MOD016
+static CG_TLS unsigned char *pMpfaWrittenBlocks[CG_MPFA_SECTION_COUNT];		//MOD016
 
 																				//MOD008 v
 /*---------------------------------------------------------------------------
@@ -530,6 +573,7 @@ UINT16 CgMpfaSetOEMBiosVersion( _TCHAR* lpszBiosVersion)
         // (we simply use modLoadAddr and modEntryOff fields which are not used by the ROOT module)
         ((CG_MPFA_MODULE_HEADER *)pTempSectionBuffer)->modLoadAddr = *((UINT32 *)lpszBiosVersion);
         ((CG_MPFA_MODULE_HEADER *)pTempSectionBuffer)->modEntryOff = *((UINT32 *)lpszBiosVersion + 1);    
+        CgMpfaMarkDirty(&CgMpfaStaticInfo, nFoundIndex, sizeof(localMpfaHdr));	//MOD017
     }
     else
     {
@@ -685,27 +729,27 @@ UINT16 CgMpfaGetBiosInfoFlash(void)
     UINT32 nFlashSize, nIndex;
    
     // Get flash size 
-    if((nFlashSize = CgosStorageAreaSize(hCgos, CG32_STORAGE_MPFA_ALL)) < 1)
+    if((nFlashSize = CgStoreSize(CG32_STORAGE_MPFA_ALL)) < 1)	//MOD014
     {
         return CG_MPFARET_ERROR; 
     }
     nIndex = 0;
     while(nIndex < nFlashSize)
     {
-        if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo.infoIDLow, sizeof(CgMpfaBiosInfo.infoIDLow)))
+        if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo.infoIDLow, sizeof(CgMpfaBiosInfo.infoIDLow)))	//MOD014
         {
             return CG_MPFARET_ERROR;
         }
         else if(CgMpfaBiosInfo.infoIDLow == CG_SYS_BIOS_INFO_ID_L)
         {
-            if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgMpfaBiosInfo.infoIDLow), (unsigned char*)&CgMpfaBiosInfo.infoIDHigh, sizeof(CgMpfaBiosInfo.infoIDHigh)))
+            if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgMpfaBiosInfo.infoIDLow), (unsigned char*)&CgMpfaBiosInfo.infoIDHigh, sizeof(CgMpfaBiosInfo.infoIDHigh)))	//MOD014
             {
                 return CG_MPFARET_ERROR;
             }
             else if(CgMpfaBiosInfo.infoIDHigh == CG_SYS_BIOS_INFO_ID_H)
             {
                 // BIOS info structure found, now copy whole structure
-                if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo, sizeof(CgMpfaBiosInfo)))
+                if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo, sizeof(CgMpfaBiosInfo)))	//MOD014
                 {
                     return CG_MPFARET_ERROR;
                 }
@@ -728,20 +772,20 @@ UINT16 CgMpfaGetBiosInfoFlash(void)
         nIndex = 0;
         while(nIndex < nFlashSize)
         {
-            if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo.infoIDLow, sizeof(CgMpfaBiosInfo.infoIDLow)))
+            if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo.infoIDLow, sizeof(CgMpfaBiosInfo.infoIDLow)))	//MOD014
             {
                 return CG_MPFARET_ERROR;
             }
             else if(CgMpfaBiosInfo.infoIDLow == CG_SYS_BIOS_INFO_ID_L)
             {
-                if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgMpfaBiosInfo.infoIDLow), (unsigned char*)&CgMpfaBiosInfo.infoIDHigh, sizeof(CgMpfaBiosInfo.infoIDHigh)))
+                if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex + sizeof(CgMpfaBiosInfo.infoIDLow), (unsigned char*)&CgMpfaBiosInfo.infoIDHigh, sizeof(CgMpfaBiosInfo.infoIDHigh)))	//MOD014
                 {
                     return CG_MPFARET_ERROR;
                 }
                 else if(CgMpfaBiosInfo.infoIDHigh == CG_SYS_BIOS_INFO_ID_H)
                 {
                     // BIOS info structure found, now copy whole structure
-                    if(!CgosStorageAreaRead(hCgos, CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo, sizeof(CgMpfaBiosInfo)))
+                    if(!CgStoreRead(CG32_STORAGE_MPFA_ALL, nIndex, (unsigned char*)&CgMpfaBiosInfo, sizeof(CgMpfaBiosInfo)))	//MOD014
                     {
                         return CG_MPFARET_ERROR;
                     }
@@ -1272,7 +1316,7 @@ static UINT16 DeriveSectionInfoFromCgos(void)
 		pTempInfo = g_MpfaSectionList[i];
 		if(pTempInfo->sectionType != CG_MPFA_EXTD)								//MOD001
 		{																		//MOD001 
-			pTempInfo->sectionSize = CgosStorageAreaSize(hCgos, pTempInfo->physAccess); 
+			pTempInfo->sectionSize = CgStoreSize(pTempInfo->physAccess);	//MOD014
 			//GWETODO: FIX after CGOS driver is fixed to return correct blocksize pTempInfo->sectionBlockSize = (CgosStorageAreaBlockSize(hCgos, pTempInfo->physAccess))*1024; 
 			pTempInfo->sectionBlockSize = 64 * 1024;//GWETODO
 		}																		//MOD001
@@ -1391,6 +1435,12 @@ static UINT16 DeriveSectionInfoFromRomfile(void)
  */
 UINT16 CgMpfaCreateSectionInfo(void)
 {
+    g_MpfaSectionList[0] = &CgMpfaExtdInfo;	//MUST BE FIRST ENTRY TO EASE OUTPUT CREATION IN ROMFILE MODE !	//MOD001 //MOD013 v
+    g_MpfaSectionList[1] = &CgMpfaAllInfo;																	//MOD001
+    g_MpfaSectionList[2] = &CgMpfaDynamicInfo;
+    g_MpfaSectionList[3] = &CgMpfaStaticInfo;
+    g_MpfaSectionList[4] = &CgMpfaUserInfo;																	//MOD013 ^
+
     if(g_nOperationTarget == OT_ROMFILE)
     {
         return (DeriveSectionInfoFromRomfile());
@@ -1415,7 +1465,7 @@ UINT16 CgMpfaCreateSectionInfo(void)
  */
 UINT16 CgMpfaBufferInit(UINT16 bIncMPFA_ALL)
 {
-    UINT32 i,nTransfered;
+    UINT32 i;
     CG_MPFA_SECTION_INFO* pTempInfo;
 
     for(i= 0; i < g_nNoMpfaSections; i++)
@@ -1446,20 +1496,26 @@ UINT16 CgMpfaBufferInit(UINT16 bIncMPFA_ALL)
                 {
                     return CG_MPFARET_ERROR;
                 }
-                nTransfered = 0;
-		        do
+                // Read section with the tuned read size, not the erase block size		//MOD011
+                if(!CgBfStorageRead(pTempInfo->physAccess, 0, pTempInfo->pSectionBuffer, pTempInfo->sectionSize))	//MOD011
                 {
-                    if(!CgosStorageAreaRead(hCgos, pTempInfo->physAccess, nTransfered, pTempInfo->pSectionBuffer + nTransfered, pTempInfo->sectionBlockSize))
-                    {
-                        //PRINTF("ERROR:Failed to read %X bytes from MPFA section %X\n",pTempInfo->sectionSize,pTempInfo->physAccess ); 
-                        return CG_MPFARET_ERROR;        
-                    }
-                    nTransfered = nTransfered + pTempInfo->sectionBlockSize;
-                }while(nTransfered < pTempInfo->sectionSize);
+                    //PRINTF("ERROR:Failed to read %X bytes from MPFA section %X\n",pTempInfo->sectionSize,pTempInfo->physAccess ); 
+                    return CG_MPFARET_ERROR;        
+                }
             }
+            // The buffer matches the flash now, so nothing is dirty yet.		//MOD017 v
+            // Changes of the following rebuild are already recorded.
+            if(pTempInfo->pSectionBuffer != NULL)
+            {
+                pTempInfo->pDirtyMap = (unsigned char*)calloc((pTempInfo->sectionSize + CG_MPFA_DIRTY_SIZE - 1) / CG_MPFA_DIRTY_SIZE, 1);
+                if(pTempInfo->pDirtyMap == NULL)
+                {
+                    return CG_MPFARET_ERROR;
+                }
+            }																	//MOD017 ^
             if((pTempInfo->sectionType == CG_MPFA_STATIC) || (pTempInfo->sectionType == CG_MPFA_DYNAMIC))
             {
-                if(CgMpfaRebuildSection(pTempInfo) != CG_MPFARET_OK)
+                if(UpdateSectionLayout(pTempInfo, TRUE) != CG_MPFARET_OK)		//MOD018
                 {
                     // PRINTF("ERROR: Failed to rebuild MPFA section %X\n",pTempInfo->sectionType ); 
                     return CG_MPFARET_ERROR;        
@@ -1492,6 +1548,11 @@ UINT16 CgMpfaBufferCleanup(void)
             free(pTempInfo->pSectionBuffer);  
             pTempInfo->pSectionBuffer = NULL;
         }
+        if(pTempInfo->pDirtyMap != NULL)											//MOD017 v
+        {
+            free(pTempInfo->pDirtyMap);
+            pTempInfo->pDirtyMap = NULL;
+        }																		//MOD017 ^
     }
     return CG_MPFARET_OK;
 }
@@ -1545,10 +1606,182 @@ static UINT16 ApplyChangesToRomfile(void)
     }
     return CG_MPFARET_OK;
 }
+/*---------------------------------------------------------------------------
+ * Name: GetMaxSectionBlockSize
+ * Desc: Returns the largest block size of all MPFA sections.
+ * Inp:  none
+ * Outp: Block size in bytes.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 GetMaxSectionBlockSize(void)										//MOD016
+{
+    UINT32 nSectionCount, nBlockSize = 0;
+
+    for(nSectionCount=0; nSectionCount < g_nNoMpfaSections; nSectionCount++)
+    {
+        if(g_MpfaSectionList[nSectionCount]->sectionBlockSize > nBlockSize)
+        {
+            nBlockSize = g_MpfaSectionList[nSectionCount]->sectionBlockSize;
+        }
+    }
+    return nBlockSize;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: FreeWrittenBlocks
+ * Desc: Releases the written block lists of ApplyChangesToCgos.
+ * Inp:  none
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+static void FreeWrittenBlocks(void)												//MOD016
+{
+    UINT32 nSectionCount;
+
+    for(nSectionCount=0; nSectionCount < CG_MPFA_SECTION_COUNT; nSectionCount++)
+    {
+        if(pMpfaWrittenBlocks[nSectionCount] != NULL)
+        {
+            free(pMpfaWrittenBlocks[nSectionCount]);
+            pMpfaWrittenBlocks[nSectionCount] = NULL;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgMpfaMarkDirty
+ * Desc: Records a change of the section buffer in the section dirty map.
+ *       Must be called by every function that modifies a section buffer.
+ * Inp:  pSectionInfo   - Pointer to information block of changed section
+ *       nOffset        - Offset of the change in the section buffer
+ *       nSize          - Size of the change in bytes
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgMpfaMarkDirty															//MOD017
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 nOffset,
+    UINT32 nSize
+)
+{
+    UINT32 nEnd;
+
+    if((pSectionInfo->pDirtyMap == NULL) || (nSize == 0) || (nOffset >= pSectionInfo->sectionSize))
+    {
+        return;
+    }
+    nEnd = nOffset + nSize;
+    if((nEnd > pSectionInfo->sectionSize) || (nEnd < nOffset))
+    {
+        nEnd = pSectionInfo->sectionSize;
+    }
+    memset(pSectionInfo->pDirtyMap + (nOffset / CG_MPFA_DIRTY_SIZE), TRUE,
+           ((nEnd - 1) / CG_MPFA_DIRTY_SIZE) - (nOffset / CG_MPFA_DIRTY_SIZE) + 1);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: IsSectionBlockDirty
+ * Desc: Checks the section dirty map for changes within a section block.
+ * Inp:  pSectionInfo   - Pointer to section information block
+ *       nOffset        - Offset of the block in the section
+ * Outp: TRUE if the block holds changes (or no dirty map exists), else FALSE
+ *---------------------------------------------------------------------------
+ */
+static UINT16 IsSectionBlockDirty												//MOD017
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 nOffset
+)
+{
+    UINT32 i;
+
+    if(pSectionInfo->pDirtyMap == NULL)
+    {
+        return TRUE;
+    }
+    for(i = nOffset / CG_MPFA_DIRTY_SIZE; i <= (nOffset + pSectionInfo->sectionBlockSize - 1) / CG_MPFA_DIRTY_SIZE; i++)
+    {
+        if(pSectionInfo->pDirtyMap[i])
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: ClearDirtyMaps
+ * Desc: Resets the dirty maps of all sections after the changes have been
+ *       applied and verified.
+ * Inp:  none
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+static void ClearDirtyMaps(void)												//MOD017
+{
+    UINT32 nSectionCount;
+    CG_MPFA_SECTION_INFO* pTempInfo;
+
+    for(nSectionCount=0; nSectionCount < g_nNoMpfaSections; nSectionCount++)
+    {
+        pTempInfo = g_MpfaSectionList[nSectionCount];
+        if(pTempInfo->pDirtyMap != NULL)
+        {
+            memset(pTempInfo->pDirtyMap, 0, (pTempInfo->sectionSize + CG_MPFA_DIRTY_SIZE - 1) / CG_MPFA_DIRTY_SIZE);
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CheckSectionBlock
+ * Desc: Compares the flash contents of a section block with the buffer
+ *       contents and determines the required update (CgBfCheckBlock) and
+ *       the changed range of the block.
+ * Inp:  pFlashData     - Pointer to current flash block contents.
+ *       pNewData       - Pointer to new block contents.
+ *       nSize          - Block size in bytes (DWORD aligned).
+ *       pStart         - Pointer to storage for offset of first changed DWORD.
+ *       pEnd           - Pointer to storage for end offset of last changed DWORD.
+ * Outp: block state (CG_BFBLK_xxx)
+ *---------------------------------------------------------------------------
+ */
+static UINT32 CheckSectionBlock													//MOD015
+(
+    unsigned char *pFlashData,
+    unsigned char *pNewData,
+    UINT32 nSize,
+    UINT32 *pStart,
+    UINT32 *pEnd
+)
+{
+    UINT32 nState;
+
+    *pStart = 0;
+    *pEnd = nSize;
+    nState = CgBfCheckBlock(pFlashData, pNewData, nSize);
+    if(nState == CG_BFBLK_PROGRAM)
+    {
+        while(*((UINT32*)(pNewData + *pStart)) == *((UINT32*)(pFlashData + *pStart)))
+        {
+            *pStart = *pStart + 4;
+        }
+        while(*((UINT32*)(pNewData + *pEnd - 4)) == *((UINT32*)(pFlashData + *pEnd - 4)))
+        {
+            *pEnd = *pEnd - 4;
+        }
+    }
+    return nState;
+}
+
 /*---------------------------------------------------------------------------
  * Name: ApplyChangesToCgos
  * Desc: Apply changes to target board using CGOS interface.
- * Inp:  none
+ *       The written blocks are recorded for VerifyChangesToCgos.
+ *       MOD017: Blocks without an entry in the section dirty map are
+ *       skipped without reading the flash.
+ * Inp:  bFailedOnly    - TRUE: only process the blocks that failed
+ *                        verification (MOD016)
  * Outp: return code:
  *       CG_MPFARET_INTRF_ERROR  - Interface access error 
  *       CG_MPFARET_ERROR        - Execution error
@@ -1561,137 +1794,138 @@ static UINT16 ApplyChangesToRomfile(void)
 // and in case of a failure here a complete module area update re-processing.
 // 
 
-static UINT16 ApplyChangesToCgos(void)
+static UINT16 ApplyChangesToCgos(UINT16 bFailedOnly)								//MOD016
 {
-    UINT32 nSectionCount, j, k, nWriteStart, nWriteEnd, nRetryCount;
-    UINT32 *pBufferData , flashData, *pFlashData;
+    UINT32 nSectionCount, k, nBlockSize, nRetryCount;
+    UINT32 nBlockState, nWriteStart, nWriteEnd;									//MOD015
+    unsigned char *pFlashBlock;													//MOD015
     CG_MPFA_SECTION_INFO* pTempInfo;
-    UINT16 bStartFound, bEraseError, bWriteError, bForceErase;
+    UINT16 bEraseError, bWriteError;
 	
 
-    pFlashData = &flashData;
-
     if (!hCgos)
     {
         return CG_MPFARET_ERROR;
     }
+    // The sections are part of a flash snapshot that might be held		//MOD012
+    CgBfSnapshotFree();														//MOD012
+
+    // Buffer for the current flash contents of one section block			//MOD015 v
+    nBlockSize = GetMaxSectionBlockSize();										//MOD016
+    if((nBlockSize == 0) || ((pFlashBlock = (unsigned char*)malloc(nBlockSize)) == NULL))
+    {
+        return CG_MPFARET_ERROR;
+    }																			//MOD015 ^
+    if(!bFailedOnly)															//MOD016 v
+    {
+        FreeWrittenBlocks();
+    }																			//MOD016 ^
   
 	//
 	// Check each MPFA section whether an update is required, i.e. the current buffer contents of
 	// that the utility holds for each section is different to the original flash contents.
 	// CG_MPFA_ALL and CG_MPFA_EXTD sections are excluded, as they are only relevant for complete
 	// BIOS flash updates.
-	// The handler compares buffer and flash byte by byte (or DWORD by DWORD) and indicates that 
-	// at least a section block update is required when one mismatch is found.
+	// MOD015: Each section block is read at once and compared with the buffer in memory
+	// (CgBfCheckBlock). Blocks that match are skipped.
 	// In order to improve performance, the handler also checks whether the flash really has
 	// to be erased or if the current buffer contents can be written without preceeding erasure
 	// of the flash block. This check is based on the assumption that on each flash a bit may be
-	// written from '1' to '0' any time.
+	// written from '1' to '0' any time. Only the changed range of such a block is written.
     for(nSectionCount=0; nSectionCount < g_nNoMpfaSections; nSectionCount++)
     {
-		bForceErase = FALSE;
         pTempInfo = g_MpfaSectionList[nSectionCount];
         if((pTempInfo->pSectionBuffer != NULL) && (pTempInfo->sectionType != CG_MPFA_ALL) && (pTempInfo->sectionType != CG_MPFA_EXTD))	//MOD001
         {
-SECTION_START:
-            k = 0;
-            bStartFound =FALSE;
-            pBufferData = (UINT32 *)pTempInfo->pSectionBuffer;
-            do
+            if((!bFailedOnly) && (pMpfaWrittenBlocks[nSectionCount] == NULL))	//MOD016 v
+            {
+                pMpfaWrittenBlocks[nSectionCount] = (unsigned char*)calloc(pTempInfo->sectionSize / pTempInfo->sectionBlockSize, 1);
+                if(pMpfaWrittenBlocks[nSectionCount] == NULL)
+                {
+                    free(pFlashBlock);
+                    return CG_MPFARET_ERROR;
+                }
+            }																	//MOD016 ^
+            for(k = 0; k < pTempInfo->sectionSize; k = k + pTempInfo->sectionBlockSize)	//MOD015 v
             {
-                for(j = k/4; j < ((k + (pTempInfo->sectionBlockSize -4))/4); j++)
+                // On retry only the blocks that failed verification are processed	//MOD016 v
+                if(bFailedOnly &&
+                   ((pMpfaWrittenBlocks[nSectionCount] == NULL) || (!pMpfaWrittenBlocks[nSectionCount][k / pTempInfo->sectionBlockSize])))
+                {
+                    continue;
+                }																//MOD016 ^
+                // Blocks without changes since the last load or apply still	//MOD017 v
+                // match the flash and are not read at all.
+                if((!bFailedOnly) && (!IsSectionBlockDirty(pTempInfo, k)))
+                {
+                    continue;
+                }																//MOD017 ^
+                if(!CgBfStorageRead(pTempInfo->physAccess, k, pFlashBlock, pTempInfo->sectionBlockSize))
                 {
-                    if(!CgosStorageAreaRead(hCgos,pTempInfo->physAccess, j*4, (unsigned char*) pFlashData, 4))
+                    free(pFlashBlock);
+                    return CG_MPFARET_ERROR;
+                }
+                nBlockState = CheckSectionBlock(pFlashBlock, (unsigned char *)(pTempInfo->pSectionBuffer + k), pTempInfo->sectionBlockSize, &nWriteStart, &nWriteEnd);
+                if(nBlockState == CG_BFBLK_EQUAL)
+                {
+                    continue;
+                }
+                pMpfaWrittenBlocks[nSectionCount][k / pTempInfo->sectionBlockSize] = TRUE;	//MOD016
+                if(nBlockState == CG_BFBLK_PROGRAM)
+                {
+                    // All the new data can be written without preceeding erasure of the block.
+                    if(CgStoreWrite(pTempInfo->physAccess, k + nWriteStart, (unsigned char *)(pTempInfo->pSectionBuffer + k + nWriteStart), nWriteEnd - nWriteStart))	//MOD014
                     {
-                        return CG_MPFARET_ERROR;
-                    }
-                    if( *(pBufferData +j) != *pFlashData)
-                    {                        
-                        if(bStartFound != TRUE)
-                        {
-                            nWriteStart = j*4;
-                            bStartFound = TRUE;
-                        }
-                        nWriteEnd = j*4;
+                        continue;
                     }
-
-					// Here we check whether the flash block really has to be erased to write the contents.
-					// E.g. in case everything is still FF in the flash anything can be written without erasing the block.
-                    *pFlashData = ~(*pFlashData);                                       
-                    if( (*(pBufferData +j) & (*pFlashData)) || bForceErase)
-                    {   
-						// New data cannot be written without erasing the block. So start block based
-						// erase and write sequence here.
-						
-						// First we can clear the bStartFound flag to indicate to the 'write only'
-						// handler below that it cannot do anything.
-						bStartFound = FALSE;	
-
-						nRetryCount = 0;
+                    // If something really went wrong during the write, it is very likely that
+                    // erasing the block is required to recover. A pure retry of the write is
+                    // likely to fail again. So fall through to the erase and write sequence.
+                }																//MOD015 ^
+
+				// New data cannot be written without erasing the block. So start block based
+				// erase and write sequence here.
+				nRetryCount = 0;
+				bEraseError = FALSE;
+				bWriteError = FALSE;
+
+				do
+				{
+					if((!CgStoreErase(pTempInfo->physAccess, k, pTempInfo->sectionBlockSize)) ||	//MOD014
+					   (CgBfWaitEraseDone(pTempInfo->physAccess, k, pTempInfo->sectionBlockSize) != CG_BFRET_OK))	//MOD010
+					{
+						bEraseError = TRUE;
+					}
+					else
+					{
 						bEraseError = FALSE;
-						bWriteError = FALSE;
-
-						do
+					}
+						                        
+					if(bEraseError == FALSE)	//No need to try writing if erasing of the block already failed
+					{
+						if(!CgStoreWrite(pTempInfo->physAccess, k, (unsigned char *)(pTempInfo->pSectionBuffer + k), pTempInfo->sectionBlockSize))	//MOD014
 						{
-							if(!CgosStorageAreaErase(hCgos, pTempInfo->physAccess, k, pTempInfo->sectionBlockSize))
-							{
-								bEraseError = TRUE;
-							}
-							else
-							{
-								bEraseError = FALSE;
-							}
-								                        
-							if(bEraseError == FALSE)	//No need to try writing if erasing of the block already failed
-							{
-			                    Sleep(20L);	//Add a little bit of extra security in case the BIOS erase routines don't. MOD002
-
-								if(!CgosStorageAreaWrite(hCgos, pTempInfo->physAccess, k, (unsigned char *)(pTempInfo->pSectionBuffer + k), pTempInfo->sectionBlockSize))
-								{
-									bWriteError = TRUE;
-								}
-								else
-								{
-									bWriteError = FALSE;
-								}
-							}
-							nRetryCount = nRetryCount + 1;
-						}while ( ((bEraseError==TRUE) || (bWriteError==TRUE)) && (nRetryCount < MAX_MODULE_FLASH_RETRIES) );
-
-						// Check whether (at least finally after all retries) erasing and writing of the block 
-						// was successful. If YES continue with  next section block, if NO exit with error.
-						if((bEraseError==TRUE) || (bWriteError==TRUE))
+							bWriteError = TRUE;
+						}
+						else
 						{
-							return CG_MPFARET_ERROR;
+							bWriteError = FALSE;
 						}
+					}
+					nRetryCount = nRetryCount + 1;
+				}while ( ((bEraseError==TRUE) || (bWriteError==TRUE)) && (nRetryCount < MAX_MODULE_FLASH_RETRIES) );
 
-                        break;  //No need to check this block any longer, so leave FOR loop and continue with next block!
-                    }
-                }
-                k = k + pTempInfo->sectionBlockSize;                    
-            } while (k < pTempInfo->sectionSize);
-
-            if(bStartFound == TRUE)
-            { 
-				// We only reach this point, if the code above has detected that a MPFA section  requires
-				// some new data, but all the data can be written without preceeding erasure of a section block.
-				// The code above also has gathered the start and the end address of the new data in the section.
-                if(!CgosStorageAreaWrite(hCgos, pTempInfo->physAccess, nWriteStart, (unsigned char *)(pTempInfo->pSectionBuffer + nWriteStart),(nWriteEnd - nWriteStart) +4))
-                {
-					// Handling an error in a 'write only' processing is a little bit tricky. 
-					// If something really went wrong during the write, it is very likely that at 
-					// least now erasing of section blocks might be required to recover. A pure
-					// retry of the write is likely to fail again. So we simply restart the loop
-					// using the deprecated GOTO instruction, but this time we force an erase sequence.
-					// The sequence that erases and write block by block of a section already includes
-					// a retry mechanism, so this write error should finally be handled.
-					bStartFound = FALSE;
-					bForceErase = TRUE;
-                    goto SECTION_START;
-                }      
+				// Check whether (at least finally after all retries) erasing and writing of the block 
+				// was successful. If YES continue with  next section block, if NO exit with error.
+				if((bEraseError==TRUE) || (bWriteError==TRUE))
+				{
+					free(pFlashBlock);											//MOD015
+					return CG_MPFARET_ERROR;
+				}
             }
         }
     }
+    free(pFlashBlock);															//MOD015
     return CG_MPFARET_OK;
 }
 //MOD002 ^                        
@@ -1700,6 +1934,9 @@ SECTION_START:
  * Name: VerifyChangesToCgos
  * Desc: Checks whether the current utility buffer contents for the MPFA 
  *       sections matches the actual flash contents.
+ *       MOD016: Only the blocks written by ApplyChangesToCgos are checked.
+ *       Blocks that match are removed from the written blocks, so that a
+ *       retry only processes the failing blocks.
  * Inp:  none
  * Outp: return code:
  *       CG_MPFARET_INTRF_ERROR  - Interface access error 
@@ -1709,48 +1946,58 @@ SECTION_START:
  */
 static UINT16 VerifyChangesToCgos(void)
 {
-    UINT32 nSectionCount, j, k;
-    UINT32 *pBufferData , flashData, *pFlashData;
+    UINT32 nSectionCount, k, nBlockSize;
+    unsigned char *pFlashBlock;													//MOD016
     CG_MPFA_SECTION_INFO* pTempInfo;
+    UINT16 retVal = CG_MPFARET_OK;												//MOD016
 
 
-    pFlashData = &flashData;
-
     if (!hCgos)
     {
         return CG_MPFARET_ERROR;
     }
+
+    nBlockSize = GetMaxSectionBlockSize();										//MOD016 v
+    if((nBlockSize == 0) || ((pFlashBlock = (unsigned char*)malloc(nBlockSize)) == NULL))
+    {
+        return CG_MPFARET_ERROR;
+    }																			//MOD016 ^
   
 	//
 	// Check each MPFA section whether the buffered section contents of the utility matches 
 	// the flash contents of the sections. CG_MPFA_ALL and CG_MPFA_EXTD sections are excluded, as they are only 
 	// relevant for complete BIOS flash updates.
-	// The handler compares buffer and flash byte by byte (or DWORD by DWORD).
+	// MOD016: Each written block is read at once and compared with the buffer.
     for(nSectionCount=0; nSectionCount < g_nNoMpfaSections; nSectionCount++)
     {
         pTempInfo = g_MpfaSectionList[nSectionCount];
-        if((pTempInfo->pSectionBuffer != NULL) && (pTempInfo->sectionType != CG_MPFA_ALL) && (pTempInfo->sectionType != CG_MPFA_EXTD))	//MOD001
+        if((pTempInfo->pSectionBuffer != NULL) && (pTempInfo->sectionType != CG_MPFA_ALL) && (pTempInfo->sectionType != CG_MPFA_EXTD) &&	//MOD001
+           (pMpfaWrittenBlocks[nSectionCount] != NULL))							//MOD016
         {
-            k = 0;
-            pBufferData = (UINT32 *)pTempInfo->pSectionBuffer;
-            do
+            for(k = 0; k < pTempInfo->sectionSize; k = k + pTempInfo->sectionBlockSize)	//MOD016 v
             {
-                for(j = k/4; j < ((k + (pTempInfo->sectionBlockSize -4))/4); j++)
+                if(!pMpfaWrittenBlocks[nSectionCount][k / pTempInfo->sectionBlockSize])
                 {
-                    if(!CgosStorageAreaRead(hCgos,pTempInfo->physAccess, j*4, (unsigned char*) pFlashData, 4))
-                    {
-                        return CG_MPFARET_ERROR;
-                    }
-                    if( *(pBufferData +j) != *pFlashData)
-                    {                        
-                        return CG_MPFARET_ERROR;
-                    }
+                    continue;
+                }
+                if(!CgBfStorageRead(pTempInfo->physAccess, k, pFlashBlock, pTempInfo->sectionBlockSize))
+                {
+                    free(pFlashBlock);
+                    return CG_MPFARET_ERROR;
+                }
+                if(memcmp(pFlashBlock, pTempInfo->pSectionBuffer + k, pTempInfo->sectionBlockSize) == 0)
+                {
+                    pMpfaWrittenBlocks[nSectionCount][k / pTempInfo->sectionBlockSize] = FALSE;
                 }
-                k = k + pTempInfo->sectionBlockSize;                    
-            } while (k < pTempInfo->sectionSize);
+                else
+                {
+                    retVal = CG_MPFARET_ERROR;
+                }
+            }																	//MOD016 ^
         }
     }
-    return CG_MPFARET_OK;
+    free(pFlashBlock);															//MOD016
+    return retVal;																//MOD016
 }
 //MOD002 ^                        
 /*---------------------------------------------------------------------------
@@ -1773,6 +2020,7 @@ UINT16 CgMpfaApplyChanges(UINT16 bRestart)
 //
     UINT16 retVal;
 	UINT32 nRetryCount;		
+	UINT16 bFailedOnly = FALSE;													//MOD016
 
 	nRetryCount = 0;				
 
@@ -1784,10 +2032,15 @@ UINT16 CgMpfaApplyChanges(UINT16 bRestart)
 		}
 		else if(g_nOperationTarget == OT_BOARD)
 		{
-			retVal = ApplyChangesToCgos();
+			CgBfDigestInvalidate();												//MOD019
+			retVal = ApplyChangesToCgos(bFailedOnly);							//MOD016
+			bFailedOnly = FALSE;												//MOD016
 			if(retVal == CG_MPFARET_OK)
 			{
 				retVal = VerifyChangesToCgos();
+				// Only retry the blocks that failed verification. After an apply	//MOD016 v
+				// error all blocks are checked again.
+				bFailedOnly = (retVal != CG_MPFARET_OK) ? TRUE : FALSE;			//MOD016 ^
 			}
 		}
 		else
@@ -1797,11 +2050,13 @@ UINT16 CgMpfaApplyChanges(UINT16 bRestart)
 		}
 		nRetryCount = nRetryCount + 1;
 	}while((nRetryCount < MAX_MODULE_FLASH_RETRIES) && (retVal != CG_MPFARET_OK));
+	FreeWrittenBlocks();														//MOD016
 //MOD002 ^
     if(retVal != CG_MPFARET_OK)
     {
         return retVal;
     }
+    ClearDirtyMaps();															//MOD017
     if(bRestart)
     {
         if ((retVal = CgMpfaEnd()) == CG_MPFARET_OK)
@@ -1814,6 +2069,283 @@ UINT16 CgMpfaApplyChanges(UINT16 bRestart)
 }
 
 
+/*---------------------------------------------------------------------------
+ * Name: GetSectionModuleSize
+ * Desc: Checks for a valid module entry at the given section index.
+ * Inp:  pSectionInfo   - Pointer to section information block
+ *       nIndex         - Index of the module in the section
+ * Outp: Module size in bytes, 0 if there is no valid module entry.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 GetSectionModuleSize												//MOD018
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 nIndex
+)
+{
+    CG_MPFA_MODULE_HEADER *pHeader;
+    UINT32 nSize;
+
+    if((nIndex + sizeof(localMpfaHdr) + sizeof(localMpfaEnd)) > pSectionInfo->sectionSize)
+    {
+        return 0;
+    }
+    pHeader = (CG_MPFA_MODULE_HEADER *)(pSectionInfo->pSectionBuffer + nIndex);
+    nSize = pHeader->modSize;
+    if((pHeader->hdrID != CG_MPFA_MOD_HDR_ID) || (nSize & 0x00000003) ||
+       (nSize < sizeof(localMpfaHdr) + sizeof(localMpfaEnd)) || (nSize > pSectionInfo->sectionSize - nIndex))
+    {
+        return 0;
+    }
+    if(((CG_MPFA_MODULE_END *)(pSectionInfo->pSectionBuffer + nIndex + nSize - sizeof(localMpfaEnd)))->endID != CG_MPFA_MOD_END_ID)
+    {
+        return 0;
+    }
+    return nSize;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: IsFreeSectionModule
+ * Desc: Checks whether a module entry only occupies free space, i.e. it is
+ *       not used or it is a PAD module that does not align a following
+ *       firmware volume module.
+ * Inp:  pSectionInfo   - Pointer to section information block
+ *       nIndex         - Index of a valid module entry in the section
+ * Outp: TRUE if the module entry is free space, else FALSE
+ *---------------------------------------------------------------------------
+ */
+static UINT16 IsFreeSectionModule												//MOD018
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 nIndex
+)
+{
+    CG_MPFA_MODULE_HEADER *pHeader;
+    UINT32 nNextIndex;
+
+    pHeader = (CG_MPFA_MODULE_HEADER *)(pSectionInfo->pSectionBuffer + nIndex);
+    if(!(pHeader->modFlags & CG_MOD_ENTRY_USED))
+    {
+        return TRUE;
+    }
+    if(pHeader->modType != CG_MPFA_TYPE_PAD)
+    {
+        return FALSE;
+    }
+    nNextIndex = nIndex + pHeader->modSize;
+    if((GetSectionModuleSize(pSectionInfo, nNextIndex) != 0) &&
+       (((CG_MPFA_MODULE_HEADER *)(pSectionInfo->pSectionBuffer + nNextIndex))->modFlags & CG_MOD_ENTRY_USED) &&
+       (((CG_MPFA_MODULE_HEADER *)(pSectionInfo->pSectionBuffer + nNextIndex))->modType == CG_MPFA_TYPE_FIRMWARE_VOLUME))
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: ScanSectionLayout
+ * Desc: Walks the module chain of a section.
+ * Inp:  pSectionInfo   - Pointer to section information block
+ *       pUsedEnd       - Pointer to storage for the end index of the last
+ *                        module that is not free space
+ *       pChainEnd      - Pointer to storage for the end index of the chain
+ *       pFreeSize      - Pointer to storage for the size of the free
+ *                        modules in front of the last used module
+ * Outp: TRUE if the section only holds the module chain followed by erased
+ *       space, FALSE if it has to be rebuilt.
+ *---------------------------------------------------------------------------
+ */
+static UINT16 ScanSectionLayout													//MOD018
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 *pUsedEnd,
+    UINT32 *pChainEnd,
+    UINT32 *pFreeSize
+)
+{
+    UINT32 nIndex, nSize, nFree;
+
+    nIndex = 0;
+    nFree = 0;
+    *pUsedEnd = 0;
+    *pFreeSize = 0;
+    while((nSize = GetSectionModuleSize(pSectionInfo, nIndex)) != 0)
+    {
+        if(IsFreeSectionModule(pSectionInfo, nIndex))
+        {
+            nFree = nFree + nSize;
+        }
+        else
+        {
+            *pFreeSize = nFree;
+            *pUsedEnd = nIndex + nSize;
+        }
+        nIndex = nIndex + nSize;
+    }
+    *pChainEnd = nIndex;
+
+    // Anything else than erased space behind the chain needs a rebuild
+    for(; nIndex < pSectionInfo->sectionSize; nIndex = nIndex + 4)
+    {
+        if(*((UINT32 *)(pSectionInfo->pSectionBuffer + nIndex)) != 0xFFFFFFFF)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: SetSectionFreeSpace
+ * Desc: Turns a range of the section into free space. Only a free module
+ *       header and end are written, the data in between is kept to leave
+ *       as much of the flash contents untouched as possible. Ranges too
+ *       small for a module entry are erased.
+ * Inp:  pSectionInfo   - Pointer to section information block
+ *       nIndex         - Start index of the range
+ *       nSize          - Size of the range in bytes
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+static void SetSectionFreeSpace													//MOD018
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 nIndex,
+    UINT32 nSize
+)
+{
+    CG_MPFA_MODULE_HEADER *pHeader;
+
+    if(nSize == 0)
+    {
+        return;
+    }
+    if(nSize < sizeof(localMpfaHdr) + sizeof(localMpfaEnd))
+    {
+        memset(pSectionInfo->pSectionBuffer + nIndex, 0xFF, nSize);
+        CgMpfaMarkDirty(pSectionInfo, nIndex, nSize);
+        return;
+    }
+    pHeader = (CG_MPFA_MODULE_HEADER *)(pSectionInfo->pSectionBuffer + nIndex);
+    memcpy(pHeader, &localMpfaHdr, sizeof(localMpfaHdr));
+    pHeader->modType = CG_MPFA_TYPE_PAD;
+    pHeader->modSize = nSize;
+    pHeader->modFlags = pHeader->modFlags & (~CG_MOD_ENTRY_USED);
+    memcpy(pSectionInfo->pSectionBuffer + nIndex + nSize - sizeof(localMpfaEnd), &localMpfaEnd, sizeof(localMpfaEnd));
+    CgMpfaMarkDirty(pSectionInfo, nIndex, sizeof(localMpfaHdr));
+    CgMpfaMarkDirty(pSectionInfo, nIndex + nSize - sizeof(localMpfaEnd), sizeof(localMpfaEnd));
+}
+
+/*---------------------------------------------------------------------------
+ * Name: FindSectionGap
+ * Desc: Finds the smallest run of free modules in front of the last used
+ *       module (best fit) that can take a module of the given size. The
+ *       remaining space of the gap must be able to hold a free module.
+ * Inp:  pSectionInfo   - Pointer to section information block
+ *       nModSize       - Size of the module to place
+ *       pGapEnd        - Pointer to storage for the end index of the gap
+ * Outp: Start index of the gap, 0xFFFFFFFF if no gap fits.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 FindSectionGap													//MOD018
+(
+    CG_MPFA_SECTION_INFO *pSectionInfo,
+    UINT32 nModSize,
+    UINT32 *pGapEnd
+)
+{
+    UINT32 nIndex, nSize, nGapStart, nGapSize, nUsedEnd, nChainEnd, nFreeSize;
+    UINT32 nBestStart = 0xFFFFFFFF, nBestSize = 0xFFFFFFFF;
+
+    if(!ScanSectionLayout(pSectionInfo, &nUsedEnd, &nChainEnd, &nFreeSize) || (nFreeSize < nModSize))
+    {
+        return 0xFFFFFFFF;
+    }
+    nIndex = 0;
+    nGapStart = 0xFFFFFFFF;
+    while(nIndex < nUsedEnd)
+    {
+        nSize = GetSectionModuleSize(pSectionInfo, nIndex);
+        if(IsFreeSectionModule(pSectionInfo, nIndex))
+        {
+            if(nGapStart == 0xFFFFFFFF)
+            {
+                nGapStart = nIndex;
+            }
+        }
+        else if(nGapStart != 0xFFFFFFFF)
+        {
+            nGapSize = nIndex - nGapStart;
+            if(((nGapSize == nModSize) || (nGapSize >= nModSize + sizeof(localMpfaHdr) + sizeof(localMpfaEnd))) &&
+               (nGapSize < nBestSize))
+            {
+                nBestStart = nGapStart;
+                nBestSize = nGapSize;
+            }
+            nGapStart = 0xFFFFFFFF;
+        }
+        nIndex = nIndex + nSize;
+    }
+    if(nBestStart != 0xFFFFFFFF)
+    {
+        *pGapEnd = nBestStart + nBestSize;
+    }
+    return nBestStart;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: UpdateSectionLayout
+ * Desc: Sets the section addIndex behind the last used module. Modules keep
+ *       their place, free modules are left as gaps for new modules. The
+ *       section is only compacted (CgMpfaRebuildSection) if the gaps exceed
+ *       CG_MPFA_COMPACT_THRESHOLD percent of the section or its layout is
+ *       not a plain module chain.
+ * Inp:  pSectionInfo   - Pointer to information block of section
+ *       bCompact       - FALSE: keep the gaps regardless of their size, e.g.
+ *                        if the gap will be refilled right away
+ * Outp: return code:
+ *       CG_MPFARET_ERROR        - Execution error
+ *       CG_MPFARET_OK           - Success
+ *---------------------------------------------------------------------------
+ */
+static UINT16 UpdateSectionLayout(CG_MPFA_SECTION_INFO *pSectionInfo, UINT16 bCompact)	//MOD018
+{
+    UINT32 nUsedEnd, nChainEnd, nFreeSize;
+
+    if((!ScanSectionLayout(pSectionInfo, &nUsedEnd, &nChainEnd, &nFreeSize)) ||
+       (bCompact && (nFreeSize > (pSectionInfo->sectionSize / 100) * CG_MPFA_COMPACT_THRESHOLD)))
+    {
+        return CgMpfaRebuildSection(pSectionInfo);
+    }
+    pSectionInfo->addIndex = nUsedEnd;
+    return CG_MPFARET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgMpfaGetFreeSpace
+ * Desc: Returns the space available for new modules in a section. This is
+ *       the space behind the last used module plus the gaps left by deleted
+ *       modules in front of it.
+ * Inp:  pSectionInfo   - Pointer to information block of section
+ * Outp: Free space in bytes.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgMpfaGetFreeSpace(CG_MPFA_SECTION_INFO *pSectionInfo)					//MOD020
+{
+    UINT32 nUsedEnd, nChainEnd, nFreeSize;
+
+    if((pSectionInfo->pSectionBuffer == NULL) || (pSectionInfo->addIndex > pSectionInfo->sectionSize))
+    {
+        return 0;
+    }
+    if(!ScanSectionLayout(pSectionInfo, &nUsedEnd, &nChainEnd, &nFreeSize))
+    {
+        // Not a plain module chain, only the space behind addIndex is known
+        return pSectionInfo->sectionSize - pSectionInfo->addIndex;
+    }
+    return (pSectionInfo->sectionSize - nUsedEnd) + nFreeSize;
+}
+
 /*---------------------------------------------------------------------------
  * Name: CgMpfaRebuildSection
  * Desc: Rebuild specified section and update section addIndex (= index in 
@@ -1984,20 +2516,20 @@ UINT16 CgMpfaRebuildSection(CG_MPFA_SECTION_INFO *pSectionInfo)
         
     //
     // Write back temporary section buffer to original section buffer
+    // MOD017: Only the parts that really changed are copied and marked dirty.
     //
-    
-    // Set start pointers
-    pCurrentSource = (UINT32 *)pSectionInfo->pSectionBuffer;
-    pCurrentDest = pTempSectionBuffer;
-
-    // Set copy length to copy the whole section
-    nCopyLength = (pSectionInfo->sectionSize) / 4;
-
-    for(nCount = 0; nCount < nCopyLength; nCount++)
+    for(nCount = 0; nCount < pSectionInfo->sectionSize; nCount = nCount + CG_MPFA_DIRTY_SIZE)
     {
-        *pCurrentSource = *pCurrentDest;
-        pCurrentDest = pCurrentDest + 1;
-        pCurrentSource = pCurrentSource + 1;        
+        nCopyLength = pSectionInfo->sectionSize - nCount;
+        if(nCopyLength > CG_MPFA_DIRTY_SIZE)
+        {
+            nCopyLength = CG_MPFA_DIRTY_SIZE;
+        }
+        if(memcmp(pSectionInfo->pSectionBuffer + nCount, (unsigned char *)pTempSectionBuffer + nCount, nCopyLength) != 0)
+        {
+            memcpy(pSectionInfo->pSectionBuffer + nCount, (unsigned char *)pTempSectionBuffer + nCount, nCopyLength);
+            CgMpfaMarkDirty(pSectionInfo, nCount, nCopyLength);
+        }
     }
         
 	free(pTempSectionBuffer);													//MOD008
@@ -2441,6 +2973,8 @@ UINT16 CgMpfaAddModule
     UINT32 nTypeCount, nSectionCount, nSectionType, nFoundIndex, nDataSize, 
                     nTempOffset, nCount, nCompFlags,  
 					nPadModuleSize, nPadModuleDataSize, nAlignment;				//MOD006 MOD008
+    UINT32 nAddStart;															//MOD017
+    UINT32 nGapIndex, nGapEnd, nUsedEnd, nChainEnd, nFreeSize;					//MOD018
     UINT16 retVal;
     CG_MPFA_SECTION_INFO *pTempInfo;
     unsigned char *pTempSectionBuffer;
@@ -2622,21 +3156,57 @@ UINT16 CgMpfaAddModule
             // We have found the module, now set it to UNUSED.
             pTempSectionBuffer = (pTempInfo->pSectionBuffer + nFoundIndex);
             ((CG_MPFA_MODULE_HEADER *)pTempSectionBuffer)->modFlags = ((CG_MPFA_MODULE_HEADER *)pTempSectionBuffer)->modFlags & (~CG_MOD_ENTRY_USED);
+            CgMpfaMarkDirty(pTempInfo, nFoundIndex, sizeof(localMpfaHdr));	//MOD017
     
-            // Launch rebuild of the section to really remove the module 
-            if(CgMpfaRebuildSection(pTempInfo) != CG_MPFARET_OK)
+            // The module space stays in place as gap for the new module	//MOD018
+            if(UpdateSectionLayout(pTempInfo, FALSE) != CG_MPFARET_OK)		//MOD018
             {
 				free(pTempModuleBuffer);											//MOD008
                 return CG_MPFARET_ERROR;
             }
         }
     }while(retVal == CG_MPFARET_OK);
-   
-    if((pTempInfo->addIndex != 0xFFFFFFFF) && 
+
+    // Keep the layout of the section stable: place the module into the best	//MOD018 v
+    // fitting gap. It is only appended if no gap fits and the section is only
+    // compacted if the module does not fit otherwise. FV modules are always
+    // appended, as their alignment pad has to be placed in front of them.
+    nGapIndex = 0xFFFFFFFF;
+    nChainEnd = 0;
+    if(pTempInfo->addIndex != 0xFFFFFFFF)
+    {
+        if(((CG_MPFA_MODULE_HEADER *)pTempModuleBuffer)->modType != CG_MPFA_TYPE_FIRMWARE_VOLUME)
+        {
+            nGapIndex = FindSectionGap(pTempInfo, nDataSize, &nGapEnd);
+        }
+        if((nGapIndex == 0xFFFFFFFF) &&
+           (pTempInfo->sectionSize < pTempInfo->addIndex + ((CG_MPFA_MODULE_HEADER *)pTempModuleBuffer)->modSize))
+        {
+            if(CgMpfaRebuildSection(pTempInfo) != CG_MPFARET_OK)
+            {
+                free(pTempModuleBuffer);
+                return CG_MPFARET_ERROR;
+            }
+        }
+        if(!ScanSectionLayout(pTempInfo, &nUsedEnd, &nChainEnd, &nFreeSize))
+        {
+            nChainEnd = 0;
+        }
+    }
+
+    if(nGapIndex != 0xFFFFFFFF)
+    {
+        memcpy(pTempInfo->pSectionBuffer + nGapIndex, pTempModuleBuffer, nDataSize);
+        CgMpfaMarkDirty(pTempInfo, nGapIndex, nDataSize);
+        SetSectionFreeSpace(pTempInfo, nGapIndex + nDataSize, nGapEnd - (nGapIndex + nDataSize));
+        retVal = CG_MPFARET_OK;
+    }																			//MOD018 ^
+    else if((pTempInfo->addIndex != 0xFFFFFFFF) && 
         (pTempInfo->sectionSize >= pTempInfo->addIndex +  ((CG_MPFA_MODULE_HEADER *)pTempModuleBuffer)->modSize ))
     {
         // Prepare to copy module from temporary buffer to section buffer
         pTempSectionBuffer = (pTempInfo->pSectionBuffer + pTempInfo->addIndex);
+        nAddStart = pTempInfo->addIndex;										//MOD017
 
 																				//MOD006 MOD008 v
 		////////////////////////////////////////////////////////////////////////
@@ -2733,12 +3303,23 @@ UINT16 CgMpfaAddModule
 
         // Adjust add index for this section.
         pTempInfo->addIndex = pTempInfo->addIndex + nDataSize;
+        CgMpfaMarkDirty(pTempInfo, nAddStart, pTempInfo->addIndex - nAddStart);	//MOD017
+        // Free modules behind the appended module stay part of the chain	//MOD018 v
+        if(nChainEnd > pTempInfo->addIndex)
+        {
+            SetSectionFreeSpace(pTempInfo, pTempInfo->addIndex, nChainEnd - pTempInfo->addIndex);
+        }																		//MOD018 ^
         retVal = CG_MPFARET_OK;
     }
     else
     {
         retVal = CG_MPFARET_ERROR_SIZE;
     }
+    // Gaps of a replaced module that were not refilled may need compaction	//MOD018 v
+    if((retVal == CG_MPFARET_OK) && (UpdateSectionLayout(pTempInfo, TRUE) != CG_MPFARET_OK))
+    {
+        retVal = CG_MPFARET_ERROR;
+    }																			//MOD018 ^
  
     free(pTempModuleBuffer);
 
@@ -2751,6 +3332,7 @@ UINT16 CgMpfaAddModule
         pTempSectionBuffer = (pTempInfo->pSectionBuffer + nFoundIndex);
         ((CG_MPFA_MODULE_HEADER *)pTempSectionBuffer)->modFlags = 
             ((CG_MPFA_MODULE_HEADER *)pTempSectionBuffer)->modFlags & (~CG_MOD_ENTRY_MODIFIED);
+        CgMpfaMarkDirty(pTempInfo, nFoundIndex, sizeof(localMpfaHdr));		//MOD017
     }
     
     return retVal;
@@ -2834,9 +3416,10 @@ UINT16 CgMpfaDelModule
         // We have found the module, now set it to UNUSED.
         pTempMpfaHeader = (CG_MPFA_MODULE_HEADER *)(pTempInfo->pSectionBuffer + nFoundIndex);
         pTempMpfaHeader->modFlags = pTempMpfaHeader->modFlags & (~CG_MOD_ENTRY_USED);
+        CgMpfaMarkDirty(pTempInfo, nFoundIndex, sizeof(localMpfaHdr));		//MOD017
         
-        // Launch rebuild of the section to really remove the module 
-        retVal = CgMpfaRebuildSection(pTempInfo);   
+        // The module space stays in place as gap in the section			//MOD018
+        retVal = UpdateSectionLayout(pTempInfo, TRUE);							//MOD018
 
         // Now go and mark the section as modified by marking the ROOT module
         // as modified. If there is no ROOT module, simply do nothing.
@@ -2846,6 +3429,7 @@ UINT16 CgMpfaDelModule
             //
             pTempMpfaHeader = (CG_MPFA_MODULE_HEADER *)(pTempInfo->pSectionBuffer + nFoundIndex);
             pTempMpfaHeader->modFlags = pTempMpfaHeader->modFlags & (~CG_MOD_ENTRY_MODIFIED);
+            CgMpfaMarkDirty(pTempInfo, nFoundIndex, sizeof(localMpfaHdr));	//MOD017
         }
     }
     return retVal;
@@ -29,6 +29,8 @@
  *
  * $Log:   S:/CG/archives/CGTOOLS/INC/CGMPFA.H-arc  $
  * 
+ * MOD005: Added CG_MPFA_SECTION_COUNT for the per thread section list.
+ * 
  *    Rev 1.9   Sep 06 2016 15:57:52   congatec
  * Added BSD header.
  * MOD004: Added support for new MPFA module types.
@@ -123,6 +125,7 @@ typedef struct
 										// For non-descriptor BIOS identical 
 										// to CG_MPFA_ALL
 																								//MOD001 ^
+#define CG_MPFA_SECTION_COUNT	5	// Number of entries in g_MpfaSectionList					//MOD005
 
 //+---------------------------------------------------------------------------
 //       MPFA module header
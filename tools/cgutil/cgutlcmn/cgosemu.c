@@ -0,0 +1,799 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: File backed CGOS emulation (LINUX).
+ *           Replaces the CGOS library to run the utility without a board,
+ *           e.g. for flash throughput measurements. Built by 'make emu'.
+ *
+ *           All files are located in the directory given by CGOSEMU_DIR
+ *           (default: current directory):
+ *
+ *           flash.bin       Whole SPI flash part (CG32_STORAGE_MPFA_EXTD).
+ *                           The top CGOSEMU_BIOS_SIZE bytes (default: whole
+ *                           file) form the BIOS area (CG32_STORAGE_MPFA_ALL).
+ *           sa_<unit>.bin   Any other storage area, e.g. sa_40020100.bin for
+ *                           the static MPFA area. The CMOS area
+ *                           (sa_00030000.bin) is created if not present.
+ *           i2c<bus>_<addr>.bin
+ *                           256 byte I2C EEPROM, e.g. i2c2_A0.bin.
+ *           cbcflash.bin    cBC flash accessed by the extended AVR SPM
+ *                           commands.
+ *
+ *           The board name and BIOS revision are taken from the BIOS info
+ *           structure in the BIOS area, unless CGOSEMU_BOARD is set.
+ *
+ *           Timing (all values in microseconds, default 0):
+ *           CGOSEMU_CALL_US     Delay of each storage area / I2C / cBC call.
+ *           CGOSEMU_ERASE_US    Erase time per KB.
+ *           CGOSEMU_PROGRAM_US  Program time per KB.
+ *
+ *           Further settings:
+ *           CGOSEMU_BLOCK_SIZE  Block size reported for the flash areas.
+ *                               0x80000 emulates BIOSes that erase on write.
+ *           CGOSEMU_LOCKED      Set to 1 to start with a locked flash part.
+ *           CGOSEMU_I2C_DDC     I2C bus number of the DDC bus (default 2).
+ *           CGOSEMU_STATS       Set to 1 to print access statistics on exit.
+ *           CGOSEMU_BOARDS      Number of boards (default 1). Board n > 0 uses
+ *                               the files in subdirectory board<n>.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "cgbinfo.h"
+#include "cgbc.h"
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+#define CGOSEMU_MAX_FILES       64
+#define CGOSEMU_I2C_COUNT       3
+#define CGOSEMU_I2C_SIZE        256
+#define CGOSEMU_CMOS_SIZE       256
+#define CGOSEMU_HANDLE          1
+
+typedef struct {
+    char szName[48];
+    FILE *fp;
+    UINT32 nSize;
+} CGOSEMU_FILE;
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+static CGOSEMU_FILE CgosEmuFiles[CGOSEMU_MAX_FILES];
+static UINT32 nEmuCallUs, nEmuEraseUs, nEmuProgramUs;
+static UINT32 nEmuBlockSize = 0x10000;
+static UINT32 nEmuBiosSize;
+static UINT32 bEmuLocked, bEmuStats;
+static UINT32 nEmuDdcBus = 2;
+static CG_TLS UINT32 nEmuSpmAddr;
+static CG_TLS unsigned char nEmuI2CPointer[CGOSEMU_I2C_COUNT][128];
+static UINT32 nStatCalls, nStatReads, nStatWrites, nStatErases;
+static double dStatReadBytes, dStatWriteBytes, dStatEraseBytes;
+static pthread_mutex_t EmuMutex = PTHREAD_MUTEX_INITIALIZER;		// File table and statistics
+
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuGetEnv
+ * Desc: Returns a numeric setting from the environment.
+ * Inp:  lpszName       - Name of environment variable.
+ *       nDefault       - Value if the variable is not set.
+ * Outp: Setting.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 CgosEmuGetEnv(char *lpszName, UINT32 nDefault)
+{
+    char *lpszValue = getenv(lpszName);
+
+    if(!lpszValue || !(*lpszValue))
+    {
+        return nDefault;
+    }
+    return (UINT32)strtoul(lpszValue, NULL, 0);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuDelay
+ * Desc: Emulates the time of an access.
+ * Inp:  nUsPerKb       - Time per KB.
+ *       nLen           - Number of bytes accessed.
+ * Outp: None
+ *---------------------------------------------------------------------------
+ */
+static void CgosEmuDelay(UINT32 nUsPerKb, UINT32 nLen)
+{
+    unsigned long long nUs;
+
+    pthread_mutex_lock(&EmuMutex);
+    nStatCalls++;
+    pthread_mutex_unlock(&EmuMutex);
+    nUs = (unsigned long long)nEmuCallUs + (((unsigned long long)nUsPerKb * nLen) / 1024);
+    while(nUs > 0)
+    {
+        // usleep() does not need to support values of one second and above
+        usleep((nUs > 500000) ? 500000 : (useconds_t)nUs);
+        nUs = (nUs > 500000) ? (nUs - 500000) : 0;
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuOpenFileLocked
+ * Desc: Opens a backing file. Files stay open until the library is
+ *       uninitialized. EmuMutex must be held.
+ * Inp:  lpszName       - File name within CGOSEMU_DIR.
+ *       nCreateSize    - Size of file to create if it does not exist yet,
+ *                        0 to not create the file.
+ * Outp: Pointer to file entry or NULL.
+ *---------------------------------------------------------------------------
+ */
+static CGOSEMU_FILE *CgosEmuOpenFileLocked(char *lpszName, UINT32 nCreateSize)
+{
+    char szPath[512];
+    char *lpszDir;
+    UINT32 i;
+    CGOSEMU_FILE *pFile = NULL;
+
+    for(i = 0; i < CGOSEMU_MAX_FILES; i++)
+    {
+        if(CgosEmuFiles[i].fp && (strcmp(CgosEmuFiles[i].szName, lpszName) == 0))
+        {
+            return &CgosEmuFiles[i];
+        }
+        if(!CgosEmuFiles[i].fp && !pFile)
+        {
+            pFile = &CgosEmuFiles[i];
+        }
+    }
+    if(!pFile)
+    {
+        return NULL;
+    }
+
+    lpszDir = getenv("CGOSEMU_DIR");
+    snprintf(szPath, sizeof(szPath), "%s/%s", (lpszDir && *lpszDir) ? lpszDir : ".", lpszName);
+    pFile->fp = fopen(szPath, "r+b");
+    if(!pFile->fp && nCreateSize)
+    {
+        pFile->fp = fopen(szPath, "w+b");
+        if(pFile->fp)
+        {
+            for(i = 0; i < nCreateSize; i++)
+            {
+                fputc(0xFF, pFile->fp);
+            }
+        }
+    }
+    if(!pFile->fp)
+    {
+        return NULL;
+    }
+    fseek(pFile->fp, 0, SEEK_END);
+    pFile->nSize = (UINT32)ftell(pFile->fp);
+    strncpy(pFile->szName, lpszName, sizeof(pFile->szName) - 1);
+    return pFile;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuOpenFile
+ * Desc: Opens a backing file of a board.
+ * Inp:  hCgos          - Board handle.
+ *       lpszName       - File name within the directory of the board.
+ *       nCreateSize    - See CgosEmuOpenFileLocked.
+ * Outp: Pointer to file entry or NULL.
+ *---------------------------------------------------------------------------
+ */
+static CGOSEMU_FILE *CgosEmuOpenFile(HCGOS hCgos, char *lpszName, UINT32 nCreateSize)
+{
+    char szName[48];
+    CGOSEMU_FILE *pFile;
+
+    if(hCgos > CGOSEMU_HANDLE)
+    {
+        snprintf(szName, sizeof(szName), "board%u/%s", (UINT32)(hCgos - CGOSEMU_HANDLE), lpszName);
+    }
+    else
+    {
+        snprintf(szName, sizeof(szName), "%s", lpszName);
+    }
+    pthread_mutex_lock(&EmuMutex);
+    pFile = CgosEmuOpenFileLocked(szName, nCreateSize);
+    pthread_mutex_unlock(&EmuMutex);
+    return pFile;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuGetArea
+ * Desc: Maps a storage area to its backing file.
+ * Inp:  hCgos          - Board handle.
+ *       dwUnit         - Storage area.
+ *       pBase          - Pointer to storage for area offset within file.
+ *       pSize          - Pointer to storage for area size.
+ * Outp: Pointer to file entry or NULL if area is not available.
+ *---------------------------------------------------------------------------
+ */
+static CGOSEMU_FILE *CgosEmuGetArea(HCGOS hCgos, unsigned int dwUnit, UINT32 *pBase, UINT32 *pSize)
+{
+    char szName[32];
+    CGOSEMU_FILE *pFile;
+
+    if((dwUnit == CG32_STORAGE_MPFA_ALL) || (dwUnit == CG32_STORAGE_MPFA_EXTD))
+    {
+        if(!(pFile = CgosEmuOpenFile(hCgos, "flash.bin", 0)))
+        {
+            return NULL;
+        }
+        *pBase = 0;
+        *pSize = pFile->nSize;
+        if((dwUnit == CG32_STORAGE_MPFA_ALL) && nEmuBiosSize && (nEmuBiosSize < pFile->nSize))
+        {
+            // The BIOS is located at the end of the flash part
+            *pBase = pFile->nSize - nEmuBiosSize;
+            *pSize = nEmuBiosSize;
+        }
+        return pFile;
+    }
+
+    sprintf(szName, "sa_%08X.bin", dwUnit);
+    if(!(pFile = CgosEmuOpenFile(hCgos, szName, (dwUnit == CGOS_STORAGE_AREA_CMOS) ? CGOSEMU_CMOS_SIZE : 0)))
+    {
+        return NULL;
+    }
+    *pBase = 0;
+    *pSize = pFile->nSize;
+    return pFile;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuAccess
+ * Desc: Reads or writes a backing file range.
+ * Inp:  pFile          - File entry.
+ *       nOffset        - File offset.
+ *       pBytes         - Data buffer.
+ *       nLen           - Number of bytes.
+ *       bWrite         - TRUE to write, FALSE to read.
+ * Outp: TRUE on success, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 CgosEmuAccess(CGOSEMU_FILE *pFile, UINT32 nOffset, unsigned char *pBytes, UINT32 nLen, UINT32 bWrite)
+{
+    if(fseek(pFile->fp, nOffset, SEEK_SET) != 0)
+    {
+        return FALSE;
+    }
+    if(bWrite)
+    {
+        return ((fwrite(pBytes, 1, nLen, pFile->fp) == nLen) && (fflush(pFile->fp) == 0)) ? TRUE : FALSE;
+    }
+    return (fread(pBytes, 1, nLen, pFile->fp) == nLen) ? TRUE : FALSE;
+}
+
+//
+// Library
+//
+
+cgosret_ulong CgosLibGetVersion(void)
+{
+    return CgosLibVersion;
+}
+
+cgosret_ulong CgosLibGetDrvVersion(void)
+{
+    return CgosLibVersion;
+}
+
+cgosret_bool CgosLibInitialize(void)
+{
+    nEmuCallUs = CgosEmuGetEnv("CGOSEMU_CALL_US", 0);
+    nEmuEraseUs = CgosEmuGetEnv("CGOSEMU_ERASE_US", 0);
+    nEmuProgramUs = CgosEmuGetEnv("CGOSEMU_PROGRAM_US", 0);
+    nEmuBlockSize = CgosEmuGetEnv("CGOSEMU_BLOCK_SIZE", 0x10000);
+    nEmuBiosSize = CgosEmuGetEnv("CGOSEMU_BIOS_SIZE", 0);
+    bEmuLocked = CgosEmuGetEnv("CGOSEMU_LOCKED", 0);
+    bEmuStats = CgosEmuGetEnv("CGOSEMU_STATS", 0);
+    nEmuDdcBus = CgosEmuGetEnv("CGOSEMU_I2C_DDC", 2);
+    return TRUE;
+}
+
+cgosret_bool CgosLibUninitialize(void)
+{
+    UINT32 i;
+
+    for(i = 0; i < CGOSEMU_MAX_FILES; i++)
+    {
+        if(CgosEmuFiles[i].fp)
+        {
+            fclose(CgosEmuFiles[i].fp);
+            CgosEmuFiles[i].fp = NULL;
+        }
+    }
+    if(bEmuStats)
+    {
+        fprintf(stderr, "\nCGOSEMU: %u calls, %u reads (%.0f bytes), %u writes (%.0f bytes), %u erases (%.0f bytes)\n",
+                nStatCalls, nStatReads, dStatReadBytes, nStatWrites, dStatWriteBytes, nStatErases, dStatEraseBytes);
+    }
+    return TRUE;
+}
+
+cgosret_bool CgosLibInstall(unsigned int install)
+{
+    return TRUE;
+}
+
+//
+// Generic board
+//
+
+cgosret_ulong CgosBoardCount(unsigned int dwClass, unsigned int dwFlags)
+{
+    return CgosEmuGetEnv("CGOSEMU_BOARDS", 1);
+}
+
+cgosret_bool CgosBoardOpen(unsigned int dwClass, unsigned int dwNum, unsigned int dwFlags, HCGOS *phCgos)
+{
+    if(dwNum >= CgosBoardCount(dwClass, dwFlags))
+    {
+        return FALSE;
+    }
+    *phCgos = CGOSEMU_HANDLE + dwNum;
+    return TRUE;
+}
+
+cgosret_bool CgosBoardClose(HCGOS hCgos)
+{
+    return TRUE;
+}
+
+cgosret_bool CgosBoardGetInfoA(HCGOS hCgos, CGOSBOARDINFOA *pBoardInfo)
+{
+    CG_BIOS_INFO biosInfo;
+    CGOSEMU_FILE *pFile;
+    UINT32 nBase, nSize, nIndex;
+    char *lpszBoard;
+    char szRevision[4] = {0};
+
+    if(pBoardInfo->dwSize < sizeof(CGOSBOARDINFOA))
+    {
+        return FALSE;
+    }
+    memset(pBoardInfo, 0, sizeof(CGOSBOARDINFOA));
+    pBoardInfo->dwSize = sizeof(CGOSBOARDINFOA);
+    strcpy(pBoardInfo->szManufacturer, "congatec");
+    snprintf(pBoardInfo->szSerialNumber, sizeof(pBoardInfo->szSerialNumber), "%012u", (UINT32)(hCgos - CGOSEMU_HANDLE));
+    strcpy(pBoardInfo->szBoard, "EMU0");
+
+    // Take board name and BIOS revision from the BIOS info structure (e.g. 'BEXLR012')
+    if((pFile = CgosEmuGetArea(hCgos, CG32_STORAGE_MPFA_ALL, &nBase, &nSize)) != NULL)
+    {
+        for(nIndex = 0; (nIndex + sizeof(biosInfo)) <= nSize; nIndex = nIndex + 4)
+        {
+            if(!CgosEmuAccess(pFile, nBase + nIndex, (unsigned char*)&biosInfo, 8, FALSE))
+            {
+                break;
+            }
+            if((biosInfo.infoIDLow == CG_SYS_BIOS_INFO_ID_L) && (biosInfo.infoIDHigh == CG_SYS_BIOS_INFO_ID_H) &&
+               CgosEmuAccess(pFile, nBase + nIndex, (unsigned char*)&biosInfo, sizeof(biosInfo), FALSE))
+            {
+                memcpy(pBoardInfo->szBoard, &biosInfo.biosVersion[0], 4);
+                pBoardInfo->szBoard[4] = 0;
+                memcpy(szRevision, &biosInfo.biosVersion[5], 3);
+                pBoardInfo->wSystemBiosRevision = (unsigned short)strtoul(szRevision, NULL, 16);
+                break;
+            }
+        }
+    }
+
+    if((lpszBoard = getenv("CGOSEMU_BOARD")) != NULL)
+    {
+        strncpy(pBoardInfo->szBoard, lpszBoard, CGOS_BOARD_MAX_SIZE_ID_STRING - 1);
+    }
+    return TRUE;
+}
+
+cgosret_bool CgosBoardGetBootCounter(HCGOS hCgos, unsigned int *pdwCount)
+{
+    *pdwCount = CgosEmuGetEnv("CGOSEMU_BOOT_COUNTER", 1);
+    return TRUE;
+}
+
+cgosret_bool CgosBoardGetRunningTimeMeter(HCGOS hCgos, unsigned int *pdwCount)
+{
+    *pdwCount = 0;
+    return TRUE;
+}
+
+//
+// VGA
+//
+
+static unsigned int nEmuBacklight = 100, nEmuBacklightEnable = 1;
+
+cgosret_bool CgosVgaGetBacklight(HCGOS hCgos, unsigned int dwUnit, unsigned int *pdwSetting)
+{
+    *pdwSetting = nEmuBacklight;
+    return TRUE;
+}
+
+cgosret_bool CgosVgaSetBacklight(HCGOS hCgos, unsigned int dwUnit, unsigned int dwSetting)
+{
+    nEmuBacklight = dwSetting;
+    return TRUE;
+}
+
+cgosret_bool CgosVgaGetBacklightEnable(HCGOS hCgos, unsigned int dwUnit, unsigned int *pdwSetting)
+{
+    *pdwSetting = nEmuBacklightEnable;
+    return TRUE;
+}
+
+cgosret_bool CgosVgaSetBacklightEnable(HCGOS hCgos, unsigned int dwUnit, unsigned int dwSetting)
+{
+    nEmuBacklightEnable = dwSetting;
+    return TRUE;
+}
+
+//
+// Storage areas
+//
+
+cgosret_ulong CgosStorageAreaSize(HCGOS hCgos, unsigned int dwUnit)
+{
+    UINT32 nBase, nSize;
+
+    if(!CgosEmuGetArea(hCgos, dwUnit, &nBase, &nSize))
+    {
+        return 0;
+    }
+    return nSize;
+}
+
+cgosret_ulong CgosStorageAreaBlockSize(HCGOS hCgos, unsigned int dwUnit)
+{
+    UINT32 nBase, nSize;
+
+    if(!CgosEmuGetArea(hCgos, dwUnit, &nBase, &nSize))
+    {
+        return 0;
+    }
+    return ((dwUnit & 0x00FF0000) == CGOS_STORAGE_AREA_FLASH) ? nEmuBlockSize : 1;
+}
+
+cgosret_bool CgosStorageAreaRead(HCGOS hCgos, unsigned int dwUnit, unsigned int dwOffset, unsigned char *pBytes, unsigned int dwLen)
+{
+    CGOSEMU_FILE *pFile;
+    UINT32 nBase, nSize;
+
+    CgosEmuDelay(0, 0);
+    if(!pBytes || !dwLen)
+    {
+        // E.g. trigger of setup data preservation
+        return TRUE;
+    }
+    if(!(pFile = CgosEmuGetArea(hCgos, dwUnit, &nBase, &nSize)) || (dwOffset > nSize) || (dwLen > (nSize - dwOffset)))
+    {
+        return FALSE;
+    }
+    pthread_mutex_lock(&EmuMutex);
+    nStatReads++;
+    dStatReadBytes += dwLen;
+    pthread_mutex_unlock(&EmuMutex);
+    return CgosEmuAccess(pFile, nBase + dwOffset, pBytes, dwLen, FALSE);
+}
+
+cgosret_bool CgosStorageAreaWrite(HCGOS hCgos, unsigned int dwUnit, unsigned int dwOffset, unsigned char *pBytes, unsigned int dwLen)
+{
+    CGOSEMU_FILE *pFile;
+    UINT32 nBase, nSize, i;
+    unsigned char *pOld;
+    UINT32 bResult;
+
+    if(!pBytes || !dwLen)
+    {
+        CgosEmuDelay(0, 0);
+        return TRUE;
+    }
+    if(!(pFile = CgosEmuGetArea(hCgos, dwUnit, &nBase, &nSize)) || (dwOffset > nSize) || (dwLen > (nSize - dwOffset)))
+    {
+        CgosEmuDelay(0, 0);
+        return FALSE;
+    }
+    if((dwUnit == CG32_STORAGE_MPFA_EXTD) && bEmuLocked)
+    {
+        CgosEmuDelay(0, 0);
+        return FALSE;
+    }
+    pthread_mutex_lock(&EmuMutex);
+    nStatWrites++;
+    dStatWriteBytes += dwLen;
+    pthread_mutex_unlock(&EmuMutex);
+
+    if(((dwUnit & 0x00FF0000) != CGOS_STORAGE_AREA_FLASH) || (nEmuBlockSize == 0x80000))
+    {
+        // Not a flash area or the BIOS erases the block on write itself
+        CgosEmuDelay(((dwUnit & 0x00FF0000) == CGOS_STORAGE_AREA_FLASH) ? (nEmuEraseUs + nEmuProgramUs) : 0, dwLen);
+        return CgosEmuAccess(pFile, nBase + dwOffset, pBytes, dwLen, TRUE);
+    }
+
+    // Flash programming can only clear bits
+    CgosEmuDelay(nEmuProgramUs, dwLen);
+    if(!(pOld = (unsigned char*)malloc(dwLen)))
+    {
+        return FALSE;
+    }
+    bResult = CgosEmuAccess(pFile, nBase + dwOffset, pOld, dwLen, FALSE);
+    for(i = 0; i < dwLen; i++)
+    {
+        pOld[i] = pOld[i] & pBytes[i];
+    }
+    bResult = bResult && CgosEmuAccess(pFile, nBase + dwOffset, pOld, dwLen, TRUE);
+    free(pOld);
+    return bResult;
+}
+
+cgosret_bool CgosStorageAreaErase(HCGOS hCgos, unsigned int dwUnit, unsigned int dwOffset, unsigned int dwLen)
+{
+    CGOSEMU_FILE *pFile;
+    UINT32 nBase, nSize;
+    unsigned char *pErased;
+    UINT32 bResult;
+
+    if(!(pFile = CgosEmuGetArea(hCgos, dwUnit, &nBase, &nSize)) || (dwOffset > nSize) || (dwLen > (nSize - dwOffset)) ||
+       ((dwUnit == CG32_STORAGE_MPFA_EXTD) && bEmuLocked))
+    {
+        CgosEmuDelay(0, 0);
+        return FALSE;
+    }
+    pthread_mutex_lock(&EmuMutex);
+    nStatErases++;
+    dStatEraseBytes += dwLen;
+    pthread_mutex_unlock(&EmuMutex);
+    CgosEmuDelay(nEmuEraseUs, dwLen);
+    if(!(pErased = (unsigned char*)malloc(dwLen)))
+    {
+        return FALSE;
+    }
+    memset(pErased, 0xFF, dwLen);
+    bResult = CgosEmuAccess(pFile, nBase + dwOffset, pErased, dwLen, TRUE);
+    free(pErased);
+    return bResult;
+}
+
+cgosret_bool CgosStorageAreaEraseStatus(HCGOS hCgos, unsigned int dwUnit, unsigned int dwOffset, unsigned int dwLen, unsigned int *lpStatus)
+{
+    // Erase is synchronous, so it has always completed
+    CgosEmuDelay(0, 0);
+    *lpStatus = 0;
+    return TRUE;
+}
+
+cgosret_bool CgosStorageAreaLock(HCGOS hCgos, unsigned int dwUnit, unsigned int dwFlags, unsigned char *pBytes, unsigned int dwLen)
+{
+    bEmuLocked = TRUE;
+    return TRUE;
+}
+
+cgosret_bool CgosStorageAreaUnlock(HCGOS hCgos, unsigned int dwUnit, unsigned int dwFlags, unsigned char *pBytes, unsigned int dwLen)
+{
+    bEmuLocked = FALSE;
+    return TRUE;
+}
+
+cgosret_bool CgosStorageAreaIsLocked(HCGOS hCgos, unsigned int dwUnit, unsigned int dwFlags)
+{
+    return (dwUnit == CG32_STORAGE_MPFA_EXTD) ? bEmuLocked : FALSE;
+}
+
+//
+// I2C bus
+//
+
+/*---------------------------------------------------------------------------
+ * Name: CgosEmuGetI2CDevice
+ * Desc: Maps an I2C device to its backing file.
+ * Inp:  hCgos          - Board handle.
+ *       dwUnit         - I2C bus.
+ *       bAddr          - Device address (read/write bit is ignored).
+ * Outp: Pointer to file entry or NULL if no such device.
+ *---------------------------------------------------------------------------
+ */
+static CGOSEMU_FILE *CgosEmuGetI2CDevice(HCGOS hCgos, unsigned int dwUnit, unsigned char bAddr)
+{
+    char szName[32];
+
+    if(dwUnit >= CGOSEMU_I2C_COUNT)
+    {
+        return NULL;
+    }
+    sprintf(szName, "i2c%u_%02X.bin", dwUnit, bAddr & 0xFE);
+    return CgosEmuOpenFile(hCgos, szName, 0);
+}
+
+cgosret_ulong CgosI2CCount(HCGOS hCgos)
+{
+    return CGOSEMU_I2C_COUNT;
+}
+
+cgosret_ulong CgosI2CType(HCGOS hCgos, unsigned int dwUnit)
+{
+    if(dwUnit == nEmuDdcBus)
+    {
+        return CGOS_I2C_TYPE_DDC;
+    }
+    return (dwUnit == 0) ? CGOS_I2C_TYPE_PRIMARY : CGOS_I2C_TYPE_SMB;
+}
+
+cgosret_bool CgosI2CRead(HCGOS hCgos, unsigned int dwUnit, unsigned char bAddr, unsigned char *pBytes, unsigned int dwLen)
+{
+    CGOSEMU_FILE *pFile;
+    unsigned char *pPointer;
+    UINT32 i;
+
+    CgosEmuDelay(0, 0);
+    if(!(pFile = CgosEmuGetI2CDevice(hCgos, dwUnit, bAddr)))
+    {
+        return FALSE;
+    }
+    // Sequential read from the current address pointer with wrap around
+    pPointer = &nEmuI2CPointer[dwUnit][(bAddr >> 1) & 0x7F];
+    for(i = 0; i < dwLen; i++)
+    {
+        if(!CgosEmuAccess(pFile, (*pPointer) % pFile->nSize, pBytes + i, 1, FALSE))
+        {
+            return FALSE;
+        }
+        *pPointer = (unsigned char)(*pPointer + 1);
+    }
+    return TRUE;
+}
+
+cgosret_bool CgosI2CWrite(HCGOS hCgos, unsigned int dwUnit, unsigned char bAddr, unsigned char *pBytes, unsigned int dwLen)
+{
+    CGOSEMU_FILE *pFile;
+    unsigned char *pPointer;
+    UINT32 i;
+
+    CgosEmuDelay(0, 0);
+    if(!(pFile = CgosEmuGetI2CDevice(hCgos, dwUnit, bAddr)) || !dwLen)
+    {
+        return FALSE;
+    }
+    // First byte sets the address pointer, the following bytes are written
+    pPointer = &nEmuI2CPointer[dwUnit][(bAddr >> 1) & 0x7F];
+    *pPointer = pBytes[0];
+    for(i = 1; i < dwLen; i++)
+    {
+        if(!CgosEmuAccess(pFile, (*pPointer) % pFile->nSize, pBytes + i, 1, TRUE))
+        {
+            return FALSE;
+        }
+        *pPointer = (unsigned char)(*pPointer + 1);
+    }
+    return TRUE;
+}
+
+cgosret_bool CgosI2CReadRegister(HCGOS hCgos, unsigned int dwUnit, unsigned char bAddr, unsigned short wReg, unsigned char *pDataByte)
+{
+    CGOSEMU_FILE *pFile;
+
+    CgosEmuDelay(0, 0);
+    if(!(pFile = CgosEmuGetI2CDevice(hCgos, dwUnit, bAddr)))
+    {
+        return FALSE;
+    }
+    return CgosEmuAccess(pFile, wReg % pFile->nSize, pDataByte, 1, FALSE);
+}
+
+cgosret_bool CgosI2CWriteRegister(HCGOS hCgos, unsigned int dwUnit, unsigned char bAddr, unsigned short wReg, unsigned char bData)
+{
+    CGOSEMU_FILE *pFile;
+
+    CgosEmuDelay(0, 0);
+    if(!(pFile = CgosEmuGetI2CDevice(hCgos, dwUnit, bAddr)))
+    {
+        return FALSE;
+    }
+    return CgosEmuAccess(pFile, wReg % pFile->nSize, &bData, 1, TRUE);
+}
+
+//
+// Board controller
+//
+
+cgosret_bool CgosCgbcSetControl(HCGOS hCgos, unsigned int dwLine, unsigned int dwSetting)
+{
+    return TRUE;
+}
+
+cgosret_bool CgosCgbcReadWrite(HCGOS hCgos, unsigned char bDataByte, unsigned char *pDataByte,
+  unsigned int dwClockDelay, unsigned int dwByteDelay)
+{
+    // Raw board controller communication is not emulated
+    return FALSE;
+}
+
+cgosret_bool CgosCgbcHandleCommand(HCGOS hCgos, unsigned char *pBytesWrite, unsigned int dwLenWrite,
+  unsigned char *pBytesRead, unsigned int dwLenRead, unsigned int *pdwStatus)
+{
+    CGOSEMU_FILE *pFile;
+    UINT32 nPageSize;
+
+    CgosEmuDelay(0, 0);
+
+    // Only the extended AVR SPM commands are emulated
+    if((dwLenWrite < 2) || (pBytesWrite[0] != CGBC_CMD_AVR_SPM_EXT) ||
+       !(pFile = CgosEmuOpenFile(hCgos, "cbcflash.bin", 0)))
+    {
+        return FALSE;
+    }
+
+    *pdwStatus = CGBC_RDY_STAT;
+    switch(pBytesWrite[1])
+    {
+        case CGBC_CMD_AVR_SPM_FLS_ADDR:
+            if(dwLenWrite < 6)
+            {
+                return FALSE;
+            }
+            nEmuSpmAddr = pBytesWrite[2] | (pBytesWrite[3] << 8) | (pBytesWrite[4] << 16) | ((UINT32)pBytesWrite[5] << 24);
+            return TRUE;
+
+        case CGBC_CMD_AVR_SPM_FLS_STAT:
+            if(dwLenRead < 5)
+            {
+                return FALSE;
+            }
+            nPageSize = 256;
+            pBytesRead[0] = CGBC_AVR_SPM_FLS_IDL;
+            memcpy(&pBytesRead[1], &nPageSize, 4);
+            *pdwStatus = CGBC_RDY_STAT | CGBC_DAT_PENDING | (5 - 1);
+            return TRUE;
+
+        case CGBC_CMD_AVR_SPM_FLS_RD32:
+            if((dwLenRead < 32) || ((nEmuSpmAddr + 32) > pFile->nSize) ||
+               !CgosEmuAccess(pFile, nEmuSpmAddr, pBytesRead, 32, FALSE))
+            {
+                return FALSE;
+            }
+            nEmuSpmAddr = nEmuSpmAddr + 32;
+            *pdwStatus = CGBC_RDY_STAT | CGBC_DAT_PENDING | (32 - 1);
+            return TRUE;
+
+        case CGBC_CMD_AVR_SPM_FLS_WR32:
+            if((dwLenWrite < 34) || ((nEmuSpmAddr + 32) > pFile->nSize))
+            {
+                return FALSE;
+            }
+            CgosEmuDelay(nEmuProgramUs, 32);
+            if(!CgosEmuAccess(pFile, nEmuSpmAddr, &pBytesWrite[2], 32, TRUE))
+            {
+                return FALSE;
+            }
+            nEmuSpmAddr = nEmuSpmAddr + 32;
+            return TRUE;
+    }
+    return FALSE;
+}
@@ -0,0 +1,224 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Slim Bootloader (SBL) flash map parser.
+ *           Decodes the component layout (Stage1A/1B/2, payloads, config
+ *           data, ...) of an SBL image and determines the components whose
+ *           contents differ from the flash part. The SBL image is located
+ *           at the end of the flash image, the component offsets of the
+ *           flash map are relative to the start of the SBL image.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "biosflsh.h"
+#include "cgsbl.h"
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+
+
+/*---------------------------------------------------------------------------
+ * Name: CgSblParseMap
+ * Desc: Decodes a flash map candidate.
+ * Inp:  pImage         - Pointer to flash image.
+ *       nImageSize     - Size of flash image.
+ *       nMapOffset     - Offset of the flash map candidate.
+ *       pSbl           - Pointer to storage for the decoded flash map.
+ * Outp: CG_BFRET_OK if the flash map is valid, else CG_BFRET_INVALID.
+ *---------------------------------------------------------------------------
+ */
+static UINT16 CgSblParseMap(unsigned char *pImage, UINT32 nImageSize, UINT32 nMapOffset, CG_SBL_INFO *pSbl)
+{
+    CG_SBL_FLASH_MAP *pMap = (CG_SBL_FLASH_MAP*)(pImage + nMapOffset);
+    CG_SBL_FLASH_MAP_ENTRY *pEntry;
+    UINT32 nSblBase, i;
+
+    if(((nImageSize - nMapOffset) < sizeof(CG_SBL_FLASH_MAP)) ||
+       (pMap->nLength < sizeof(CG_SBL_FLASH_MAP)) ||
+       (pMap->nLength > (nImageSize - nMapOffset)) ||
+       (((pMap->nLength - sizeof(CG_SBL_FLASH_MAP)) % sizeof(CG_SBL_FLASH_MAP_ENTRY)) != 0) ||
+       (((pMap->nLength - sizeof(CG_SBL_FLASH_MAP)) / sizeof(CG_SBL_FLASH_MAP_ENTRY)) > CG_SBL_MAX_COMPONENTS) ||
+       (pMap->nRomSize == 0) || (pMap->nRomSize > nImageSize) ||
+       (nMapOffset < (nImageSize - pMap->nRomSize)))
+    {
+        return CG_BFRET_INVALID;
+    }
+    nSblBase = nImageSize - pMap->nRomSize;
+
+    memset(pSbl, 0, sizeof(CG_SBL_INFO));
+    pSbl->nMapOffset = nMapOffset;
+    pSbl->nMapLength = pMap->nLength;
+    pSbl->nComponents = (pMap->nLength - sizeof(CG_SBL_FLASH_MAP)) / sizeof(CG_SBL_FLASH_MAP_ENTRY);
+    pEntry = (CG_SBL_FLASH_MAP_ENTRY*)(pImage + nMapOffset + sizeof(CG_SBL_FLASH_MAP));
+    for(i = 0; i < pSbl->nComponents; i++, pEntry++)
+    {
+        if((pEntry->nOffset > pMap->nRomSize) || (pEntry->nSize > (pMap->nRomSize - pEntry->nOffset)))
+        {
+            return CG_BFRET_INVALID;
+        }
+        pSbl->components[i].nSignature = pEntry->nSignature;
+        pSbl->components[i].nFlags = pEntry->nFlags;
+        pSbl->components[i].nBase = nSblBase + pEntry->nOffset;
+        pSbl->components[i].nSize = pEntry->nSize;
+        pSbl->components[i].bChanged = TRUE;
+    }
+    return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgSblParse
+ * Desc: Searches a flash image for the SBL flash map and decodes it.
+ *       All components are marked as changed.
+ * Inp:  pImage         - Pointer to flash image.
+ *       nImageSize     - Size of flash image.
+ *       pSbl           - Pointer to storage for the decoded flash map.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_INVALID       - No valid SBL flash map found
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgSblParse(unsigned char *pImage, UINT32 nImageSize, CG_SBL_INFO *pSbl)
+{
+    UINT32 nSignature = CG_SBL_FLMP_SIGNATURE;
+    UINT32 nStart, nOffset;
+
+    for(nStart = 0; nStart < nImageSize; nStart = nStart + nOffset + 4)
+    {
+        if(CgBfFindPattern(pImage + nStart, nImageSize - nStart, (unsigned char*)&nSignature, 4, 4, &nOffset) != CG_BFRET_OK)
+        {
+            break;
+        }
+        if(CgSblParseMap(pImage, nImageSize, nStart + nOffset, pSbl) == CG_BFRET_OK)
+        {
+            return CG_BFRET_OK;
+        }
+    }
+    return CG_BFRET_INVALID;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgSblCompareFlash
+ * Desc: Compares each component of the SBL image with the flash part and
+ *       marks the components that differ. Redundant A/B copies are
+ *       separate components and are compared on their own.
+ *       The flash map in the flash part has to be identical, otherwise all
+ *       components are treated as changed.
+ * Inp:  pSbl               - Decoded flash map of the image (CgSblParse).
+ *       pImage             - Pointer to flash image.
+ *       ulStorageSelector  - Storage area the image is written to.
+ *       pScratch           - Buffer to read flash contents to.
+ *       nScratchSize       - Size of pScratch, at least the flash map length.
+ * Outp: return code:
+ *       CG_BFRET_OK            - Success
+ *       CG_BFRET_ERROR_REGION  - Flash map of the flash part differs
+ *       CG_BFRET_INTRF_ERROR   - Failed to read flash part
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgSblCompareFlash
+(
+    CG_SBL_INFO *pSbl,
+    unsigned char *pImage,
+    UINT32 ulStorageSelector,
+    unsigned char *pScratch,
+    UINT32 nScratchSize
+)
+{
+    CG_SBL_COMPONENT *pComponent;
+    UINT32 i, nPos, nLength;
+
+    if(!CgBfStorageRead(ulStorageSelector, pSbl->nMapOffset, pScratch, pSbl->nMapLength))
+    {
+        return CG_BFRET_INTRF_ERROR;
+    }
+    if(memcmp(pScratch, pImage + pSbl->nMapOffset, pSbl->nMapLength) != 0)
+    {
+        return CG_BFRET_ERROR_REGION;
+    }
+
+    // The whole image is at hand, so the components are compared directly
+    // instead of comparing hashes of both sides.
+    for(i = 0; i < pSbl->nComponents; i++)
+    {
+        pComponent = &pSbl->components[i];
+        pComponent->bChanged = FALSE;
+        for(nPos = 0; nPos < pComponent->nSize; nPos = nPos + nLength)
+        {
+            nLength = ((pComponent->nSize - nPos) < nScratchSize) ? (pComponent->nSize - nPos) : nScratchSize;
+            if(!CgBfStorageRead(ulStorageSelector, pComponent->nBase + nPos, pScratch, nLength))
+            {
+                return CG_BFRET_INTRF_ERROR;
+            }
+            if(memcmp(pScratch, pImage + pComponent->nBase + nPos, nLength) != 0)
+            {
+                pComponent->bChanged = TRUE;
+                break;
+            }
+        }
+    }
+    return CG_BFRET_OK;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgSblIsBlockUnchanged
+ * Desc: Checks whether a flash block is completely covered by unchanged
+ *       SBL components and thus need not be written.
+ * Inp:  pSbl           - Decoded flash map (CgSblCompareFlash).
+ *       nOffset        - Offset of the block.
+ *       nSize          - Size of the block.
+ * Outp: TRUE if the block only holds unchanged components, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgSblIsBlockUnchanged(CG_SBL_INFO *pSbl, UINT32 nOffset, UINT32 nSize)
+{
+    CG_SBL_COMPONENT *pComponent;
+    UINT32 i, nStart, nEnd, nCovered = 0;
+
+    for(i = 0; i < pSbl->nComponents; i++)
+    {
+        pComponent = &pSbl->components[i];
+        nStart = (pComponent->nBase > nOffset) ? pComponent->nBase : nOffset;
+        nEnd = ((pComponent->nBase + pComponent->nSize) < (nOffset + nSize)) ? (pComponent->nBase + pComponent->nSize) : (nOffset + nSize);
+        if(nStart >= nEnd)
+        {
+            continue;
+        }
+        if(pComponent->bChanged)
+        {
+            return FALSE;
+        }
+        nCovered = nCovered + (nEnd - nStart);
+    }
+    // Components do not overlap
+    return (nCovered == nSize) ? TRUE : FALSE;
+}
@@ -0,0 +1,95 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Slim Bootloader (SBL) flash map parser definitions.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+#ifndef _INC_CGSBL
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma pack(push,1)
+
+//----------------------------
+// SBL flash map definitions
+//----------------------------
+#define CG_SBL_FLMP_SIGNATURE   0x504D4C46  // 'FLMP'
+#define CG_SBL_MAX_COMPONENTS   32
+
+// Flash map entry flags
+#define CG_SBL_FLAG_TOP_SWAP    0x01        // Part of the top swap area
+#define CG_SBL_FLAG_REDUNDANT   0x02        // Component of a redundant A/B partition
+#define CG_SBL_FLAG_BACKUP      0x40        // Backup (B) copy of a redundant component
+
+// Flash map as found in the SBL image (FLASH_MAP of the SBL sources)
+typedef struct {
+    UINT32 nSignature;                      // CG_SBL_FLMP_SIGNATURE
+    UINT16 nVersion;
+    UINT16 nLength;                         // Length of header and all entries
+    unsigned char nAttributes;
+    unsigned char nReserved[3];
+    UINT32 nRomSize;                        // Size of the SBL image
+} CG_SBL_FLASH_MAP;
+
+typedef struct {
+    UINT32 nSignature;                      // Component, e.g. 'SG1A', 'PYLD', 'CNFG'
+    UINT32 nFlags;                          // CG_SBL_FLAG_xxx
+    UINT32 nOffset;                         // Offset within the SBL image
+    UINT32 nSize;
+} CG_SBL_FLASH_MAP_ENTRY;
+
+#pragma pack(pop)
+
+//-------------------------
+// Decoded SBL flash map
+//-------------------------
+typedef struct {
+    UINT32 nSignature;
+    UINT32 nFlags;
+    UINT32 nBase;                           // Offset within the flash image
+    UINT32 nSize;
+    UINT16 bChanged;                        // Set by CgSblCompareFlash
+} CG_SBL_COMPONENT;
+
+typedef struct {
+    UINT32 nMapOffset;                      // Offset of the flash map within the flash image
+    UINT32 nMapLength;
+    UINT32 nComponents;
+    CG_SBL_COMPONENT components[CG_SBL_MAX_COMPONENTS];
+} CG_SBL_INFO;
+
+//---------------------
+// Function prototypes
+//---------------------
+extern UINT16 CgSblParse(unsigned char *pImage, UINT32 nImageSize, CG_SBL_INFO *pSbl);
+extern UINT16 CgSblCompareFlash(CG_SBL_INFO *pSbl, unsigned char *pImage, UINT32 ulStorageSelector, unsigned char *pScratch, UINT32 nScratchSize);
+extern UINT16 CgSblIsBlockUnchanged(CG_SBL_INFO *pSbl, UINT32 nOffset, UINT32 nSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _INC_CGSBL
+#endif
@@ -0,0 +1,557 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Flash storage backends.
+ *           The BIOS flash engines access the BIOS flash areas through the
+ *           CgStoreXxx functions. By default they are passed to the CGOS
+ *           interface (BIOS/SMI calls). On Linux the flash part can be
+ *           accessed through an MTD device (e.g. intel-spi driver) instead.
+ *           The MTD device covers the whole flash part: CG32_STORAGE_MPFA_EXTD
+ *           is the whole device, CG32_STORAGE_MPFA_ALL the BIOS region of
+ *           its flash descriptor or the whole device if there is none.
+ *           The MPFA sections (CG32_STORAGE_MPFA_STATIC/_DYNAMIC and
+ *           CG32_STORAGE_FLASH) are served once CgStoreMapMpfaSections has
+ *           located them with the MPFA info structure of the BIOS.
+ *           A plain file can be used as MTD stand-in for testing.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "biosflsh.h"
+#include "cgifd.h"
+#include "cgbmod.h"
+#include "cgstore.h"
+#ifdef LINUX
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <mtd/mtd-user.h>
+#endif
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+static CG_STORE_OPS CgStoreCgosOps;
+static CG_STORE_OPS *pStoreOps = &CgStoreCgosOps;	// Selected backend
+
+//-----------------
+// CGOS backend
+//-----------------
+static UINT32 CgStoreCgosServes(UINT32 ulStorageSelector)
+{
+    return TRUE;
+}
+
+static UINT32 CgStoreCgosSize(UINT32 ulStorageSelector)
+{
+    return CgosStorageAreaSize(hCgos, ulStorageSelector);
+}
+
+static UINT32 CgStoreCgosBlockSize(UINT32 ulStorageSelector)
+{
+    return CgosStorageAreaBlockSize(hCgos, ulStorageSelector);
+}
+
+static UINT32 CgStoreCgosRead(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen)
+{
+    return CgosStorageAreaRead(hCgos, ulStorageSelector, nOffset, pBuffer, nLen);
+}
+
+static UINT32 CgStoreCgosWrite(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen)
+{
+    return CgosStorageAreaWrite(hCgos, ulStorageSelector, nOffset, pBuffer, nLen);
+}
+
+static UINT32 CgStoreCgosErase(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen)
+{
+    return CgosStorageAreaErase(hCgos, ulStorageSelector, nOffset, nLen);
+}
+
+static UINT32 CgStoreCgosEraseStatus(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen, UINT32 *pStatus)
+{
+    return CgosStorageAreaEraseStatus(hCgos, ulStorageSelector, nOffset, nLen, pStatus);
+}
+
+static CG_STORE_OPS CgStoreCgosOps =
+{
+    _T("CGOS"),
+    CgStoreCgosServes,
+    CgStoreCgosSize,
+    CgStoreCgosBlockSize,
+    CgStoreCgosRead,
+    CgStoreCgosWrite,
+    CgStoreCgosErase,
+    CgStoreCgosEraseStatus
+};
+
+#ifdef LINUX
+//-----------------
+// MTD backend
+//-----------------
+static int nMtdFd = -1;
+static UINT16 bMtdFile;						// Plain file instead of MTD device
+static UINT32 nMtdSize, nMtdEraseSize;
+static UINT32 nMtdBiosBase, nMtdBiosSize;	// Location of CG32_STORAGE_MPFA_ALL
+static UINT16 bMtdSections;					// MPFA section locations valid
+static UINT32 nMtdSectionBase[CG_STORE_MPFA_SECTIONS], nMtdSectionSize[CG_STORE_MPFA_SECTIONS];
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreMtdSection
+ * Desc: Returns the index of an MPFA section storage area.
+ * Inp:  ulStorageSelector  - Storage area.
+ * Outp: Index into nMtdSectionBase/nMtdSectionSize or -1 if the storage area
+ *       is no MPFA section.
+ *---------------------------------------------------------------------------
+ */
+static INT32 CgStoreMtdSection(UINT32 ulStorageSelector)
+{
+    switch(ulStorageSelector)
+    {
+        case CG32_STORAGE_MPFA_STATIC:
+            return 0;
+        case CG32_STORAGE_MPFA_DYNAMIC:
+            return 1;
+        case CG32_STORAGE_FLASH:
+            return 2;
+        default:
+            return -1;
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreMtdMap
+ * Desc: Translates a storage area range to a device offset.
+ * Inp:  ulStorageSelector  - CG32_STORAGE_MPFA_ALL or CG32_STORAGE_MPFA_EXTD
+ *       nOffset            - Offset within the storage area.
+ *       nLen               - Length of the range.
+ *       pDevOffset         - Pointer to storage for the device offset.
+ * Outp: TRUE if the range is located within the storage area, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+static UINT32 CgStoreMtdMap(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen, UINT32 *pDevOffset)
+{
+    INT32 nSection = CgStoreMtdSection(ulStorageSelector);
+    UINT32 nBase, nSize;
+
+    if(ulStorageSelector == CG32_STORAGE_MPFA_ALL)
+    {
+        nBase = nMtdBiosBase;
+        nSize = nMtdBiosSize;
+    }
+    else if(ulStorageSelector == CG32_STORAGE_MPFA_EXTD)
+    {
+        nBase = 0;
+        nSize = nMtdSize;
+    }
+    else if(bMtdSections && (nSection >= 0))
+    {
+        nBase = nMtdSectionBase[nSection];
+        nSize = nMtdSectionSize[nSection];
+    }
+    else
+    {
+        return FALSE;
+    }
+    if((nOffset > nSize) || (nLen > (nSize - nOffset)))
+    {
+        return FALSE;
+    }
+    *pDevOffset = nBase + nOffset;
+    return TRUE;
+}
+
+static UINT32 CgStoreMtdServes(UINT32 ulStorageSelector)
+{
+    if(bMtdSections && (CgStoreMtdSection(ulStorageSelector) >= 0))
+    {
+        return TRUE;
+    }
+    return ((ulStorageSelector == CG32_STORAGE_MPFA_ALL) || (ulStorageSelector == CG32_STORAGE_MPFA_EXTD)) ? TRUE : FALSE;
+}
+
+static UINT32 CgStoreMtdSize(UINT32 ulStorageSelector)
+{
+    INT32 nSection = CgStoreMtdSection(ulStorageSelector);
+
+    if(bMtdSections && (nSection >= 0))
+    {
+        return nMtdSectionSize[nSection];
+    }
+    return (ulStorageSelector == CG32_STORAGE_MPFA_ALL) ? nMtdBiosSize : nMtdSize;
+}
+
+static UINT32 CgStoreMtdBlockSize(UINT32 ulStorageSelector)
+{
+    return nMtdEraseSize;
+}
+
+static UINT32 CgStoreMtdRead(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen)
+{
+    UINT32 nDevOffset;
+    ssize_t nDone;
+
+    if(!CgStoreMtdMap(ulStorageSelector, nOffset, nLen, &nDevOffset))
+    {
+        return FALSE;
+    }
+    // One large read, the driver splits it as required
+    while(nLen)
+    {
+        if((nDone = pread(nMtdFd, pBuffer, nLen, nDevOffset)) <= 0)
+        {
+            return FALSE;
+        }
+        pBuffer = pBuffer + nDone;
+        nDevOffset = nDevOffset + (UINT32)nDone;
+        nLen = nLen - (UINT32)nDone;
+    }
+    return TRUE;
+}
+
+static UINT32 CgStoreMtdWrite(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen)
+{
+    UINT32 nDevOffset;
+    ssize_t nDone;
+
+    if(!CgStoreMtdMap(ulStorageSelector, nOffset, nLen, &nDevOffset))
+    {
+        return FALSE;
+    }
+    while(nLen)
+    {
+        if((nDone = pwrite(nMtdFd, pBuffer, nLen, nDevOffset)) <= 0)
+        {
+            return FALSE;
+        }
+        pBuffer = pBuffer + nDone;
+        nDevOffset = nDevOffset + (UINT32)nDone;
+        nLen = nLen - (UINT32)nDone;
+    }
+    return TRUE;
+}
+
+static UINT32 CgStoreMtdErase(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen)
+{
+    struct erase_info_user eraseInfo;
+    unsigned char erased[CG_STORE_FILE_ERASE_SIZE];
+    UINT32 nDevOffset, nPos;
+
+    if(!CgStoreMtdMap(ulStorageSelector, nOffset, nLen, &nDevOffset) ||
+       (nDevOffset % nMtdEraseSize) || (nLen % nMtdEraseSize))
+    {
+        return FALSE;
+    }
+    if(bMtdFile)
+    {
+        memset(erased, 0xFF, sizeof(erased));
+        for(nPos = 0; nPos < nLen; nPos = nPos + sizeof(erased))
+        {
+            if(pwrite(nMtdFd, erased, sizeof(erased), nDevOffset + nPos) != sizeof(erased))
+            {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+    eraseInfo.start = nDevOffset;
+    eraseInfo.length = nLen;
+    return (ioctl(nMtdFd, MEMERASE, &eraseInfo) == 0) ? TRUE : FALSE;
+}
+
+static UINT32 CgStoreMtdEraseStatus(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen, UINT32 *pStatus)
+{
+    // MEMERASE returns when the erase has completed
+    *pStatus = CG_BF_ERASE_STATUS_DONE;
+    return TRUE;
+}
+
+static CG_STORE_OPS CgStoreMtdOps =
+{
+    _T("MTD"),
+    CgStoreMtdServes,
+    CgStoreMtdSize,
+    CgStoreMtdBlockSize,
+    CgStoreMtdRead,
+    CgStoreMtdWrite,
+    CgStoreMtdErase,
+    CgStoreMtdEraseStatus
+};
+#endif
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreOpenMtd
+ * Desc: Selects the MTD backend for the BIOS flash areas.
+ * Inp:  lpszDevice     - MTD device (e.g. /dev/mtd0) or plain file.
+ * Outp: FALSE          - Failed to open the device or not supported
+ *       TRUE           - Success
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgStoreOpenMtd(_TCHAR *lpszDevice)
+{
+#ifdef LINUX
+    struct mtd_info_user mtdInfo;
+    struct stat fileStat;
+    unsigned char descriptor[CG_IFD_SIZE];
+    CG_IFD_INFO ifd;
+    UINT32 nBase, nLimit;
+
+    if(((nMtdFd = open(lpszDevice, O_RDWR)) < 0) || (fstat(nMtdFd, &fileStat) != 0))
+    {
+        CgStoreClose();
+        return FALSE;
+    }
+    bMtdFile = S_ISREG(fileStat.st_mode) ? TRUE : FALSE;
+    if(bMtdFile)
+    {
+        nMtdSize = (UINT32)fileStat.st_size;
+        nMtdEraseSize = CG_STORE_FILE_ERASE_SIZE;
+    }
+    else if(ioctl(nMtdFd, MEMGETINFO, &mtdInfo) == 0)
+    {
+        nMtdSize = mtdInfo.size;
+        nMtdEraseSize = mtdInfo.erasesize;
+    }
+    else
+    {
+        CgStoreClose();
+        return FALSE;
+    }
+    if((nMtdSize == 0) || (nMtdEraseSize == 0) || (nMtdSize % nMtdEraseSize))
+    {
+        CgStoreClose();
+        return FALSE;
+    }
+
+    // The BIOS area is the BIOS region of the flash descriptor
+    nMtdBiosBase = 0;
+    nMtdBiosSize = nMtdSize;
+    if((pread(nMtdFd, descriptor, sizeof(descriptor), 0) == sizeof(descriptor)) &&
+       (CgIfdParse(descriptor, sizeof(descriptor), &ifd) == CG_IFDRET_OK) &&
+       (CgIfdGetRegion(&ifd, CG_IFD_REGION_BIOS, &nBase, &nLimit) == CG_IFDRET_OK) &&
+       ((nLimit + 0x1000) <= nMtdSize) && (nBase < nLimit))
+    {
+        nMtdBiosBase = nBase;
+        nMtdBiosSize = nLimit + 0x1000 - nBase;
+    }
+    pStoreOps = &CgStoreMtdOps;
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreMapMpfaSections
+ * Desc: Locates the MPFA sections in the MTD device, so that the MPFA module
+ *       engine accesses them through the MTD backend as well. The section
+ *       addresses are taken from the MPFA info structure in the BIOS area.
+ *       They are physical addresses below 4GB, the end of the BIOS area is
+ *       mapped to 4GB.
+ * Inp:  nMpfaBlockSize - Block size the MPFA engine erases and writes.
+ * Outp: FALSE          - No MTD backend, MPFA info structure not found or
+ *                        the device can't erase single MPFA blocks
+ *       TRUE           - Success
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgStoreMapMpfaSections(UINT32 nMpfaBlockSize)
+{
+#ifdef LINUX
+    unsigned char *pChunk;
+    CG_MPFA_INFO info;
+    UINT32 nPos, nLen, i, nBiosEnd;
+    UINT32 nStart[CG_STORE_MPFA_SECTIONS], nEnd[CG_STORE_MPFA_SECTIONS];
+    UINT16 bFound = FALSE;
+
+    if((pStoreOps != &CgStoreMtdOps) || (nMpfaBlockSize == 0) || (nMpfaBlockSize % nMtdEraseSize))
+    {
+        return FALSE;
+    }
+    if(!(pChunk = (unsigned char*)malloc(CG_STORE_SCAN_SIZE + sizeof(info))))
+    {
+        return FALSE;
+    }
+
+    // Search the info structure DWORD aligned. The chunks overlap by the size
+    // of the structure, so it is found completely in one chunk.
+    for(nPos = 0; !bFound && (nPos < nMtdBiosSize); nPos = nPos + CG_STORE_SCAN_SIZE)
+    {
+        nLen = nMtdBiosSize - nPos;
+        if(nLen > (CG_STORE_SCAN_SIZE + sizeof(info)))
+        {
+            nLen = CG_STORE_SCAN_SIZE + sizeof(info);
+        }
+        if(!CgStoreMtdRead(CG32_STORAGE_MPFA_ALL, nPos, pChunk, nLen))
+        {
+            break;
+        }
+        for(i = 0; (i + sizeof(info)) <= nLen; i = i + 4)
+        {
+            memcpy(&info, pChunk + i, sizeof(info));
+            if((info.infoIDLow == CG_MPFA_INFO_ID_L) && (info.infoIDHigh == CG_MPFA_INFO_ID_H))
+            {
+                bFound = TRUE;
+                break;
+            }
+        }
+    }
+    free(pChunk);
+    if(!bFound)
+    {
+        return FALSE;
+    }
+
+    nStart[0] = info.mpfaMStart;
+    nEnd[0] = info.mpfaMEnd;
+    nStart[1] = info.mpfaBStart;
+    nEnd[1] = info.mpfaBEnd;
+    nStart[2] = info.mpfaUStart;
+    nEnd[2] = info.mpfaUEnd;
+    nBiosEnd = nMtdBiosBase + nMtdBiosSize;
+    for(i = 0; i < CG_STORE_MPFA_SECTIONS; i++)
+    {
+        nMtdSectionBase[i] = 0;
+        nMtdSectionSize[i] = 0;
+        if((nStart[i] == 0) || (nEnd[i] <= nStart[i]))
+        {
+            // Section not present in this BIOS
+            continue;
+        }
+        // Distance of the section start to 4GB
+        nLen = (0xFFFFFFFF - nStart[i]) + 1;
+        if((nLen > nMtdBiosSize) || ((nEnd[i] - nStart[i]) > nLen) || ((nBiosEnd - nLen) % nMtdEraseSize))
+        {
+            return FALSE;
+        }
+        nMtdSectionBase[i] = nBiosEnd - nLen;
+        nMtdSectionSize[i] = nEnd[i] - nStart[i];
+    }
+    bMtdSections = TRUE;
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreIsCgos
+ * Desc: Tells whether the BIOS flash areas are accessed through CGOS.
+ *       Only the CGOS backend lets the BIOS erase 512KB update blocks itself.
+ * Inp:  none
+ * Outp: TRUE for the CGOS backend, else FALSE.
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgStoreIsCgos(void)
+{
+    return (pStoreOps == &CgStoreCgosOps) ? TRUE : FALSE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreClose
+ * Desc: Closes the MTD backend and selects the CGOS backend again.
+ * Inp:  none
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgStoreClose(void)
+{
+#ifdef LINUX
+    if(nMtdFd >= 0)
+    {
+        close(nMtdFd);
+        nMtdFd = -1;
+    }
+    bMtdSections = FALSE;
+#endif
+    pStoreOps = &CgStoreCgosOps;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreGetName
+ * Desc: Returns the name of the selected backend.
+ * Inp:  none
+ * Outp: Backend name, e.g. "CGOS".
+ *---------------------------------------------------------------------------
+ */
+_TCHAR *CgStoreGetName(void)
+{
+    return pStoreOps->lpszName;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgStoreSize / CgStoreBlockSize / CgStoreRead / CgStoreWrite /
+ *       CgStoreErase / CgStoreEraseStatus
+ * Desc: Storage area access through the selected backend. Areas the
+ *       backend does not serve are accessed through CGOS.
+ *       Same parameters and results as the CgosStorageAreaXxx functions.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgStoreSize(UINT32 ulStorageSelector)
+{
+    CG_STORE_OPS *pOps = pStoreOps->pServes(ulStorageSelector) ? pStoreOps : &CgStoreCgosOps;
+
+    return pOps->pSize(ulStorageSelector);
+}
+
+UINT32 CgStoreBlockSize(UINT32 ulStorageSelector)
+{
+    CG_STORE_OPS *pOps = pStoreOps->pServes(ulStorageSelector) ? pStoreOps : &CgStoreCgosOps;
+
+    return pOps->pBlockSize(ulStorageSelector);
+}
+
+UINT32 CgStoreRead(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen)
+{
+    CG_STORE_OPS *pOps = pStoreOps->pServes(ulStorageSelector) ? pStoreOps : &CgStoreCgosOps;
+
+    return pOps->pRead(ulStorageSelector, nOffset, pBuffer, nLen);
+}
+
+UINT32 CgStoreWrite(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen)
+{
+    CG_STORE_OPS *pOps = pStoreOps->pServes(ulStorageSelector) ? pStoreOps : &CgStoreCgosOps;
+
+    return pOps->pWrite(ulStorageSelector, nOffset, pBuffer, nLen);
+}
+
+UINT32 CgStoreErase(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen)
+{
+    CG_STORE_OPS *pOps = pStoreOps->pServes(ulStorageSelector) ? pStoreOps : &CgStoreCgosOps;
+
+    return pOps->pErase(ulStorageSelector, nOffset, nLen);
+}
+
+UINT32 CgStoreEraseStatus(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen, UINT32 *pStatus)
+{
+    CG_STORE_OPS *pOps = pStoreOps->pServes(ulStorageSelector) ? pStoreOps : &CgStoreCgosOps;
+
+    return pOps->pEraseStatus(ulStorageSelector, nOffset, nLen, pStatus);
+}
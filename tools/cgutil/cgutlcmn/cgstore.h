@@ -0,0 +1,80 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: Flash storage backend definitions.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+#ifndef _INC_CGSTORE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//-------------------------
+// Storage backend
+//-------------------------
+// Access functions of a backend. They follow the semantics of the
+// corresponding CgosStorageAreaXxx functions. A backend only has to serve
+// the BIOS flash areas (CG32_STORAGE_MPFA_ALL / _EXTD), pServes tells
+// which areas it handles. All others are accessed through CGOS.
+typedef struct {
+    _TCHAR *lpszName;
+    UINT32 (*pServes)(UINT32 ulStorageSelector);
+    UINT32 (*pSize)(UINT32 ulStorageSelector);
+    UINT32 (*pBlockSize)(UINT32 ulStorageSelector);
+    UINT32 (*pRead)(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen);
+    UINT32 (*pWrite)(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen);
+    UINT32 (*pErase)(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen);
+    UINT32 (*pEraseStatus)(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen, UINT32 *pStatus);
+} CG_STORE_OPS;
+
+// Erase block size assumed for a plain file used as MTD stand-in
+#define CG_STORE_FILE_ERASE_SIZE    0x1000
+
+// MPFA sections served by the MTD backend (STATIC, DYNAMIC, USER)
+#define CG_STORE_MPFA_SECTIONS      3
+
+// Chunk size used to search the MPFA info structure
+#define CG_STORE_SCAN_SIZE          0x10000
+
+//---------------------
+// Function prototypes
+//---------------------
+extern UINT16 CgStoreOpenMtd(_TCHAR *lpszDevice);
+extern UINT16 CgStoreMapMpfaSections(UINT32 nMpfaBlockSize);
+extern UINT16 CgStoreIsCgos(void);
+extern void CgStoreClose(void);
+extern _TCHAR *CgStoreGetName(void);
+extern UINT32 CgStoreSize(UINT32 ulStorageSelector);
+extern UINT32 CgStoreBlockSize(UINT32 ulStorageSelector);
+extern UINT32 CgStoreRead(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen);
+extern UINT32 CgStoreWrite(UINT32 ulStorageSelector, UINT32 nOffset, unsigned char *pBuffer, UINT32 nLen);
+extern UINT32 CgStoreErase(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen);
+extern UINT32 CgStoreEraseStatus(UINT32 ulStorageSelector, UINT32 nOffset, UINT32 nLen, UINT32 *pStatus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _INC_CGSTORE
+#endif
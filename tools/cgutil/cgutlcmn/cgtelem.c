@@ -0,0 +1,335 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: BIOS update telemetry.
+ *           Writes one JSON object per line to the telemetry file:
+ *           "start"   - Board and BIOS file of an update
+ *           "phase"   - Duration of a phase like reading the BIOS file
+ *           "block"   - One erase, program, verify or compare attempt of a
+ *                       flash block with latency, size and retry number
+ *           "summary" - Time per phase and per operation statistics with
+ *                       latency histogram at the end of an update
+ *           All times are given in microseconds. The file is opened for
+ *           appending so the results of several runs can be collected.
+ *           Updates of several boards in parallel share the file, the
+ *           statistics are kept per worker thread.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------
+ * Include files
+ *---------------
+ */
+#include "cgutlcmn.h"
+#include "cgtelem.h"
+#include <time.h>
+
+/*--------------------
+ * Local definitions
+ *--------------------
+ */
+// Statistics of one block operation
+typedef struct {
+    UINT32 nCount;                          // Attempts
+    UINT32 nFailed;                         // Failed attempts
+    UINT32 nRetries;                        // Attempts that were a retry
+    UINT32 nBytes;                          // Bytes transferred
+    UINT32 nMaxUs;                          // Slowest attempt
+    UINT32 nMaxOffset;                      // Flash offset of the slowest attempt
+    UINT32 nHist[CG_TM_HIST_BUCKETS];
+} CG_TM_OP_STATS;
+
+// Telemetry state of one update
+typedef struct {
+    UINT16 bActive;                         // CgTmBegin has been called
+    UINT32 nBoard;
+    UINT32 nStart;                          // Time stamp of CgTmBegin
+    UINT32 nPhaseUs[CG_TM_PHASE_COUNT];
+    CG_TM_OP_STATS ops[CG_TM_PHASE_COUNT];  // Only used for block operations
+} CG_TM_STATE;
+
+/*------------------
+ * Global variables
+ *------------------
+ */
+static FILE *fpTmFile = NULL;
+static CG_TLS CG_TM_STATE TmState;
+
+static const char *TmPhaseNames[CG_TM_PHASE_COUNT] =
+{
+    "read_file", "read_flash", "backup", "mac_recovery", "compare", "erase", "program", "verify"
+};
+
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmWriteString
+ * Desc: Writes a string as JSON string value.
+ * Inp:  lpszString     - String to write.
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+static void CgTmWriteString(const char *lpszString)
+{
+    fputc('"', fpTmFile);
+    for(; *lpszString; lpszString++)
+    {
+        if((*lpszString == '"') || (*lpszString == '\\'))
+        {
+            fputc('\\', fpTmFile);
+            fputc(*lpszString, fpTmFile);
+        }
+        else if((unsigned char)*lpszString < 0x20)
+        {
+            fprintf(fpTmFile, "\\u%04x", (unsigned char)*lpszString);
+        }
+        else
+        {
+            fputc(*lpszString, fpTmFile);
+        }
+    }
+    fputc('"', fpTmFile);
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmOpen
+ * Desc: Enables the telemetry and opens the telemetry file.
+ * Inp:  lpszFile       - Name of the telemetry file. Events are appended.
+ * Outp: FALSE          - Failed to open the file
+ *       TRUE           - Success
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgTmOpen(_TCHAR *lpszFile)
+{
+    if((fpTmFile = FOPEN(lpszFile, _T("a"))) == NULL)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmClose
+ * Desc: Closes the telemetry file.
+ * Inp:  none
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgTmClose(void)
+{
+    if(fpTmFile)
+    {
+        fclose(fpTmFile);
+        fpTmFile = NULL;
+    }
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmTimeStamp
+ * Desc: Returns a microsecond time stamp. Durations are taken as difference
+ *       of two time stamps and stay valid across a wrap around.
+ * Inp:  none
+ * Outp: Time stamp in microseconds.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgTmTimeStamp(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER nCount, nFrequency;
+    LONGLONG nSeconds, nRemainder;
+
+    QueryPerformanceCounter(&nCount);
+    QueryPerformanceFrequency(&nFrequency);
+    // Split into seconds and remainder, the counter multiplied by 10^6
+    // would overflow after a few days of uptime.
+    nSeconds = nCount.QuadPart / nFrequency.QuadPart;
+    nRemainder = nCount.QuadPart % nFrequency.QuadPart;
+    return (UINT32)((nSeconds * 1000000) + ((nRemainder * 1000000) / nFrequency.QuadPart));
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT32)((ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000));
+#endif
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmBegin
+ * Desc: Starts recording the update of the current board (hCgos) and
+ *       writes the "start" event.
+ * Inp:  nBoard         - Board index reported with each event.
+ *       lpszBiosFile   - BIOS file of the update.
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgTmBegin(UINT32 nBoard, _TCHAR *lpszBiosFile)
+{
+    CGOSBOARDINFO boardInfo;
+
+    if(!fpTmFile)
+    {
+        return;
+    }
+    memset(&TmState, 0, sizeof(TmState));
+    TmState.bActive = TRUE;
+    TmState.nBoard = nBoard;
+    TmState.nStart = CgTmTimeStamp();
+
+    memset(&boardInfo, 0, sizeof(boardInfo));
+    boardInfo.dwSize = sizeof(boardInfo);
+    if(!CgosBoardGetInfo(hCgos, &boardInfo))
+    {
+        memset(&boardInfo, 0, sizeof(boardInfo));
+    }
+
+    CgutlLock();
+    fprintf(fpTmFile, "{\"event\":\"start\",\"board\":%u,\"time\":%lu,\"name\":", nBoard, (unsigned long)time(NULL));
+    CgTmWriteString(boardInfo.szBoard);
+    fprintf(fpTmFile, ",\"serial\":");
+    CgTmWriteString(boardInfo.szSerialNumber);
+    fprintf(fpTmFile, ",\"file\":");
+    CgTmWriteString(lpszBiosFile);
+    fprintf(fpTmFile, "}\n");
+    fflush(fpTmFile);
+    CgutlUnlock();
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmPhase
+ * Desc: Records a phase that started at the given time stamp and ends now.
+ * Inp:  nPhase         - CG_TM_PHASE_xxx
+ *       nStart         - Time stamp taken at the start of the phase.
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgTmPhase(UINT32 nPhase, UINT32 nStart)
+{
+    UINT32 nUs;
+
+    if(!TmState.bActive)
+    {
+        return;
+    }
+    nUs = CgTmTimeStamp() - nStart;
+    TmState.nPhaseUs[nPhase] = TmState.nPhaseUs[nPhase] + nUs;
+
+    CgutlLock();
+    fprintf(fpTmFile, "{\"event\":\"phase\",\"board\":%u,\"phase\":\"%s\",\"us\":%u}\n",
+            TmState.nBoard, TmPhaseNames[nPhase], nUs);
+    fflush(fpTmFile);
+    CgutlUnlock();
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmBlock
+ * Desc: Records one attempt of a block operation that started at the given
+ *       time stamp and ends now.
+ * Inp:  nPhase         - CG_TM_PHASE_COMPARE .. CG_TM_PHASE_VERIFY
+ *       nOffset        - Flash offset of the block.
+ *       nSize          - Size of the block.
+ *       nStart         - Time stamp taken before the operation.
+ *       nRetry         - Retry number, 0 for the first attempt.
+ *       bOk            - FALSE if the operation failed.
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgTmBlock(UINT32 nPhase, UINT32 nOffset, UINT32 nSize, UINT32 nStart, UINT32 nRetry, UINT16 bOk)
+{
+    CG_TM_OP_STATS *pOp = &TmState.ops[nPhase];
+    UINT32 nUs, nBucket;
+
+    if(!TmState.bActive)
+    {
+        return;
+    }
+    nUs = CgTmTimeStamp() - nStart;
+    TmState.nPhaseUs[nPhase] = TmState.nPhaseUs[nPhase] + nUs;
+
+    pOp->nCount++;
+    pOp->nBytes = pOp->nBytes + nSize;
+    if(!bOk)
+    {
+        pOp->nFailed++;
+    }
+    if(nRetry)
+    {
+        pOp->nRetries++;
+    }
+    if(nUs >= pOp->nMaxUs)
+    {
+        pOp->nMaxUs = nUs;
+        pOp->nMaxOffset = nOffset;
+    }
+    for(nBucket = 0; (nBucket < (CG_TM_HIST_BUCKETS - 1)) && (nUs >= ((UINT32)CG_TM_HIST_BASE_US << nBucket)); nBucket++)
+    {
+    }
+    pOp->nHist[nBucket]++;
+
+    CgutlLock();
+    fprintf(fpTmFile, "{\"event\":\"block\",\"board\":%u,\"op\":\"%s\",\"offset\":%u,\"bytes\":%u,\"us\":%u,\"retry\":%u,\"ok\":%s}\n",
+            TmState.nBoard, TmPhaseNames[nPhase], nOffset, nSize, nUs, nRetry, bOk ? "true" : "false");
+    fflush(fpTmFile);
+    CgutlUnlock();
+}
+
+/*---------------------------------------------------------------------------
+ * Name: CgTmEnd
+ * Desc: Writes the "summary" event of the current update and stops
+ *       recording.
+ * Inp:  nResult        - Result of the update (CG_BFRET_xxx).
+ * Outp: none
+ *---------------------------------------------------------------------------
+ */
+void CgTmEnd(UINT32 nResult)
+{
+    CG_TM_OP_STATS *pOp;
+    UINT32 nPhase, nBucket;
+
+    if(!TmState.bActive)
+    {
+        return;
+    }
+    TmState.bActive = FALSE;
+
+    CgutlLock();
+    fprintf(fpTmFile, "{\"event\":\"summary\",\"board\":%u,\"result\":%u,\"us\":%u,\"phases\":{",
+            TmState.nBoard, nResult, CgTmTimeStamp() - TmState.nStart);
+    for(nPhase = 0; nPhase < CG_TM_PHASE_COUNT; nPhase++)
+    {
+        fprintf(fpTmFile, "%s\"%s\":%u", nPhase ? "," : "", TmPhaseNames[nPhase], TmState.nPhaseUs[nPhase]);
+    }
+    fprintf(fpTmFile, "},\"hist_base_us\":%u,\"ops\":{", CG_TM_HIST_BASE_US);
+    for(nPhase = CG_TM_PHASE_COMPARE; nPhase < CG_TM_PHASE_COUNT; nPhase++)
+    {
+        pOp = &TmState.ops[nPhase];
+        fprintf(fpTmFile, "%s\"%s\":{\"count\":%u,\"failed\":%u,\"retries\":%u,\"bytes\":%u,\"max_us\":%u,\"max_offset\":%u,\"hist\":[",
+                (nPhase != CG_TM_PHASE_COMPARE) ? "," : "", TmPhaseNames[nPhase],
+                pOp->nCount, pOp->nFailed, pOp->nRetries, pOp->nBytes, pOp->nMaxUs, pOp->nMaxOffset);
+        for(nBucket = 0; nBucket < CG_TM_HIST_BUCKETS; nBucket++)
+        {
+            fprintf(fpTmFile, "%s%u", nBucket ? "," : "", pOp->nHist[nBucket]);
+        }
+        fprintf(fpTmFile, "]}");
+    }
+    fprintf(fpTmFile, "}}\n");
+    fflush(fpTmFile);
+    CgutlUnlock();
+}
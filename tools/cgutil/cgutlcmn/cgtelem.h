@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------
+ *
+ * Copyright (c) 2023, congatec GmbH. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the BSD 2-clause license which
+ * accompanies this distribution.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the BSD 2-clause license for more details.
+ *
+ * The full text of the license may be found at:
+ * http://opensource.org/licenses/BSD-2-Clause
+ *
+ *---------------------------------------------------------------------------
+ */
+
+/*---------------------------------------------------------------------------
+ *
+ * Contents: BIOS update telemetry definitions.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+#ifndef _INC_CGTELEM
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//--------------------------------
+// Telemetry phases and operations
+//--------------------------------
+// Phases recorded with CgTmPhase
+#define CG_TM_PHASE_READFILE    0           // Read (and expand) the BIOS file
+#define CG_TM_PHASE_READFLASH   1           // Read the flash snapshot
+#define CG_TM_PHASE_BACKUP      2           // Write the backup file
+#define CG_TM_PHASE_MACRECOVERY 3           // MAC address / LAN area recovery
+// Block operations recorded with CgTmBlock
+#define CG_TM_PHASE_COMPARE     4           // Read and compare for /DIFF
+#define CG_TM_PHASE_ERASE       5
+#define CG_TM_PHASE_PROGRAM     6           // Includes the erase for 512KB update blocks
+#define CG_TM_PHASE_VERIFY      7
+#define CG_TM_PHASE_COUNT       8
+
+// Latency histogram of block operations. Bucket n counts operations
+// faster than CG_TM_HIST_BASE_US << n, the last bucket all others.
+#define CG_TM_HIST_BASE_US      64
+#define CG_TM_HIST_BUCKETS      16
+
+//---------------------
+// Function prototypes
+//---------------------
+extern UINT16 CgTmOpen(_TCHAR *lpszFile);
+extern void CgTmClose(void);
+extern void CgTmBegin(UINT32 nBoard, _TCHAR *lpszBiosFile);
+extern void CgTmEnd(UINT32 nResult);
+extern UINT32 CgTmTimeStamp(void);
+extern void CgTmPhase(UINT32 nPhase, UINT32 nStart);
+extern void CgTmBlock(UINT32 nPhase, UINT32 nOffset, UINT32 nSize, UINT32 nStart, UINT32 nRetry, UINT16 bOk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define _INC_CGTELEM
+#endif
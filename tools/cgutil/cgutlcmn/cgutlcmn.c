@@ -51,14 +51,18 @@
  * Local definitions
  *--------------------
  */
+typedef struct {
+    void (*pWorker)(UINT32 nIndex);
+    UINT32 nIndex;
+} CGUTL_WORKER;
 
 /*------------------
  * Global variables
  *------------------
  */
 UINT16 g_nOperationTarget;
-HCGOS hCgos = 0;
-FILE *g_fpBiosRomfile = NULL;
+CG_TLS HCGOS hCgos = 0;								// Board handle of the calling thread
+CG_TLS FILE *g_fpBiosRomfile = NULL;
 UINT16 g_nAccessLevel = CGUTL_ACC_LEV_USER;
 UINT16 g_nBiosReadOnly = FALSE;
 
@@ -117,6 +121,58 @@ UINT16 CgosClose(void)
     return TRUE;          
 }
 
+/*---------------------------------------------------------------------------
+ * Name:        CgosGetBoardCount
+ * Desc:        Get the number of boards provided by the CGOS interface.
+ *              CgosOpen must have been called before.
+ * Inp:         none
+ * Outp:        Number of boards.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgosGetBoardCount(void)
+{
+    return CgosBoardCount(0, 0);
+}
+
+/*---------------------------------------------------------------------------
+ * Name:        CgosOpenBoard
+ * Desc:        Open a board by index for the calling thread. The CGOS 
+ *              library must have been initialized by CgosOpen before.
+ * Inp:         nBoard  - Board index (0 .. CgosGetBoardCount() - 1)
+ * Outp:        Status:
+ *              FALSE   - Error
+ *              TRUE    - Success
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgosOpenBoard(UINT32 nBoard)
+{
+    if (!CgosBoardOpen(0,nBoard,0,&hCgos)) 
+    {
+        hCgos = 0;
+        return FALSE;
+    }
+    return TRUE;          
+}
+
+/*---------------------------------------------------------------------------
+ * Name:        CgosCloseBoard
+ * Desc:        Close the board opened by CgosOpenBoard for the calling
+ *              thread. The CGOS library stays initialized.
+ * Inp:         none
+ * Outp:        Status:
+ *              TRUE    - Success
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgosCloseBoard(void)
+{
+    if (hCgos) 
+    {
+        CgosBoardClose(hCgos);
+        hCgos = 0;
+    }
+    return TRUE;          
+}
+
 /*---------------------------------------------------------------------------
  * Name:        CgutlGetAccessLevel
  * Desc:        Set the access level for the utility. Depending on the 
@@ -160,6 +216,147 @@ UINT16 CgutlGetAccessLevel(void)
     return TRUE;          
 }
 
+/*---------------------------------------------------------------------------
+ * Name:        CgutlGetTickCount
+ * Desc:        Returns a millisecond time stamp for throughput measurements.
+ * Inp:         none
+ * Outp:        Time stamp in milliseconds.
+ *---------------------------------------------------------------------------
+ */
+UINT32 CgutlGetTickCount(void)
+{
+#ifdef WIN32
+    return GetTickCount();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT32)((ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+#endif
+}
+
+#ifdef WIN32
+static CRITICAL_SECTION CgutlLockSection;
+static UINT16 bCgutlLockValid = FALSE;
+
+// The lock is first used by the main thread, i.e. before any worker runs.
+static void CgutlLockInit(void)
+{
+    if(!bCgutlLockValid)
+    {
+        InitializeCriticalSection(&CgutlLockSection);
+        bCgutlLockValid = TRUE;
+    }
+}
+
+static DWORD WINAPI CgutlWorkerThread(LPVOID pParam)
+{
+    CGUTL_WORKER *pWorker = (CGUTL_WORKER*)pParam;
+
+    pWorker->pWorker(pWorker->nIndex);
+    return 0;
+}
+#else
+static pthread_mutex_t CgutlLockMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *CgutlWorkerThread(void *pParam)
+{
+    CGUTL_WORKER *pWorker = (CGUTL_WORKER*)pParam;
+
+    pWorker->pWorker(pWorker->nIndex);
+    return NULL;
+}
+#endif
+
+/*---------------------------------------------------------------------------
+ * Name:        CgutlRunParallel
+ * Desc:        Run a worker function in one thread per index and wait until
+ *              all workers have returned. Engine state declared CG_TLS 
+ *              (e.g. hCgos) is separate for each worker.
+ * Inp:         nCount  - Number of workers.
+ *              pWorker - Worker function, called with index 0 .. nCount - 1.
+ * Outp:        Status:
+ *              FALSE   - Failed to start all workers. Workers already
+ *                        started have completed.
+ *              TRUE    - Success
+ *---------------------------------------------------------------------------
+ */
+UINT16 CgutlRunParallel(UINT32 nCount, void (*pWorker)(UINT32 nIndex))
+{
+    CGUTL_WORKER *pWorkers;
+    UINT32 i, nStarted;
+#ifdef WIN32
+    HANDLE *pThreads;
+#else
+    pthread_t *pThreads;
+#endif
+
+    pWorkers = (CGUTL_WORKER*)malloc(nCount * sizeof(CGUTL_WORKER));
+    pThreads = malloc(nCount * sizeof(pThreads[0]));
+    if(!pWorkers || !pThreads)
+    {
+        free(pWorkers);
+        free(pThreads);
+        return FALSE;
+    }
+#ifdef WIN32
+    CgutlLockInit();
+#endif
+
+    for(nStarted = 0; nStarted < nCount; nStarted++)
+    {
+        pWorkers[nStarted].pWorker = pWorker;
+        pWorkers[nStarted].nIndex = nStarted;
+#ifdef WIN32
+        if((pThreads[nStarted] = CreateThread(NULL, 0, CgutlWorkerThread, &pWorkers[nStarted], 0, NULL)) == NULL)
+#else
+        if(pthread_create(&pThreads[nStarted], NULL, CgutlWorkerThread, &pWorkers[nStarted]) != 0)
+#endif
+        {
+            break;
+        }
+    }
+    for(i = 0; i < nStarted; i++)
+    {
+#ifdef WIN32
+        WaitForSingleObject(pThreads[i], INFINITE);
+        CloseHandle(pThreads[i]);
+#else
+        pthread_join(pThreads[i], NULL);
+#endif
+    }
+    free(pWorkers);
+    free(pThreads);
+    return (nStarted == nCount) ? TRUE : FALSE;
+}
+
+/*---------------------------------------------------------------------------
+ * Name:        CgutlLock / CgutlUnlock
+ * Desc:        Serialize access of parallel workers to shared data, e.g.
+ *              progress output.
+ * Inp:         none
+ * Outp:        none
+ *---------------------------------------------------------------------------
+ */
+void CgutlLock(void)
+{
+#ifdef WIN32
+    CgutlLockInit();
+    EnterCriticalSection(&CgutlLockSection);
+#else
+    pthread_mutex_lock(&CgutlLockMutex);
+#endif
+}
+
+void CgutlUnlock(void)
+{
+#ifdef WIN32
+    LeaveCriticalSection(&CgutlLockSection);
+#else
+    pthread_mutex_unlock(&CgutlLockMutex);
+#endif
+}
+
 #ifdef WIN32
 /*---------------------------------------------------------------------------
  * Name: ClearScreen
@@ -89,7 +89,9 @@ extern "C" {
 #include <malloc.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <ctype.h>
+#include <pthread.h>
 #endif
 
 #include "cgos.h"
@@ -109,6 +111,27 @@ extern "C" {
 #define Sleep(n) usleep(n*1000)
 #endif
 
+// Storage class of engine state that is kept per worker thread, i.e. per board.
+//
+// Threading contract of the engines (BIOS flash, MPFA, IFD, telemetry):
+// - The engines have no context object. All state that belongs to one board
+//   (e.g. hCgos, g_fpBiosRomfile, MPFA section info, flash sizes) is declared
+//   CG_TLS, so each worker of CgutlRunParallel works on its own copy. New
+//   engine state has to be declared CG_TLS as well.
+// - CG_TLS state starts zeroed/initialized in every worker. Nothing set up
+//   by the main thread (e.g. an open board) is visible to the workers.
+// - Globals without CG_TLS (e.g. g_nOperationTarget, g_nAccessLevel) are
+//   set before the workers are started and only read by them.
+// - Data shared by all workers (telemetry file, digest cache, console
+//   output) is only accessed between CgutlLock and CgutlUnlock. The lock
+//   can be used on the single-board path as well.
+// - Workers must not restart or power-cycle the system.
+#ifdef WIN32
+#define CG_TLS __declspec(thread)
+#else
+#define CG_TLS __thread
+#endif
+
 //-------------------
 // Common defintions
 //-------------------
@@ -135,8 +158,8 @@ extern "C" {
 //------------------
 
 extern UINT16 g_nOperationTarget;
-extern HCGOS hCgos;
-extern FILE *g_fpBiosRomfile;
+extern CG_TLS HCGOS hCgos;
+extern CG_TLS FILE *g_fpBiosRomfile;
 extern _TCHAR *g_lpszBiosFilename;
 extern UINT16 g_nAccessLevel;
 extern UINT16 g_nBiosReadOnly;
@@ -151,6 +174,7 @@ extern UINT16 g_nBiosReadOnly;
 #define STRNCMP _wcsnicmp
 #define TOLOWER towlower
 #define SPRINTF wsprintf
+#define SNPRINTF _snwprintf
 
 #else //UNICODE
 
@@ -166,6 +190,11 @@ extern UINT16 g_nBiosReadOnly;
 #define SSCANF sscanf
 #define TOLOWER tolower
 #define SPRINTF sprintf
+#ifdef WIN32
+#define SNPRINTF _snprintf
+#else
+#define SNPRINTF snprintf
+#endif
 
 #endif //_UNICODE
 
@@ -174,8 +203,15 @@ extern UINT16 g_nBiosReadOnly;
 //---------------------
 UINT16 CgosClose(void);
 UINT16 CgosOpen(void);
+UINT32 CgosGetBoardCount(void);
+UINT16 CgosOpenBoard(UINT32 nBoard);
+UINT16 CgosCloseBoard(void);
 UINT16 CgutlGetAccessLevel(void);
 void CgClearScreen(void);
+UINT32 CgutlGetTickCount(void);
+UINT16 CgutlRunParallel(UINT32 nCount, void (*pWorker)(UINT32 nIndex));
+void CgutlLock(void);
+void CgutlUnlock(void);
 
 //---------------------
 // Version definition